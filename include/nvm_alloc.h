@@ -21,12 +21,21 @@ namespace NVM
 #define mfence _mm_sfence
 #define FENCE_METHOD "_mm_sfence"
 
-    static void *PmemMapFile(const std::string &file_name, const size_t file_size, size_t *len)
+    // open 为 true 且文件存在时映射已有的文件并保留其中的数据，否则删除旧文件重新创建
+    static void *PmemMapFile(const std::string &file_name, const size_t file_size, size_t *len, bool open = false)
     {
         int is_pmem;
-        std::filesystem::remove(file_name);
-        void *pmem_addr_ = pmem_map_file(file_name.c_str(), file_size,
-                                         PMEM_FILE_CREATE | PMEM_FILE_EXCL, 0666, len, &is_pmem);
+        void *pmem_addr_;
+        if (open && std::filesystem::exists(file_name))
+        {
+            pmem_addr_ = pmem_map_file(file_name.c_str(), 0, 0, 0666, len, &is_pmem);
+        }
+        else
+        {
+            std::filesystem::remove(file_name);
+            pmem_addr_ = pmem_map_file(file_name.c_str(), file_size,
+                                       PMEM_FILE_CREATE | PMEM_FILE_EXCL, 0666, len, &is_pmem);
+        }
 #ifdef SERVER
         assert(is_pmem == 1);
 #endif
@@ -50,10 +59,18 @@ namespace NVM
     {
 
     public:
-        Alloc(const std::string &file_name, const size_t file_size) {}
+        Alloc(const std::string &file_name, const size_t file_size, bool open = false) {}
 
         virtual ~Alloc() {}
 
+        bool Opened() const { return false; }
+
+        void *BaseAddr() const { return nullptr; }
+
+        size_t Used() const { return 0; }
+
+        void SetUsed(size_t used) {}
+
         void *alloc(size_t size)
         {
             return malloc(size);
@@ -103,10 +120,14 @@ namespace NVM
     {
 
     public:
-        Alloc(const std::string &file_name, const size_t file_size)
+        /**
+         * @param open 为 true 时映射已有的文件，分配位置由恢复出的结构通过 SetUsed 设置
+         */
+        Alloc(const std::string &file_name, const size_t file_size, bool open = false)
         {
             pmem_file_ = file_name;
-            pmem_addr_ = PmemMapFile(pmem_file_, file_size, &mapped_len_);
+            opened_ = open && std::filesystem::exists(file_name);
+            pmem_addr_ = PmemMapFile(pmem_file_, file_size, &mapped_len_, open);
             current_addr = pmem_addr_;
             used_ = freed_ = 0;
             std::cout << "Map addrs:" << pmem_addr_ << std::endl;
@@ -156,7 +177,7 @@ namespace NVM
             size_t reserve = ((uint64_t)current_addr) % align == 0 ? 0 : align - ((uint64_t)current_addr) % align;
             void *p = (char *)current_addr + reserve;
             used_ += size + reserve;
-            current_addr = (char *)(current_addr) + size;
+            current_addr = (char *)p + size;
             assert(used_ <= mapped_len_);
             // std::cout << "Alloc at pos: " << p << std::endl;
             return p;
@@ -186,7 +207,34 @@ namespace NVM
             // free(p);
         }
 
+        // 是否映射的是已有的文件
+        bool Opened() const
+        {
+            return opened_;
+        }
+
+        void *BaseAddr() const
+        {
+            return pmem_addr_;
+        }
+
+        // 当前分配位置相对文件开头的偏移
+        size_t Used() const
+        {
+            return (char *)current_addr - (char *)pmem_addr_;
+        }
+
+        // 恢复时把分配位置移到已使用的部分之后
+        void SetUsed(size_t used)
+        {
+            std::unique_lock<std::mutex> lock(lock_);
+            assert(used <= mapped_len_);
+            current_addr = (char *)pmem_addr_ + used;
+            used_ = used;
+        }
+
     private:
+        bool opened_;
         void *pmem_addr_;
         void *current_addr;
         size_t mapped_len_;
@@ -426,7 +474,8 @@ namespace NVM
     extern Stat const_stat;
 
     int env_init();
-    int data_init();
+    // open 为 true 时映射上次保留的数据池，用于 letree 重启恢复
+    int data_init(bool open = false);
     void env_exit();
     void show_stat();
 
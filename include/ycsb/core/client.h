@@ -236,8 +236,13 @@ template <class db_t>
 inline int KvClient<db_t>::TransactionScan() {
   const uint64_t &key = workload_.NextTransactionIntKey();
   int len = workload_.NextScanLength();
-  std::vector<std::pair<uint64_t, uint64_t>> results;
-  return db_->Scan(key, len, results);
+  // Reuse one buffer per thread so short scans do not allocate per request.
+  static thread_local std::vector<std::pair<uint64_t, uint64_t>> results;
+  if (results.size() < (size_t)len) {
+    results.resize(len);
+  }
+  db_->Scan(key, len, results.data());
+  return KvDB::kOK;
 }
 
 template <class db_t>
@@ -9,6 +9,7 @@
 #ifndef YCSB_C_DB_H_
 #define YCSB_C_DB_H_
 
+#include <algorithm>
 #include <vector>
 #include <string>
 
@@ -113,10 +114,42 @@ class KvDB {
   virtual void Info() { }
   virtual void Begin_trans() {}
   virtual int Put(uint64_t key, uint64_t value) = 0;
+  ///
+  /// Inserts a batch of records. The default implementation calls Put for
+  /// each record; indexes with a batched write path should override it.
+  ///
+  virtual int MultiPut(const std::pair<uint64_t, uint64_t> data[], int size) {
+    for (int i = 0; i < size; i++) {
+      Put(data[i].first, data[i].second);
+    }
+    return kOK;
+  }
   virtual int Get(uint64_t key, uint64_t &value) = 0;
+  ///
+  /// Reads a batch of records. The default implementation calls Get for
+  /// each key; indexes that can overlap the lookups should override it.
+  ///
+  virtual int MultiGet(const uint64_t keys[], int size, uint64_t values[]) {
+    for (int i = 0; i < size; i++) {
+      Get(keys[i], values[i]);
+    }
+    return kOK;
+  }
   virtual int Update(uint64_t key, uint64_t value) = 0;
   virtual int Delete(uint64_t key) = 0;
   virtual int Scan(uint64_t start_key, int len, std::vector<std::pair<uint64_t, uint64_t>>& results) = 0;
+  ///
+  /// Scans into a caller-provided buffer of at least len records and returns
+  /// the number written. The default implementation goes through the vector
+  /// form; indexes that can stream records directly should override it.
+  ///
+  virtual int Scan(uint64_t start_key, int len, KVPair results[]) {
+    std::vector<KVPair> tmp;
+    Scan(start_key, len, tmp);
+    int n = std::min<int>(len, tmp.size());
+    std::copy(tmp.begin(), tmp.begin() + n, results);
+    return n;
+  }
   virtual void PrintStatic() {}
   // virtual int Delete(const std::string &table, const std::string &key) = 0;
   
@@ -4,6 +4,9 @@
 #include <libpmem.h>
 #include <filesystem>
 #include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
 #include "kvbuffer.h"
 #include "sortbuffer.h"
 #include "letree_config.h"
@@ -18,6 +21,14 @@ namespace letree
 
   class BLevel;
 
+  // C 层内存池文件的打开方式
+  enum PoolMode
+  {
+    TempPool,   // 每次新建，析构时删除文件
+    CreatePool, // 新建，析构后保留文件，之后可以用 OpenPool 恢复
+    OpenPool,   // 映射已有的文件并保留其中的数据，文件不存在时按 CreatePool 新建
+  };
+
   // B+ tree
   class __attribute__((packed)) CLevel
   {
@@ -113,15 +124,27 @@ namespace letree
       {
       }
 
-      MemControl(std::string pmem_file, size_t file_size)
-          : pmem_file_(pmem_file + std::to_string(file_id_++)),
-            expand_times(0)
+      /**
+       * @brief TempPool 的文件名加上创建序号，其他模式直接使用 pmem_file，重启时据此找到原来的文件。
+       * 池开头 meta_size 字节留给使用者记录元数据，见 Meta()
+       */
+      MemControl(std::string pmem_file, size_t file_size, PoolMode mode = TempPool)
+          : pmem_file_(mode == TempPool ? pmem_file + std::to_string(file_id_++) : pmem_file),
+            expand_times(0), mode_(mode), opened_(false)
       {
 #ifdef USE_LIBPMEM
         int is_pmem;
-        std::filesystem::remove(pmem_file_);
-        pmem_addr_ = pmem_map_file(pmem_file_.c_str(), file_size + 64,
-                                   PMEM_FILE_CREATE | PMEM_FILE_EXCL, 0666, &mapped_len_, &is_pmem);
+        if (mode == OpenPool && std::filesystem::exists(pmem_file_))
+        {
+          pmem_addr_ = pmem_map_file(pmem_file_.c_str(), 0, 0, 0666, &mapped_len_, &is_pmem);
+          opened_ = true;
+        }
+        else
+        {
+          std::filesystem::remove(pmem_file_);
+          pmem_addr_ = pmem_map_file(pmem_file_.c_str(), file_size + 64,
+                                     PMEM_FILE_CREATE | PMEM_FILE_EXCL, 0666, &mapped_len_, &is_pmem);
+        }
         // assert(is_pmem == 1);
         if (pmem_addr_ == nullptr)
         {
@@ -137,14 +160,17 @@ namespace letree
           base_addr_ = (base_addr_ + 64) & ~(uintptr_t)63;
         }
 
-        cur_addr_ = base_addr_;
+        cur_addr_ = base_addr_ + meta_size;
         end_addr_ = (uint8_t *)pmem_addr_ + mapped_len_;
+        if (!opened_)
+          pmem_memset_persist((void *)base_addr_, 0, meta_size);
 #else // libvmmalloc
         pmem_file_ = "";
         pmem_addr_ = nullptr;
         base_addr_ = (uint64_t) new (std::align_val_t{64}) uint8_t[file_size];
         assert((base_addr_ & 63) == 0);
-        cur_addr_ = base_addr_;
+        memset((void *)base_addr_, 0, meta_size);
+        cur_addr_ = base_addr_ + meta_size;
         end_addr_ = (uint8_t *)base_addr_ + file_size;
 #endif
       }
@@ -154,7 +180,8 @@ namespace letree
         if (!pmem_file_.empty() && pmem_addr_)
         {
           pmem_unmap(pmem_addr_, mapped_len_);
-          std::filesystem::remove(pmem_file_);
+          if (mode_ == TempPool)
+            std::filesystem::remove(pmem_file_);
         }
         else
         {
@@ -179,16 +206,58 @@ namespace letree
       template <class T>
       T *Allocate()
       {
+        if (unlikely(free_count_.load(std::memory_order_acquire) != 0))
+        {
+          T *ret = (T *)Reuse_(sizeof(T));
+          if (ret)
+            return ret;
+        }
         assert((uint8_t *)cur_addr_.load() + sizeof(T) < end_addr_);
         T *ret = (T *)cur_addr_.fetch_add(sizeof(T));
         return ret;
       }
 
+      // 归还不再被引用的节点，按大小放入空闲链表，之后 Allocate 优先复用
+      template <class T>
+      void Free(T *p)
+      {
+        std::lock_guard<std::mutex> lock(free_lock_);
+        free_list_[sizeof(T)].push_back((uintptr_t)p);
+        free_count_.fetch_add(1, std::memory_order_release);
+        freed_bytes_ += sizeof(T);
+      }
+
       uint64_t BaseAddr() const
       {
         return base_addr_;
       }
 
+      static const size_t meta_size = 256;
+
+      // 池开头保留的元数据区，新建的池全部为 0
+      void *Meta() const
+      {
+        return (void *)base_addr_;
+      }
+
+      // 是否映射的是已有的文件
+      bool Opened() const
+      {
+        return opened_;
+      }
+
+      // 当前分配位置相对 BaseAddr 的偏移
+      uint64_t Used() const
+      {
+        return cur_addr_.load() - base_addr_;
+      }
+
+      // 恢复时把分配位置移到已使用的部分之后
+      void SetUsed(uint64_t used)
+      {
+        cur_addr_.store(base_addr_ + std::max<uint64_t>(used, meta_size));
+      }
+
       uint64_t Usage() const
       {
         size_t b = (uint64_t)cur_addr_.load() - base_addr_;
@@ -196,6 +265,7 @@ namespace letree
         size_t mb = kb / 1024;
         double gb = b / 1024.0 / 1024.0 / 1024.0;
         std::cout << pmem_file_ << " used: " << b << " ( " << gb << " Gib, " << mb << " Mib, " << kb % 1024 << " kib.)" << std::endl;
+        std::cout << "freed : " << freed_bytes_ << " bytes, " << free_count_.load() << " nodes to reuse" << std::endl;
         std::cout << "expand_times : " << expand_times << std::endl;
         return (uint64_t)cur_addr_.load() - base_addr_;
       }
@@ -203,13 +273,31 @@ namespace letree
       uint64_t expand_times;
 
     private:
+      void *Reuse_(size_t size)
+      {
+        std::lock_guard<std::mutex> lock(free_lock_);
+        auto it = free_list_.find(size);
+        if (it == free_list_.end() || it->second.empty())
+          return nullptr;
+        void *ret = (void *)it->second.back();
+        it->second.pop_back();
+        free_count_.fetch_sub(1, std::memory_order_release);
+        return ret;
+      }
+
       std::string pmem_file_;
+      PoolMode mode_ = TempPool;
+      bool opened_ = false;
       void *pmem_addr_;
       size_t mapped_len_;
       uint64_t base_addr_;
       std::atomic<uintptr_t> cur_addr_;
       void *end_addr_;
       static int file_id_;
+      std::mutex free_lock_;
+      std::map<size_t, std::vector<uintptr_t>> free_list_; // 空闲节点只记在 DRAM，重启后不复用
+      std::atomic<size_t> free_count_{0};
+      size_t freed_bytes_ = 0;
     };
 
     class Iter
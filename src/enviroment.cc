@@ -14,6 +14,12 @@ namespace letree
 {
     uint64_t scan_buckets = 0;
     uint64_t scan_groups = 0;
+#ifdef DRAM_INDEX
+    thread_local void *bentry_copy = nullptr;
+#endif
+    // LayoutStats 的计数表，开始时有 1 << LayoutStats::min_slot_bits 个槽，之后由 LayoutStats::Reserve 扩大
+    static std::atomic<uint64_t> layout_stats[1 << 13];
+    std::atomic<uint64_t> layout_table{(13UL << 48) | (uint64_t)layout_stats};
 }
 
 namespace NVM
@@ -44,12 +50,12 @@ namespace NVM
         return 0;
     }
 
-    int data_init()
+    int data_init(bool open)
     {
         if (!data_alloc)
         {
 #ifndef USE_MEM
-            data_alloc = new NVM::Alloc(PMEM_DIR "data", data_alloc_size);
+            data_alloc = new NVM::Alloc(PMEM_DIR "data", data_alloc_size, open);
 #endif
         }
         return 0;
@@ -61,6 +67,7 @@ namespace NVM
             delete data_alloc;
         if (common_alloc)
             delete common_alloc;
+        data_alloc = common_alloc = nullptr;
     }
 
     void show_stat()
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include "pmem.h"
+
+namespace letree
+{
+
+  /**
+   * @brief 轻量的 epoch 回收，用于后台 ExpandTree 替换根之后延迟释放旧的 group 数组
+   * 1. 每个线程映射到一个 slot，slot 内按 epoch 奇偶各有一个计数器，读者只写自己的 cache line；
+   * 2. Synchronize() 翻转 epoch 并等待旧奇偶上的操作全部退出，之后旧根不再被任何线程引用；
+   * 3. Synchronize() 只允许一个线程（维护线程）调用。
+   */
+  class EpochManager
+  {
+  public:
+    static const int max_slots = 128;
+
+    class Guard
+    {
+    public:
+      explicit Guard(EpochManager *mgr) : mgr_(mgr)
+      {
+        if (mgr_)
+          parity_ = mgr_->Enter(slot_);
+      }
+
+      ~Guard()
+      {
+        if (mgr_)
+          mgr_->Exit(slot_, parity_);
+      }
+
+      Guard(const Guard &) = delete;
+      Guard &operator=(const Guard &) = delete;
+
+    private:
+      EpochManager *mgr_;
+      int slot_ = 0;
+      int parity_ = 0; // mgr_ 为空时不进入 epoch，初始化以免 -O2 下的 -Wmaybe-uninitialized
+    };
+
+    EpochManager() : epoch_(0)
+    {
+      for (int i = 0; i < max_slots; i++)
+      {
+        slots_[i].active[0].store(0, std::memory_order_relaxed);
+        slots_[i].active[1].store(0, std::memory_order_relaxed);
+      }
+    }
+
+    ALWAYS_INLINE int Enter(int &slot)
+    {
+      slot = ThreadSlot();
+      int parity;
+      do
+      {
+        parity = epoch_.load(std::memory_order_seq_cst) & 1;
+        slots_[slot].active[parity].fetch_add(1, std::memory_order_seq_cst);
+        // epoch flipped between the load and the increment, retry on the new parity
+        if ((int)(epoch_.load(std::memory_order_seq_cst) & 1) == parity)
+          break;
+        slots_[slot].active[parity].fetch_sub(1, std::memory_order_release);
+      } while (true);
+      return parity;
+    }
+
+    ALWAYS_INLINE void Exit(int slot, int parity)
+    {
+      slots_[slot].active[parity].fetch_sub(1, std::memory_order_release);
+    }
+
+    // wait until every operation that started before this call has finished
+    void Synchronize()
+    {
+      int old_parity = epoch_.fetch_add(1, std::memory_order_seq_cst) & 1;
+      for (int i = 0; i < max_slots; i++)
+      {
+        while (slots_[i].active[old_parity].load(std::memory_order_acquire) != 0)
+          std::this_thread::yield();
+      }
+    }
+
+  private:
+    static int ThreadSlot()
+    {
+      static std::atomic<int> next_slot(0);
+      static thread_local int slot = next_slot.fetch_add(1) % max_slots;
+      return slot;
+    }
+
+    struct __attribute__((aligned(64))) Slot
+    {
+      std::atomic<uint64_t> active[2];
+    };
+
+    std::atomic<uint64_t> epoch_;
+    Slot slots_[max_slots];
+  };
+
+} // namespace letree
@@ -11,55 +11,134 @@
 #include "statistic.h"
 #include "nvm_alloc.h"
 #include "debug.h"
+#include "epoch.h"
+#include "manifest.h"
+#include "read_cache.h"
+#include "value_log.h"
 #include <pthread.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <iterator>
+#include <type_traits>
 
-// #define MULTI_THREAD // comment this line for single thread operation
+// #define MULTI_THREAD // default concurrency mode of letree, the mode can also be chosen at runtime
 
 namespace letree
 {
+    enum ConcurrencyMode
+    {
+        SingleThread = 0,      // 单线程，不加锁
+        MultiThread,           // 多线程，扩展期间写者阻塞
+        MultiThreadBackground, // 多线程，维护线程后台扩展
+    };
+
+#ifdef MULTI_THREAD
+    static const ConcurrencyMode default_concurrency_mode = MultiThread;
+#else
+    static const ConcurrencyMode default_concurrency_mode = SingleThread;
+#endif
+
     static const size_t max_entry_count = 1024;
     static const size_t min_entry_count = 64;
-    typedef letree::PointerBEntry bentry_t;
+    static const size_t bulk_load_chunk = min_entry_count * 4096; // 流式 bulk_load 每次读入 DRAM 的 key 数
+    static const size_t root_leaf_groups = 16; // 根模型第二层每个叶子模型平均负责的 group 数
+    static const int multi_get_batch = 32;     // MultiGet 每轮交错执行的 key 数
+#ifdef LOCAL_SPLIT
+    static const double root_window_growth = 2.0; // 局部分裂后根模型平均误差窗口超过全量重建时的倍数后改为全量重建
+#endif
+    /**
+     * @brief group 和 eentry 数组的位置。默认和 C 层节点一样放在 PM；
+     * DRAM_INDEX 时放在 DRAM，查找只在访问 C 层节点时才读 PM，
+     * PM 上另存每个 eentry 数组的副本和 GroupRecord 数组，重启时据此在 DRAM 重建
+     */
+#ifdef DRAM_INDEX
+    static inline void *index_alloc(size_t size)
+    {
+        void *p = nullptr;
+        if (posix_memalign(&p, 64, size) != 0)
+            throw std::bad_alloc();
+        return p;
+    }
+
+    static inline void index_free(void *p, size_t size)
+    {
+        free(p);
+    }
+#else
+    static inline void *index_alloc(size_t size)
+    {
+        return NVM::data_alloc->alloc_aligned(size);
+    }
+
+    static inline void index_free(void *p, size_t size)
+    {
+        NVM::data_alloc->Free(p, size);
+    }
+#endif
+
+    // DRAM_INDEX 时 group 在 PM 上只保留恢复需要的两个字段，池头的根记录指向这个数组
+    template <typename Key>
+    struct GroupRecord
+    {
+        Key min_key;
+        uint64_t entry_record;
+    };
 
     std::mutex log_mutex;
     /**
      * @brief 根模型，采用的是两层RMI模型，
      * 1. 目前实现需要首先 Load一定的数据作为初始化数据；
      * 2. EXPAND_ALL 宏定义控制采用每次扩展所有EntryGroup，还是采用重复指针一次扩展一个EntryGroup
+     * Key 可以是 uint32_t、uint64_t 或 uint128_t，value_size 为 4/8/16 字节，C 层节点的记录数在编译期确定
      */
-    class letree;
-    class __attribute__((aligned(64))) group
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    class basic_letree;
+
+    template <typename Key = uint64_t, const size_t value_size = 8, const size_t node_size = UBUCKET_SIZE, const int fanout = BENTRY_FANOUT>
+    class __attribute__((aligned(64))) basic_group
     {
         // class  group {
     public:
+        typedef basic_group group;
+        typedef PointerBEntry<Key, value_size, node_size, fanout> bentry_t;
+        typedef typename bentry_t::eentry eentry;
+        typedef typename bentry_t::key_type key_type;
+        typedef typename bentry_t::value_type value_type;
+
         class Iter;
         class BEntryIter;
         class EntryIter;
-        friend class letree;
-        group() : nr_entries_(0), next_entry_count(0)
+        friend class basic_letree<Key, value_size, node_size, fanout>;
+        basic_group() : nr_entries_(0), next_entry_count(0)
         {
         }
 
-        group(CLevel::MemControl *clevel_mem)
+        basic_group(CLevel::MemControl *clevel_mem)
         {
         }
 
-        ~group()
+        ~basic_group()
         {
             if (entry_space)
-                NVM::data_alloc->Free(entry_space, nr_entries_ * sizeof(bentry_t));
+                index_free(entry_space, nr_entries_ * sizeof(bentry_t));
+#ifdef DRAM_INDEX
+            FreeEntryCopy_(entry_record_);
+#endif
         }
 
         void Init(CLevel::MemControl *mem);
 
-        void bulk_load(std::vector<std::pair<uint64_t, uint64_t>> &data, CLevel::MemControl *mem);
+        void bulk_load(std::vector<std::pair<key_type, value_type>> &data, CLevel::MemControl *mem);
 
-        void bulk_load(std::vector<std::pair<uint64_t, uint64_t>> &data, size_t start, size_t count, CLevel::MemControl *mem);
-
-        void bulk_load(const std::pair<uint64_t, uint64_t> data[], size_t start, size_t count, CLevel::MemControl *mem);
+        // data 可以是数组、vector 或随机访问迭代器，用 data[start, start + count) 填充已分配好的 entry_space
+        template <typename DataT>
+        void bulk_load(DataT data, size_t start, size_t count, CLevel::MemControl *mem);
 
         void append_entry(const eentry *entry);
 
+        void append_entry(int pos, const eentry *entry);
+
         inline void inc_entry_count()
         {
             next_entry_count++;
@@ -69,31 +148,67 @@ namespace letree
 
         void re_tarin();
 
-        int find_entry(const uint64_t &key) const;
+        // 只用模型预测 entry 下标，MultiGet 据此提前预取 entry_space
+        ALWAYS_INLINE int predict_entry(const key_type &key) const
+        {
+            int m = model.predict(key);
+            return std::min(std::max(0, m), (int)nr_entries_ - 1);
+        }
+
+        int find_entry(const key_type &key) const;
+
+        int exponential_search_upper_bound(int m, const key_type &key) const;
 
-        int exponential_search_upper_bound(int m, const uint64_t &key) const;
+        int binary_search_upper_bound(int l, int r, const key_type &key) const;
 
-        int binary_search_upper_bound(int l, int r, const uint64_t &key) const;
+        int linear_search_upper_bound(int l, int r, const key_type &key) const;
 
-        int linear_search_upper_bound(int l, int r, const uint64_t &key) const;
+        int binary_search_lower_bound(int l, int r, const key_type &key) const;
 
-        int binary_search_lower_bound(int l, int r, const uint64_t &key) const;
+        // tmp 为扩展期间的临时写缓冲，转交给 PointerBEntry
+        status Put(CLevel::MemControl *mem, key_type key, value_type value, TmpWriteBuffer *tmp = nullptr);
 
-        status Put(CLevel::MemControl *mem, uint64_t key, uint64_t value);
+        // 写入一段有序的 key，返回 Full 时 done 之前的 key 已经写入
+        status MultiPut(CLevel::MemControl *mem, const std::pair<key_type, value_type> kvs[], int count, int &done,
+                        TmpWriteBuffer *tmp = nullptr);
 
-        bool Get(CLevel::MemControl *mem, uint64_t key, uint64_t &value) const;
+        bool Get(CLevel::MemControl *mem, key_type key, value_type &value) const;
 
-        bool Scan(CLevel::MemControl *mem, uint64_t start_key, int &len, std::vector<std::pair<uint64_t, uint64_t>> &results, bool if_first) const;
+        // 按 key 顺序把可能包含 [lo, hi] 内 key 的 C 层节点交给 fn，Reverse 为 true 时从 hi 往前，
+        // 返回 false 表示 fn 要求停止或者已经越过范围
+        template <bool Reverse = false, typename BucketFn>
+        bool VisitBuckets(const CLevel::MemControl *mem, key_type lo, key_type hi, BucketFn &&fn) const
+        {
+            if (Reverse)
+            {
+                for (int i = find_entry(hi); i >= 0; i--)
+                {
+                    if (!entry_space[i].template VisitBuckets<true>(mem, lo, hi, fn))
+                        return false;
+                }
+                return true;
+            }
+            int first = find_entry(lo);
+            for (int i = first; i < nr_entries_; i++)
+            {
+                if (i != first && entry_space[i].entry_key > hi)
+                    return false;
+                if (!entry_space[i].VisitBuckets(mem, lo, hi, fn))
+                    return false;
+            }
+            return true;
+        }
 
-        bool fast_fail(CLevel::MemControl *mem, uint64_t key, uint64_t &value);
+        bool fast_fail(CLevel::MemControl *mem, key_type key, value_type &value);
 
-        bool scan_fast_fail(CLevel::MemControl *mem, uint64_t key);
+        bool Update(CLevel::MemControl *mem, key_type key, value_type value);
 
-        bool Update(CLevel::MemControl *mem, uint64_t key, uint64_t value);
+        bool Delete(CLevel::MemControl *mem, key_type key);
 
-        bool Delete(CLevel::MemControl *mem, uint64_t key);
+        // 删除 [lo, hi] 内的 key，max_key 是路由到本 group 的最大 key，返回删除的个数
+        uint64_t DeleteRange(CLevel::MemControl *mem, key_type lo, key_type hi, key_type max_key);
 
-        static inline uint64_t get_entry_key(const bentry_t &entry)
+        static inline key_type get_entry_key(const bentry_t &entry)
         {
             return entry.entry_key;
         }
@@ -102,51 +217,179 @@ namespace letree
 
         void expand(CLevel::MemControl *mem);
 
+        /**
+         * @brief entry_space 和 nr_entries_ 在 PM 上的记录：新数组在数据池中的偏移 / 64 放在高 40 位，
+         * entry 个数放在低 24 位。切换 entry 数组时新数组持久化之后最后更新这 8 字节，作为切换的提交点，
+         * 崩溃后 Recover 只按这条记录重建 entry_space，与映射地址无关。
+         * DRAM_INDEX 时记录的是 PM 上的副本，这里同时生成副本
+         */
+        void SetEntryRecord()
+        {
+#ifdef DRAM_INDEX
+            bentry_t *copy = (bentry_t *)NVM::data_alloc->alloc_aligned(nr_entries_ * sizeof(bentry_t));
+            pmem_memcpy_persist(copy, entry_space, nr_entries_ * sizeof(bentry_t));
+            uint64_t offset = (char *)copy - (char *)NVM::data_alloc->BaseAddr();
+#else
+            uint64_t offset = (char *)entry_space - (char *)NVM::data_alloc->BaseAddr();
+#endif
+            entry_record_ = (offset >> 6) << 24 | (uint64_t)nr_entries_;
+        }
+
+        void CommitEntryRecord()
+        {
+#ifdef DRAM_INDEX
+            uint64_t old_record = entry_record_;
+            SetEntryRecord();
+            if (record_)
+            {
+                record_->entry_record = entry_record_;
+                NVM::Mem_persist(&record_->entry_record, sizeof(uint64_t));
+            }
+            FreeEntryCopy_(old_record);
+#else
+            SetEntryRecord();
+            NVM::Mem_persist(&entry_record_, sizeof(entry_record_));
+#endif
+        }
+
+        /**
+         * @brief 按 entry_record_ 恢复 entry_space，clean 为 false 时重新统计 next_entry_count 并重新训练模型
+         * @return entry 数组（DRAM_INDEX 时为 PM 上的副本）在数据池中的结束位置，没有 entry 时为 nullptr
+         */
+        const char *Recover(char *data_base, bool clean);
+
+        /**
+         * @brief 修改 DRAM 中的 entry 期间设置 bentry_copy，PointerBEntry 在分裂等持久化点直接写 PM 副本；
+         * 作用域结束时再把不经过持久化点的修改（entry_key 变小等）写回。entry 在 PM 上时什么都不做
+         */
+        struct EntrySync
+        {
+#ifdef DRAM_INDEX
+            EntrySync(group *g, int i) : g_(g), i_(i), before_(g->entry_space[i])
+            {
+                bentry_copy = g->EntryCopy_() + i;
+            }
+
+            ~EntrySync()
+            {
+                if (memcmp(&before_, &g_->entry_space[i_], sizeof(bentry_t)) != 0)
+                    pmem_memcpy_persist(bentry_copy, &g_->entry_space[i_], sizeof(bentry_t));
+                bentry_copy = nullptr;
+            }
+
+            group *g_;
+            int i_;
+            bentry_t before_;
+#else
+            EntrySync(group *g, int i) {}
+#endif
+        };
+
         void Show(CLevel::MemControl *mem);
 
         void Info();
 
+        /**
+         * @brief 乐观读：写者在持有 group 锁期间把版本号置为奇数，结束后加到偶数，
+         * 读者无需加锁，读完后版本号没有变化即说明读到的是一致的结果
+         */
+        ALWAYS_INLINE uint64_t read_begin() const
+        {
+            uint64_t v = version_.load(std::memory_order_acquire);
+            while (unlikely(v & 1))
+            {
+                _mm_pause();
+                v = version_.load(std::memory_order_acquire);
+            }
+            return v;
+        }
+
+        ALWAYS_INLINE bool read_validate(uint64_t v) const
+        {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return version_.load(std::memory_order_relaxed) == v;
+        }
+
+        ALWAYS_INLINE void write_begin()
+        {
+            version_.store(version_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+        }
+
+        ALWAYS_INLINE void write_end()
+        {
+            version_.store(version_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
     private:
+#ifdef DRAM_INDEX
+        bentry_t *EntryCopy_() const
+        {
+            return (bentry_t *)((char *)NVM::data_alloc->BaseAddr() + ((entry_record_ >> 24) << 6));
+        }
+
+        static void FreeEntryCopy_(uint64_t record)
+        {
+            if (record != 0)
+                NVM::data_alloc->Free((char *)NVM::data_alloc->BaseAddr() + ((record >> 24) << 6),
+                                      (record & ((1UL << 24) - 1)) * sizeof(bentry_t));
+        }
+#endif
+
         int nr_entries_;       // entry个数
         int next_entry_count;  // 下一次扩展的entry个数
-        uint64_t min_key;      // 最小key
+        key_type min_key;      // 最小key
         bentry_t *entry_space; // entry nvm space
-        LearnModel::rmi_line_model<uint64_t> model;
-        uint8_t reserve[24];
+        LearnModel::rmi_line_model<key_type> model;
+        std::atomic<uint64_t> version_; // 乐观读版本号，奇数表示正在修改
+        uint64_t entry_record_;         // entry 数组的持久化记录，见 SetEntryRecord
+#ifdef DRAM_INDEX
+        GroupRecord<Key> *record_; // PM 上对应的 group 记录，根提交时设置
+#else
+        uint8_t reserve[8];
+#endif
     }; // 每个group 64B
 
-    void group::Init(CLevel::MemControl *mem)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_group<Key, value_size, node_size, fanout>::Init(CLevel::MemControl *mem)
     {
 
+        version_.store(0, std::memory_order_relaxed);
         nr_entries_ = 1;
-        entry_space = (bentry_t *)NVM::data_alloc->alloc_aligned(nr_entries_ * sizeof(bentry_t));
+        entry_space = (bentry_t *)index_alloc(nr_entries_ * sizeof(bentry_t));
 
         new (&entry_space[0]) bentry_t(0, 8, mem);
+        min_key = 0;
 
         NVM::Mem_persist(entry_space, nr_entries_ * sizeof(bentry_t));
-        model.init<bentry_t *, bentry_t>(entry_space, 1, 1, get_entry_key);
+        model.template init<bentry_t *, bentry_t>(entry_space, 1, 1, get_entry_key);
 
         next_entry_count = 1;
+        SetEntryRecord();
         NVM::Mem_persist(this, sizeof(*this));
     }
 
-    void group::bulk_load(std::vector<std::pair<uint64_t, uint64_t>> &data, CLevel::MemControl *mem)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_group<Key, value_size, node_size, fanout>::bulk_load(std::vector<std::pair<key_type, value_type>> &data, CLevel::MemControl *mem)
     {
         nr_entries_ = data.size();
-        bentry_t *new_entry_space = (bentry_t *)NVM::data_alloc->alloc_aligned(nr_entries_ * sizeof(bentry_t));
+        bentry_t *new_entry_space = (bentry_t *)index_alloc(nr_entries_ * sizeof(bentry_t));
         size_t new_entry_count = 0;
         for (size_t i = 0; i < data.size(); i++)
         {
             new (&new_entry_space[new_entry_count++]) bentry_t(data[i].first, data[i].second, mem);
         }
         NVM::Mem_persist(new_entry_space, nr_entries_ * sizeof(bentry_t));
-        model.init<bentry_t *, bentry_t>(new_entry_space, new_entry_count,
+        model.template init<bentry_t *, bentry_t>(new_entry_space, new_entry_count,
                                          std::ceil(1.0 * new_entry_count / 100), get_entry_key);
         entry_space = new_entry_space;
         next_entry_count = nr_entries_;
+        CommitEntryRecord();
     }
 
-    void group::bulk_load(std::vector<std::pair<uint64_t, uint64_t>> &data, size_t start, size_t count, CLevel::MemControl *mem)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    template <typename DataT>
+    void basic_group<Key, value_size, node_size, fanout>::bulk_load(DataT data, size_t start, size_t count, CLevel::MemControl *mem)
     {
         nr_entries_ = count;
         size_t new_entry_count = 0;
@@ -155,60 +398,57 @@ namespace letree
             new (&entry_space[new_entry_count++]) bentry_t(data[start + i].first,
                                                            data[start + i].second, 0, mem);
         }
-        min_key = data[0].first;
+        min_key = data[start].first;
         NVM::Mem_persist(entry_space, nr_entries_ * sizeof(bentry_t));
-        model.init<bentry_t *, bentry_t>(entry_space, new_entry_count,
+        model.template init<bentry_t *, bentry_t>(entry_space, new_entry_count,
                                          std::ceil(1.0 * new_entry_count / 100), get_entry_key);
         next_entry_count = nr_entries_;
+        SetEntryRecord();
     }
 
-    void group::bulk_load(const std::pair<uint64_t, uint64_t> data[], size_t start, size_t count, CLevel::MemControl *mem)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_group<Key, value_size, node_size, fanout>::append_entry(const eentry *entry)
     {
-        nr_entries_ = count;
-        size_t new_entry_count = 0;
-        for (size_t i = 0; i < count; i++)
-        {
-            new (&entry_space[new_entry_count++]) bentry_t(data[start + i].first,
-                                                           data[start + i].second, 0, mem);
-        }
-        min_key = data[0].first;
-        NVM::Mem_persist(entry_space, nr_entries_ * sizeof(bentry_t));
-        model.init<bentry_t *, bentry_t>(entry_space, new_entry_count,
-                                         std::ceil(1.0 * new_entry_count / 100), get_entry_key);
-        next_entry_count = nr_entries_;
+        new (&entry_space[nr_entries_++]) bentry_t(entry);
     }
 
-    void group::append_entry(const eentry *entry)
+    // 并行扩展时各线程按预先算好的位置写入，结束后由调用者设置 nr_entries_
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_group<Key, value_size, node_size, fanout>::append_entry(int pos, const eentry *entry)
     {
-        new (&entry_space[nr_entries_++]) bentry_t(entry);
+        new (&entry_space[pos]) bentry_t(entry);
     }
 
-    void group::reserve_space()
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_group<Key, value_size, node_size, fanout>::reserve_space()
     {
-        entry_space = (bentry_t *)NVM::data_alloc->alloc_aligned(next_entry_count * sizeof(bentry_t));
+        entry_space = (bentry_t *)index_alloc(next_entry_count * sizeof(bentry_t));
     }
 
-    void group::re_tarin()
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_group<Key, value_size, node_size, fanout>::re_tarin()
     {
         assert(nr_entries_ <= next_entry_count);
         pmem_persist(entry_space, nr_entries_ * sizeof(bentry_t));
-        model.init<bentry_t *, bentry_t>(entry_space, nr_entries_,
+        model.template init<bentry_t *, bentry_t>(entry_space, nr_entries_,
                                          std::ceil(1.0 * nr_entries_ / 100), get_entry_key);
         min_key = entry_space[0].entry_key;
+        SetEntryRecord();
         // NVM::Mem_persist(entry_space, nr_entries_ * sizeof(bentry_t));
     }
 
     // alex指数查找
-    int group::find_entry(const uint64_t &key) const
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    int basic_group<Key, value_size, node_size, fanout>::find_entry(const key_type &key) const
     {
-        int m = model.predict(key);
-        m = std::min(std::max(0, m), (int)nr_entries_ - 1);
+        int m = predict_entry(key);
 
         return exponential_search_upper_bound(m, key);
         // return linear_search_upper_bound(m, key);
     }
 
-    int group::exponential_search_upper_bound(int m, const uint64_t &key) const
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    int basic_group<Key, value_size, node_size, fanout>::exponential_search_upper_bound(int m, const key_type &key) const
     {
         int bound = 1;
         int l, r; // will do binary search in range [l, r)
@@ -239,7 +479,8 @@ namespace letree
         return std::max(binary_search_upper_bound(l, r, key) - 1, 0);
     }
 
-    int group::binary_search_upper_bound(int l, int r, const uint64_t &key) const
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    int basic_group<Key, value_size, node_size, fanout>::binary_search_upper_bound(int l, int r, const key_type &key) const
     {
         while (l < r)
         {
@@ -256,14 +497,16 @@ namespace letree
         return l;
     }
 
-    int group::linear_search_upper_bound(int l, int r, const uint64_t &key) const
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    int basic_group<Key, value_size, node_size, fanout>::linear_search_upper_bound(int l, int r, const key_type &key) const
     {
         while (l < r && entry_space[l].entry_key <= key)
             l++;
         return l;
     }
 
-    int group::binary_search_lower_bound(int l, int r, const uint64_t &key) const
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    int basic_group<Key, value_size, node_size, fanout>::binary_search_lower_bound(int l, int r, const key_type &key) const
     {
         while (l < r)
         {
@@ -280,13 +523,18 @@ namespace letree
         return l;
     }
 
-    status group::Put(CLevel::MemControl *mem, uint64_t key, uint64_t value)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    status basic_group<Key, value_size, node_size, fanout>::Put(CLevel::MemControl *mem, key_type key, value_type value, TmpWriteBuffer *tmp)
     {
     retry0:
         int entry_id = find_entry(key);
         bool split = false;
 
-        auto ret = entry_space[entry_id].Put(mem, key, value, &split);
+        status ret;
+        {
+            EntrySync sync(this, entry_id);
+            ret = entry_space[entry_id].Put(mem, key, value, &split, tmp);
+        }
 
         if (split)
         {
@@ -307,72 +555,157 @@ namespace letree
         return ret;
     }
 
-    bool group::Get(CLevel::MemControl *mem, uint64_t key, uint64_t &value) const
-    {
-        int entry_id = find_entry(key);
-        auto ret = entry_space[entry_id].Get(mem, key, value);
-        return ret;
-    }
-
-    bool group::Scan(CLevel::MemControl *mem, uint64_t start_key, int &len, std::vector<std::pair<uint64_t, uint64_t>> &results, bool if_first) const
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    status basic_group<Key, value_size, node_size, fanout>::MultiPut(CLevel::MemControl *mem, const std::pair<key_type, value_type> kvs[], int count, int &done,
+                                                                    TmpWriteBuffer *tmp)
     {
-        int entry_id;
-        bool ret;
-        if (if_first)
+        done = 0;
+        while (done < count)
         {
-            entry_id = 0;
-            ret = entry_space[entry_id].Scan(mem, start_key, len, results, if_first);
-        }
-        else
-        {
-            entry_id = find_entry(start_key);
-            ret = entry_space[entry_id].Scan(mem, start_key, len, results, false);
-        }
-        while (!ret && entry_id < nr_entries_ - 1)
-        {
-            ++entry_id;
-            ret = entry_space[entry_id].Scan(mem, start_key, len, results, false);
+            int entry_id = find_entry(kvs[done].first);
+            int end = count;
+            if (entry_id + 1 < nr_entries_)
+            {
+                end = done + 1;
+                while (end < count && kvs[end].first < entry_space[entry_id + 1].entry_key)
+                    end++;
+            }
+            int n = 0, splits = 0;
+            status ret;
+            {
+                EntrySync sync(this, entry_id);
+                ret = entry_space[entry_id].MultiPut(mem, &kvs[done], end - done, n, splits, tmp);
+            }
+            next_entry_count += splits;
+            done += n;
+            if (ret == status::Full)
+            { // 和 Put 一样，先在 group 内扩展，超过 max_entry_count 后交给上层
+                if ((size_t)next_entry_count > max_entry_count)
+                    return ret;
+                expand(mem);
+            }
         }
-        return ret;
+        return status::OK;
     }
 
-    bool group::fast_fail(CLevel::MemControl *mem, uint64_t key, uint64_t &value)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_group<Key, value_size, node_size, fanout>::Get(CLevel::MemControl *mem, key_type key, value_type &value) const
     {
-        if (nr_entries_ <= 0 || key < min_key)
-            return false;
-        return Get(mem, key, value);
+        int entry_id = find_entry(key);
+        auto ret = entry_space[entry_id].Get(mem, key, value);
+        return ret;
     }
 
-    bool group::scan_fast_fail(CLevel::MemControl *mem, uint64_t key)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_group<Key, value_size, node_size, fanout>::fast_fail(CLevel::MemControl *mem, key_type key, value_type &value)
     {
         if (nr_entries_ <= 0 || key < min_key)
             return false;
-        return true;
+        return Get(mem, key, value);
     }
 
-    bool group::Update(CLevel::MemControl *mem, uint64_t key, uint64_t value)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_group<Key, value_size, node_size, fanout>::Update(CLevel::MemControl *mem, key_type key, value_type value)
     {
         int entry_id = find_entry(key);
+        EntrySync sync(this, entry_id);
         auto ret = entry_space[entry_id].Update(mem, key, value);
         return ret;
     }
 
-    bool group::Delete(CLevel::MemControl *mem, uint64_t key)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_group<Key, value_size, node_size, fanout>::Delete(CLevel::MemControl *mem, key_type key)
     {
         int entry_id = find_entry(key);
+        EntrySync sync(this, entry_id);
         auto ret = entry_space[entry_id].Delete(mem, key, nullptr);
         return ret;
     }
 
-    void group::expand(CLevel::MemControl *mem)
+    /**
+     * @brief 区间删除：逐个 entry 摘除被覆盖的 C 层节点，整个被覆盖的 entry 从 entry_space 中去掉，
+     * 它负责的 key 由前一个 entry 接管；group 至少保留一个 entry，min_key 不变
+     */
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    uint64_t basic_group<Key, value_size, node_size, fanout>::DeleteRange(CLevel::MemControl *mem, key_type lo, key_type hi, key_type max_key)
+    {
+        int first = find_entry(lo);
+        int end = first;
+        uint64_t removed = 0;
+        std::vector<int> covered;
+        for (; end < (int)nr_entries_ && (end == first || entry_space[end].entry_key <= hi); end++)
+        {
+            key_type last = end + 1 < (int)nr_entries_ ? entry_space[end + 1].entry_key - 1 : max_key;
+            int dropped = 0;
+            int nodes = entry_space[end].buf.entries;
+            EntrySync sync(this, end);
+            removed += entry_space[end].DeleteRange(mem, lo, hi, last, dropped);
+            if (dropped == nodes)
+                covered.push_back(end);
+            else
+                next_entry_count -= dropped;
+        }
+        if (covered.empty())
+        {
+            return removed;
+        }
+        if ((int)covered.size() == nr_entries_)
+        {
+            // 整个 group 被覆盖，保留第一个 entry 的第一个节点
+            EntrySync sync(this, covered[0]);
+            next_entry_count -= entry_space[covered[0]].Truncate(mem);
+            covered.erase(covered.begin());
+            if (covered.empty())
+                return removed;
+        }
+
+        // 和 expand 一样在旁边生成新的 entry 数组，持久化之后再切换
+        int new_entry_count = nr_entries_ - covered.size();
+        bentry_t *old_entry_space = entry_space;
+        int old_entry_count = nr_entries_;
+        bentry_t *new_entry_space = (bentry_t *)index_alloc(new_entry_count * sizeof(bentry_t));
+        int n = 0;
+        for (int i = 0, j = 0; i < old_entry_count; i++)
+        {
+            if (j < (int)covered.size() && covered[j] == i)
+            {
+                j++;
+                continue;
+            }
+            new_entry_space[n++] = entry_space[i];
+        }
+        assert(n == new_entry_count);
+        NVM::Mem_persist(new_entry_space, new_entry_count * sizeof(bentry_t));
+
+        model.template init<bentry_t *, bentry_t>(new_entry_space, new_entry_count,
+                                         std::ceil(1.0 * new_entry_count / 100), get_entry_key);
+        entry_space = new_entry_space;
+        nr_entries_ = new_entry_count;
+        for (int i : covered)
+        {
+            next_entry_count -= old_entry_space[i].buf.entries;
+        }
+        CommitEntryRecord();
+        NVM::Mem_persist(this, sizeof(*this));
+
+        for (int i : covered)
+        {
+            old_entry_space[i].FreeBuckets(mem);
+        }
+        index_free(old_entry_space, old_entry_count * sizeof(bentry_t));
+        return removed;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_group<Key, value_size, node_size, fanout>::expand(CLevel::MemControl *mem)
     {
-        bentry_t::EntryIter it;
-        bentry_t *new_entry_space = (bentry_t *)NVM::data_alloc->alloc_aligned(next_entry_count * sizeof(bentry_t));
+        typename bentry_t::EntryIter it;
+        bentry_t *new_entry_space = (bentry_t *)index_alloc(next_entry_count * sizeof(bentry_t));
         size_t new_entry_count = 0;
         entry_space[0].AdjustEntryKey(mem);
         for (size_t i = 0; i < nr_entries_; i++)
         {
-            new (&it) bentry_t::EntryIter(&entry_space[i]);
+            new (&it) typename bentry_t::EntryIter(&entry_space[i]);
             while (!it.end())
             {
                 new (&new_entry_space[new_entry_count++]) bentry_t(&(*it));
@@ -388,20 +721,57 @@ namespace letree
 
         NVM::Mem_persist(new_entry_space, new_entry_count * sizeof(bentry_t));
 
-        model.init<bentry_t *, bentry_t>(new_entry_space, new_entry_count,
+        model.template init<bentry_t *, bentry_t>(new_entry_space, new_entry_count,
                                          std::ceil(1.0 * new_entry_count / 100), get_entry_key);
         entry_space = new_entry_space;
         nr_entries_ = new_entry_count;
         next_entry_count = nr_entries_;
+        CommitEntryRecord();
         mem->expand_times++;
     }
 
-    void group::AdjustEntryKey(CLevel::MemControl *mem)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    const char *basic_group<Key, value_size, node_size, fanout>::Recover(char *data_base, bool clean)
+    {
+        version_.store(0, std::memory_order_relaxed); // 崩溃时可能停在写入中途，版本号不能再是奇数
+        if (entry_record_ == 0)
+        {
+            // 扩展时没有分到 entry 的 group
+            entry_space = nullptr;
+            nr_entries_ = next_entry_count = 0;
+            return nullptr;
+        }
+        bentry_t *entries = (bentry_t *)(data_base + ((entry_record_ >> 24) << 6));
+        nr_entries_ = entry_record_ & ((1UL << 24) - 1);
+#ifdef DRAM_INDEX
+        // 模型没有存到 PM，总是重新训练
+        entry_space = (bentry_t *)index_alloc(nr_entries_ * sizeof(bentry_t));
+        memcpy((void *)entry_space, entries, nr_entries_ * sizeof(bentry_t));
+        clean = false;
+#else
+        entry_space = entries;
+#endif
+        const char *end = (const char *)(entries + nr_entries_);
+        if (clean)
+            return end;
+        // 模型和 next_entry_count 可能停在切换 entry 数组或节点分裂的中途
+        next_entry_count = 0;
+        for (int i = 0; i < nr_entries_; i++)
+            next_entry_count += entry_space[i].buf.entries;
+        model.template init<bentry_t *, bentry_t>(entry_space, nr_entries_,
+                                         std::ceil(1.0 * nr_entries_ / 100), get_entry_key);
+        return end;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_group<Key, value_size, node_size, fanout>::AdjustEntryKey(CLevel::MemControl *mem)
     {
+        EntrySync sync(this, 0);
         entry_space[0].AdjustEntryKey(mem);
     }
 
-    void group::Show(CLevel::MemControl *mem)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_group<Key, value_size, node_size, fanout>::Show(CLevel::MemControl *mem)
     {
         std::cout << "Group Entry count:" << nr_entries_ << std::endl;
         double total = 0;
@@ -412,22 +782,24 @@ namespace letree
         std::cout << "Average kv count per bucket: " << total / nr_entries_ << std::endl;
     }
 
-    void group::Info()
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_group<Key, value_size, node_size, fanout>::Info()
     {
         std::cout << "nr_entrys: " << nr_entries_ << "\t";
         std::cout << "entry size:" << sizeof(bentry_t) << "\t";
         // clevel_mem_->Usage();
     }
 
-    static_assert(sizeof(group) == 64);
+    static_assert(sizeof(basic_group<uint64_t, 8>) == 64);
 
-    class group::BEntryIter
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    class basic_group<Key, value_size, node_size, fanout>::BEntryIter
     {
     public:
         using difference_type = ssize_t;
-        using value_type = const uint64_t;
-        using pointer = const uint64_t *;
-        using reference = const uint64_t &;
+        using value_type = const key_type;
+        using pointer = const key_type *;
+        using reference = const key_type &;
         using iterator_category = std::random_access_iterator_tag;
 
         BEntryIter(group *root) : root_(root) {}
@@ -435,7 +807,7 @@ namespace letree
         ~BEntryIter()
         {
         }
-        uint64_t operator*()
+        key_type operator*()
         {
             return root_->entry_space[idx_].entry_key;
         }
@@ -462,7 +834,7 @@ namespace letree
             return BEntryIter(root_, idx_--);
         }
 
-        uint64_t operator[](size_t i) const
+        key_type operator[](size_t i) const
         {
             if ((i + idx_) > root_->nr_entries_)
             {
@@ -488,21 +860,22 @@ namespace letree
         uint64_t idx_;
     };
 
-    class group::Iter
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    class basic_group<Key, value_size, node_size, fanout>::Iter
     {
     public:
         Iter(group *root, CLevel::MemControl *mem) : root_(root), mem_(mem), idx_(0)
         {
             if (root->nr_entries_ == 0)
                 return;
-            new (&biter_) bentry_t::Iter(&root_->entry_space[idx_], mem);
+            new (&biter_) typename bentry_t::Iter(&root_->entry_space[idx_], mem);
         }
-        Iter(group *root, uint64_t start_key, CLevel::MemControl *mem) : root_(root), mem_(mem)
+        Iter(group *root, key_type start_key, CLevel::MemControl *mem) : root_(root), mem_(mem)
         {
             if (root->nr_entries_ == 0)
                 return;
             idx_ = root->find_entry(start_key);
-            new (&biter_) bentry_t::Iter(&root_->entry_space[idx_], mem, start_key);
+            new (&biter_) typename bentry_t::Iter(&root_->entry_space[idx_], mem, start_key);
             if (biter_.end())
             {
                 next();
@@ -512,12 +885,12 @@ namespace letree
         {
         }
 
-        uint64_t key()
+        key_type key()
         {
             return biter_.key();
         }
 
-        uint64_t value()
+        value_type value()
         {
             return biter_.value();
         }
@@ -531,7 +904,7 @@ namespace letree
             idx_++;
             if (idx_ < root_->nr_entries_)
             {
-                new (&biter_) bentry_t::Iter(&root_->entry_space[idx_], mem_);
+                new (&biter_) typename bentry_t::Iter(&root_->entry_space[idx_], mem_);
                 return true;
             }
             return false;
@@ -545,16 +918,17 @@ namespace letree
     private:
         group *root_;
         CLevel::MemControl *mem_;
-        bentry_t::Iter biter_;
+        typename bentry_t::Iter biter_;
         uint64_t idx_;
     };
 
-    class group::EntryIter
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    class basic_group<Key, value_size, node_size, fanout>::EntryIter
     {
     public:
         EntryIter(group *group) : group_(group), cur_idx(0)
         {
-            new (&biter_) bentry_t::EntryIter(&group_->entry_space[cur_idx]);
+            new (&biter_) typename bentry_t::EntryIter(&group_->entry_space[cur_idx]);
         }
         const eentry &operator*() { return *biter_; }
 
@@ -569,7 +943,7 @@ namespace letree
             {
                 return false;
             }
-            new (&biter_) bentry_t::EntryIter(&group_->entry_space[cur_idx]);
+            new (&biter_) typename bentry_t::EntryIter(&group_->entry_space[cur_idx]);
             return true;
         }
 
@@ -580,557 +954,2340 @@ namespace letree
 
     private:
         group *group_;
-        bentry_t::EntryIter biter_;
+        typename bentry_t::EntryIter biter_;
         uint64_t cur_idx;
     };
 
     class EntryIter;
 
-    class letree
+    /**
+     * @brief find_group 的计数，按线程分片，每片独占一个 cache line，Info() 时相加。
+     * 每个线程只写自己的分片，用 relaxed 的读和写代替原子加，线程数超过分片数时共用分片可能少计几次。
+     * inline 变量，所有翻译单元共用一份
+     */
+    struct alignas(64) FindGroupStat
+    {
+        std::atomic<uint64_t> calls; // find_group 调用次数
+        std::atomic<uint64_t> steps; // 从预测位置向外查找和修正时访问的 group 数
+        std::atomic<uint64_t> error; // 预测位置和目标 group 之间相差的 group 数
+    };
+    static const int find_group_stat_slots = 64;
+    inline FindGroupStat find_group_stats[find_group_stat_slots];
+
+    static inline FindGroupStat &FindGroupSlot()
+    {
+        static std::atomic<int> next_slot(0);
+        static thread_local int slot = next_slot.fetch_add(1) % find_group_stat_slots;
+        return find_group_stats[slot];
+    }
+
+    static inline void NoteFindGroup(uint64_t steps, uint64_t error)
+    {
+        FindGroupStat &st = FindGroupSlot();
+        st.calls.store(st.calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        st.steps.store(st.steps.load(std::memory_order_relaxed) + steps, std::memory_order_relaxed);
+        st.error.store(st.error.load(std::memory_order_relaxed) + error, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 按 key 和值的宽度实例化的 letree，各层类型都从 group 取得。
+     * 值日志只用于 8 字节的值，tmp_buffer 只用于 8 字节的 key 和值，其他宽度在 MultiThreadBackground 下也在前台扩展。
+     * node_size 和 fanout 决定 C 层节点的大小和每个 PointerBEntry 的节点个数（见 PointerBEntry），
+     * 默认值由 CMake 的 UBUCKET_SIZE 和 BENTRY_FANOUT 给出，shape_bench 对比不同的组合
+     */
+    template <typename Key = uint64_t, const size_t value_size = 8, const size_t node_size = UBUCKET_SIZE, const int fanout = BENTRY_FANOUT>
+    class basic_letree
     {
     public:
+        typedef basic_group<Key, value_size, node_size, fanout> group;
+        typedef typename group::bentry_t bentry_t;
+        typedef typename bentry_t::buncket_t buncket_t;
+        typedef typename bentry_t::buncket_ref buncket_ref;
+        typedef typename bentry_t::eentry eentry;
+        typedef Key key_type;
+        typedef typename bentry_t::value_type value_type;
+        static constexpr key_type kMaxKey = ~key_type(0);
+
         friend class EntryIter;
         class Iter;
 
-    public:
-        letree() : nr_groups_(0), root_expand_times(0)
-#ifdef MULTI_THREAD
-#ifndef USE_TMP_WRITE_BUFFER
-                   ,
-                   is_tree_expand(false)
+    private:
+        /**
+         * @brief 树根：group 数组 + 根模型 + 每个 group 的锁，
+         * ExpandTree 在旁边生成新的 TreeRoot，之后通过 root_ 一次原子替换
+         */
+        struct TreeRoot
+        {
+            group *group_space;
+            int nr_groups_;
+            LearnModel::rmi_bound_model<key_type> model; // 两层根模型，直接预测 group 下标
+            pthread_mutex_t *lock_space;                  // 单线程模式下为 nullptr
+            double base_window = 0;                       // 最近一次全量重建后根模型的平均误差窗口
+            bool entries_moved = false;                   // 局部分裂后未分裂 group 的 eentry 数组转给了新根
+            std::vector<int> split_groups;                // entries_moved 时，只有这些 group 的 eentry 数组归旧根释放
+#ifdef DRAM_INDEX
+            GroupRecord<Key> *records = nullptr; // PM 上的 group 记录，提交根时生成
 #endif
+
+            ALWAYS_INLINE int predict_group(key_type key) const
+            {
+                return model.predict(key);
+            }
+
+            ALWAYS_INLINE int predict_group(key_type key, int &lo, int &hi) const
+            {
+                return model.predict(key, lo, hi);
+            }
+
+            // key 是否落在 group_id 的范围内，和 find_group 一样按 min_key 划分，判断失败时交给 find_group
+            ALWAYS_INLINE bool in_group(int group_id, key_type key) const
+            {
+                return group_space[group_id].nr_entries_ != 0 && key >= group_space[group_id].min_key &&
+                       (group_id == nr_groups_ - 1 || key < group_space[group_id + 1].min_key);
+            }
+
+#ifdef LOCAL_SPLIT
+            // 局部分裂让热点区间的 group 变密，根模型误差变大到一定程度后才需要全量重建
+            bool degraded() const
+            {
+                return model.avg_window() > root_window_growth * base_window + 1;
+            }
 #endif
-        {
-            clevel_mem_ = new CLevel::MemControl(CLEVEL_PMEM_FILE, CLEVEL_PMEM_FILE_SIZE);
-        }
+        };
 
-        ~letree()
-        {
+    public:
+        /**
+         * @param mode 并发模式，SingleThread 下不加锁、不维护版本号和 epoch；
+         * MultiThreadBackground 下 ExpandTree 交给维护线程执行，前台 Put/Get 在旧结构上继续运行
+         * @param pool TempPool 时退出后删除 C 层内存池；CreatePool 和 OpenPool 时保留内存池并在池头记录根，
+         * OpenPool 下先调用 Recover 从上次保留的内存池恢复，失败时再按 Init 或 bulk_load 新建。
+         * 恢复还需要用 NVM::data_init(true) 映射上次的数据池，数据池只能由一棵可恢复的树使用
+         */
+        basic_letree(ConcurrencyMode mode = default_concurrency_mode, PoolMode pool = TempPool)
+            : root_(nullptr), root_expand_times(0), root_split_times(0),
+              concurrent_(mode != SingleThread),
+              // FAST&FAIR 的 tmp_buffer 只能存 8 字节的 key 和值，其他宽度的树在前台扩展
+              background_expand_(mode == MultiThreadBackground && bentry_t::use_tmp_buffer),
+              expand_running_(false), expand_stop_(false), pool_(pool)
+        {
+            clevel_mem_ = new CLevel::MemControl(pool == TempPool ? CLEVEL_PMEM_FILE : CLEVEL_PMEM_FILE "letree",
+                                                 CLEVEL_PMEM_FILE_SIZE, pool);
+        }
+
+        ~basic_letree()
+        {
+            if (gc_thread_.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(gc_req_lock_);
+                    gc_stop_ = true;
+                }
+                gc_req_cv_.notify_all();
+                gc_thread_.join();
+            }
+            if (vlog_)
+                delete vlog_;
+            if (expand_thread_.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(expand_req_lock_);
+                    expand_stop_ = true;
+                }
+                expand_req_cv_.notify_all();
+                expand_thread_.join();
+            }
+            TreeRoot *r = root();
+            if (r && pool_ != TempPool)
+            {
+                // PM 上的 group 和 C 层节点留给下次 Recover，这里只释放 DRAM 部分
+                pmem_persist(r->group_space, r->nr_groups_ * sizeof(group));
+                MarkClean_();
+#ifdef DRAM_INDEX
+                for (int i = 0; i < r->nr_groups_; i++)
+                    index_free(r->group_space[i].entry_space, r->group_space[i].nr_entries_ * sizeof(bentry_t));
+                index_free(r->group_space, r->nr_groups_ * sizeof(group));
+#endif
+                if (r->lock_space)
+                    delete[] r->lock_space;
+                delete r;
+            }
+            else if (r)
+            {
+                FreeRoot_(r);
+            }
             if (clevel_mem_)
                 delete clevel_mem_;
-            if (group_space)
-                NVM::data_alloc->Free(group_space, nr_groups_ * sizeof(group));
-
-#ifdef MULTI_THREAD
-            if (lock_space)
-                delete[] lock_space;
-#endif
+            if (read_cache_)
+                delete read_cache_;
         }
 
         void Init()
         {
-            nr_groups_ = 1;
-            group_space = (group *)NVM::data_alloc->alloc_aligned(sizeof(group));
-#ifdef MULTI_THREAD
-            lock_space = new pthread_mutex_t[1];
-            lock_space[0] = PTHREAD_MUTEX_INITIALIZER;
-#endif
-            group_space[0].Init(clevel_mem_);
-#ifdef MULTI_THREAD
-#ifdef USE_TMP_WRITE_BUFFER
-            tmp_buffer = new FastFair::btree();
-#endif
-#endif
+            TreeRoot *new_root = new TreeRoot();
+            new_root->nr_groups_ = 1;
+            new_root->group_space = (group *)index_alloc(sizeof(group));
+            new_root->lock_space = NewLockSpace_(1);
+            new_root->group_space[0].Init(clevel_mem_);
+            SetRoot_(new_root);
+            StartWorkers_();
         }
 
-        static inline uint64_t first_key(const std::pair<uint64_t, uint64_t> &kv)
+        /**
+         * @brief 从 OpenPool 映射的内存池恢复，代替 Init。根据池头找到上次提交的 group 数组，
+         * 按各 group 的 entry 记录重建 entry_space，重建根模型、锁等 DRAM 状态。
+         * 上次没有正常关闭时扫描所有 eentry 重新计算两个池的分配位置
+         * @return 没有可恢复的树时返回 false
+         */
+        bool Recover();
+
+        static inline key_type first_key(const std::pair<key_type, value_type> &kv)
         {
             return kv.first;
         }
 
-        void bulk_load(std::vector<std::pair<uint64_t, uint64_t>> &data);
+        void bulk_load(std::vector<std::pair<key_type, value_type>> &data);
 
-        void bulk_load(const std::pair<uint64_t, uint64_t> data[], int size);
+        void bulk_load(const std::pair<key_type, value_type> data[], int size);
 
-        status Put(uint64_t key, uint64_t value);
+        /**
+         * @brief 从有序的 [first, last) 批量加载，随机访问迭代器直接按 group 并行构建；
+         * 其他迭代器每次只读入 bulk_load_chunk 个 key，按块并行构建，整个输入不需要常驻 DRAM
+         */
+        template <typename InputIt>
+        void bulk_load(InputIt first, InputIt last);
 
-        bool Update(uint64_t key, uint64_t value);
+        status Put(key_type key, value_type value);
 
-        bool Get(uint64_t key, uint64_t &value);
+        /**
+         * @brief 批量写入，先按 key 排序，落在同一个 group 的一段 key 只查找一次根、加一次锁，
+         * group 内再按 PointerBEntry 和 C 层节点分段写入，每个 C 层节点的一段 key 合并 flush/fence
+         */
+        status MultiPut(const std::pair<key_type, value_type> data[], int size);
 
-        bool Scan(uint64_t start_key, int len, std::vector<std::pair<uint64_t, uint64_t>> &results);
+        bool Update(key_type key, value_type value);
 
-        bool Delete(uint64_t key);
+        bool Get(key_type key, value_type &value);
 
-        int find_group(const uint64_t &key) const;
+        /**
+         * @brief 批量点查，每 multi_get_batch 个 key 按 根模型 → group → PointerBEntry → C 层节点
+         * 分阶段交错执行，每个阶段先为所有 key 预取下一层，再进入下一阶段，使多个 key 的 PM 访问延迟互相重叠
+         * @param found 可以为 nullptr
+         * @return 找到的 key 个数
+         */
+        int MultiGet(const key_type keys[], int size, value_type values[], bool found[] = nullptr);
 
-        bool find_fast(uint64_t key, uint64_t &value) const;
+        bool Scan(key_type start_key, int len, std::vector<std::pair<key_type, value_type>> &results);
 
-        bool scan_fast(uint64_t start_key, int &len, std::vector<std::pair<uint64_t, uint64_t>> &results) const;
+        /**
+         * @brief 从 start_key 开始按 key 顺序把最多 len 个记录交给 visit(key, value)，
+         * 直接从 C 层节点读出，不经过中间容器，也不做堆分配
+         * @return 访问的记录个数
+         */
+        template <typename Visitor>
+        int Scan(key_type start_key, int len, Visitor &&visit);
 
-        bool find_slow(uint64_t key, uint64_t &value) const;
+        // 结果写入调用者提供的 results[0, len)，返回写入的个数
+        int Scan(key_type start_key, int len, std::pair<key_type, value_type> results[]);
+
+        /**
+         * @brief 按 key 顺序访问 [lo, hi) 内的所有记录，hi 之后的 C 层节点不会被读取和排序。
+         * 和 Scan(start_key, len) 区分开命名，避免 len 和 hi 的整数类型决定调用哪个重载
+         * @return 访问的记录个数
+         */
+        template <typename Visitor>
+        uint64_t ScanRange(key_type lo, key_type hi, Visitor &&visit);
+
+        uint64_t ScanRange(key_type lo, key_type hi, std::vector<std::pair<key_type, value_type>> &results);
+
+        /**
+         * @brief 从 start_key 开始按 key 从大到小访问最多 len 个 <= start_key 的记录
+         * @return 访问的记录个数
+         */
+        template <typename Visitor>
+        int ReverseScan(key_type start_key, int len, Visitor &&visit);
+
+        int ReverseScan(key_type start_key, int len, std::pair<key_type, value_type> results[]);
+
+        bool Delete(key_type key);
+
+        /**
+         * @brief 删除 [lo, hi] 内的所有 key，整个被覆盖的 C 层节点直接摘除并归还给分配器，
+         * 只有区间两端的节点逐个删除，开销和涉及的节点数成正比
+         * @return 删除的 key 个数
+         */
+        uint64_t DeleteRange(key_type lo, key_type hi);
+
+        /**
+         * @brief 打开值日志，之后用 PutValue/GetValue/DeleteValue 读写变长的值，树中只保存值在日志中的偏移。
+         * 日志和 C 层内存池使用同样的 PoolMode，OpenPool 时在 Recover 之后调用，按树中的偏移重新统计各段的存活字节数。
+         * 多线程模式下启动后台回收线程。打开值日志之后不要再用 Put/Update 写入普通的值。
+         * 日志记录中的 key 是 8 字节，只用于 key 不超过 8 字节、值为 8 字节的树
+         */
+        void OpenValueLog(size_t size = VALUE_LOG_FILE_SIZE);
+
+        // 值先追加到当前线程的日志段并持久化，再把偏移写入树，key 已存在时覆盖，旧的记录成为垃圾
+        status PutValue(key_type key, const void *data, uint32_t len);
+
+        bool GetValue(key_type key, std::string &value);
+
+        bool DeleteValue(key_type key);
+
+        /**
+         * @brief 回收一个垃圾最多的日志段：逐条检查记录是否仍被树引用，存活的记录搬到回收专用的段，
+         * 在 group 锁内确认偏移没有被并发的写入改掉之后才改写树中的偏移
+         * @return 回收的字节数，没有值得回收的段时返回 0
+         */
+        size_t CollectValueLog();
+
+        ValueLog *value_log() const
+        {
+            return vlog_;
+        }
+
+        CLevel::MemControl *clevel_mem() const
+        {
+            return clevel_mem_;
+        }
+
+        int find_group(const key_type &key) const
+        {
+            return find_group(root(), key);
+        }
+
+        bool find_fast(key_type key, value_type &value) const
+        {
+            return find_fast(root(), key, value);
+        }
+
+        /**
+         * @brief 在 Get 前面放一个 bytes 大小的 DRAM 热点读缓存，0 表示关闭。
+         * 只缓存 Get 命中的 key，写操作在持有 group 锁时同步更新缓存；MultiGet 和 Scan 不经过缓存。
+         * 调用时不能有其他操作并发执行
+         */
+        void SetReadCache(size_t bytes)
+        {
+            if (read_cache_)
+                delete read_cache_;
+            read_cache_ = bytes ? new ReadCache<key_type, value_type>(bytes) : nullptr;
+        }
+
+        ReadCache<key_type, value_type> *read_cache() const
+        {
+            return read_cache_;
+        }
+
+        bool find_slow(key_type key, value_type &value) const
+        {
+            return find_slow(root(), key, value);
+        }
 
-#ifdef MULTI_THREAD
         ALWAYS_INLINE void trans_begin()
         {
-            if (is_tree_expand.load(std::memory_order_acquire))
+            if (!background_expand_ && tmp_.is_tree_expand.load(std::memory_order_acquire))
             {
                 std::unique_lock<std::mutex> lock(expand_wait_lock);
-                expand_wait_cv.wait(lock);
+                expand_wait_cv.wait(lock, [this]
+                                    { return !tmp_.is_tree_expand.load(std::memory_order_acquire); });
             }
         }
-#endif
-
-        bool scan_slow(uint64_t start_key, int &len, std::vector<std::pair<uint64_t, uint64_t>> &results, int fast_group_id = 0) const;
 
         void ExpandTree();
 
+        ConcurrencyMode mode() const
+        {
+            return !concurrent_ ? SingleThread : (background_expand_ ? MultiThreadBackground : MultiThread);
+        }
+
         void Show()
         {
-            for (int i = 0; i < nr_groups_; i++)
+            TreeRoot *r = root();
+            for (int i = 0; i < r->nr_groups_; i++)
             {
                 std::cout << "Group [" << i << "].\n";
-                group_space[i].Show(clevel_mem_);
+                r->group_space[i].Show(clevel_mem_);
             }
         }
 
         void Info()
         {
             std::cout << "root_expand_times : " << root_expand_times << std::endl;
+            std::cout << "root_split_times : " << root_split_times << std::endl;
             clevel_mem_->Usage();
-            cout << "nr_groups_ : " << nr_groups_ << endl;
+            cout << "nr_groups_ : " << root()->nr_groups_ << endl;
+            uint64_t calls = 0, steps = 0, error = 0;
+            for (int i = 0; i < find_group_stat_slots; i++)
+            {
+                calls += find_group_stats[i].calls.load(std::memory_order_relaxed);
+                steps += find_group_stats[i].steps.load(std::memory_order_relaxed);
+                error += find_group_stats[i].error.load(std::memory_order_relaxed);
+            }
+            cout << "find_group calls : " << calls << ", avg steps : " << (calls ? 1.0 * steps / calls : 0)
+                 << ", avg prediction error : " << (calls ? 1.0 * error / calls : 0) << endl;
+            if (read_cache_)
+                read_cache_->Info();
+            if (vlog_)
+                vlog_->Info();
             cout << endl;
         }
 
     private:
-        group *group_space;
-        int nr_groups_;
-        LearnModel::rmi_line_model<uint64_t> model;
-        CLevel::MemControl *clevel_mem_;
-        int entries_per_group = min_entry_count;
+        ALWAYS_INLINE TreeRoot *root() const
+        {
+            return root_.load(std::memory_order_acquire);
+        }
+
+        // 单线程模式下不需要 epoch 保护
+        ALWAYS_INLINE EpochManager *epoch()
+        {
+            return concurrent_ ? &epoch_ : nullptr;
+        }
+
+        pthread_mutex_t *NewLockSpace_(int n) const
+        {
+            if (!concurrent_)
+                return nullptr;
+            // std::mutex *lock_space = new std::mutex[n];
+            pthread_mutex_t *lock_space = new pthread_mutex_t[n];
+            for (int i = 0; i < n; i++)
+                lock_space[i] = PTHREAD_MUTEX_INITIALIZER;
+            return lock_space;
+        }
+
+        // 写入树之后调用，多线程模式下调用者持有 key 所在 group 的锁，保证缓存和树中的值按同样的顺序更新
+        ALWAYS_INLINE void CacheUpdate_(key_type key, value_type value)
+        {
+            if (read_cache_)
+                read_cache_->Update(key, value);
+        }
+
+        ALWAYS_INLINE void CacheErase_(key_type key)
+        {
+            if (read_cache_)
+                read_cache_->Erase(key);
+        }
+
+        int find_group(const TreeRoot *r, const key_type &key) const;
+
+        bool find_fast(const TreeRoot *r, key_type key, value_type &value) const;
+
+        bool find_slow(const TreeRoot *r, key_type key, value_type &value) const;
+
+        uint64_t DeleteRange_(TreeRoot *r, key_type lo, key_type hi);
+
+        // 扫描的公共入口，持有 epoch，扩展期间和 tmp_buffer 归并。
+        // 正向访问 [from, to] 内最多 len 个记录，Reverse 时从 from 往下访问 [to, from]
+        template <bool Reverse, typename Visitor>
+        uint64_t Scan_(key_type from, key_type to, uint64_t len, Visitor &visit);
+
+        // 在根 r 上扫描，调用者持有 epoch。多线程模式下每个 C 层节点先复制到栈上，
+        // 校验 group 版本号之后才交给 visit，校验失败时从最后交出的 key 之后重新定位
+        template <bool Reverse, typename Visitor>
+        uint64_t ScanRoot_(const TreeRoot *r, key_type from, key_type to, uint64_t len, Visitor &visit) const;
+
+        // 值日志的读写者持有，回收的段在它们退出之后才重用
+        ALWAYS_INLINE EpochManager *vlog_epoch()
+        {
+            return concurrent_ ? vlog_->epoch() : nullptr;
+        }
+
+        /**
+         * @brief 写入当前根，group 满时返回 Full，由调用者决定如何扩展。
+         * old 不为空时 key 已存在则原地更新，通过 old 返回旧值并返回 Exist
+         */
+        status Put_(key_type key, value_type value, value_type *old = nullptr);
+
+        // Put 和 PutValue 共用的写入循环，group 满时扩展后重试
+        status Upsert_(key_type key, value_type value, value_type *old);
+
+        // expected 不为空时只有当前值等于 *expected 才更新，用于值日志回收改写偏移
+        bool Update_(key_type key, value_type value, const value_type *expected);
+
+        // old 不为空时通过它返回删除的值
+        bool Delete_(key_type key, value_type *old);
+
+        // 追加到值日志，没有空闲段时先回收，仍然没有空间时返回 0
+        uint64_t AppendValue_(key_type key, const void *data, uint32_t len);
+
+        // 追加之后调用，空闲段不多时唤醒后台回收线程，单线程模式下就地回收
+        void WakeCollector_();
+
+        void GcWorker_();
+
+        friend class StringLetree;
+
+        // 把 kvs 开头落在同一个 group 的一段 key 写入当前根，返回 Full 时 done 之前的 key 已经写入
+        status MultiPut_(const std::pair<key_type, value_type> kvs[], int count, int &done);
+
+        // 按 ROOT_EXPAND_THREADS 个线程并行构建 group_space[0, ceil(size / min_entry_count))
+        template <typename DataT>
+        void BulkLoadGroups_(group *group_space, DataT data, size_t size);
+
+        template <typename DataT>
+        TreeRoot *BulkLoadRoot_(DataT data, size_t size);
+
+        template <typename InputIt>
+        TreeRoot *BulkLoadStream_(InputIt first, InputIt last);
+
+        // 根据旧根的所有 eentry 训练新模型并生成新的 group 数组，旧根保持不变
+        TreeRoot *BuildRoot_(TreeRoot *old_root);
+
+        // 选择局部分裂或者全量重建生成新根
+        TreeRoot *RebuildRoot_(TreeRoot *old_root);
+
+#ifdef LOCAL_SPLIT
+        // 只把 split_keys 所在且已满的 group 拆成多个 group，其余 group 原样复制，返回 nullptr 表示无需分裂
+        TreeRoot *SplitRoot_(TreeRoot *old_root, const std::vector<key_type> &split_keys);
+#endif
+
+        // 用每个 group 的 min_key 训练两层根模型
+        void TrainRoot_(TreeRoot *r);
+
+        void FreeRoot_(TreeRoot *r);
+
+        void RequestExpand_();
+
+        void ExpandWorker_();
+
+        void ExpandLoop_();
+
+        bool DrainTmpBuffer_();
+
+        // 多线程模式下创建 tmp_buffer 和后台扩展线程，Init 和 Recover 之后调用
+        void StartWorkers_()
+        {
+            if (concurrent_)
+            {
+#ifdef USE_TMP_WRITE_BUFFER
+                if (bentry_t::use_tmp_buffer && tmp_.buffer == nullptr)
+                    tmp_.buffer = new FastFair::btree();
+#endif
+                if (background_expand_)
+                    expand_thread_ = std::thread(&basic_letree::ExpandWorker_, this);
+            }
+        }
+
+        LetreeHead *Head_() const
+        {
+            return (LetreeHead *)clevel_mem_->Meta();
+        }
+
+        // 把持久化好的新根提交到池头，之后重启会从新根恢复
+        void CommitRoot_(const TreeRoot *r);
+
+        // 正常关闭时记录两个池的分配位置
+        void MarkClean_();
+
+#ifdef DRAM_INDEX
+        // 在 PM 上生成新根的 GroupRecord 数组，并让每个 group 指向自己的记录
+        void PersistGroups_(TreeRoot *r);
+#endif
+
+        // 发布新根，可恢复的树先提交到池头，新根上的写入（节点分裂等）不能早于提交落到 PM
+        void SetRoot_(TreeRoot *r)
+        {
+#ifdef DRAM_INDEX
+            PersistGroups_(r);
+#endif
+            CommitRoot_(r);
+            root_.store(r, std::memory_order_release);
+        }
+
+        bool TmpBufferGet_(key_type key, value_type &value) const;
+
+        // 扩展期间 key 已在 tmp_buffer 中时直接在 tmp_buffer 中覆盖，调用者持有 key 所在 group 的锁
+        bool TmpBufferPut_(key_type key, value_type value, value_type *old);
+
+        std::atomic<TreeRoot *> root_;
+        CLevel::MemControl *clevel_mem_;
+        int entries_per_group = min_entry_count;
         uint64_t root_expand_times;
+        uint64_t root_split_times;
+        std::mutex split_lock_;
+        std::vector<key_type> split_keys_; // 返回 Full 的 key，扩展时据此找到需要分裂的 group
+
+        std::mutex expand_wait_lock;
+        std::condition_variable expand_wait_cv;
+        TmpWriteBuffer tmp_; // is_tree_expand 和扩展期间的临时写缓冲
+        EpochManager epoch_;
+        const bool concurrent_;
+        const bool background_expand_;
+        std::atomic_bool expand_running_; // 扩展从开始到 tmp_buffer 回放完成期间为 true
+        ReadCache<key_type, value_type> *read_cache_ = nullptr;
+        ValueLog *vlog_ = nullptr;
+        std::thread gc_thread_;
+        std::mutex gc_req_lock_;
+        std::condition_variable gc_req_cv_;
+        bool gc_stop_ = false;
+        std::thread expand_thread_;
+        std::mutex expand_req_lock_;
+        std::condition_variable expand_req_cv_;
+        bool expand_stop_;
+        const PoolMode pool_;
+    };
+
+    // 原有的 8 字节 key、8 字节值的树
+    typedef basic_letree<> letree;
+
+    template <typename Func>
+    static void RunRanges_(int nthreads, Func &&func)
+    {
+        if (nthreads <= 1)
+        {
+            func(0);
+            return;
+        }
+        std::vector<std::thread> threads;
+        for (int t = 1; t < nthreads; t++)
+            threads.emplace_back(func, t);
+        func(0);
+        for (auto &t : threads)
+            t.join();
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    template <typename DataT>
+    void basic_letree<Key, value_size, node_size, fanout>::BulkLoadGroups_(group *group_space, DataT data, size_t size)
+    {
+        // 每个 group 的输入区间由下标直接算出，各线程负责一段连续的 group，互不依赖
+        int nr_groups = (int)((size + min_entry_count - 1) / min_entry_count);
+        int nthreads = std::max(1, std::min(ROOT_EXPAND_THREADS, nr_groups));
+        RunRanges_(nthreads, [&](int t)
+                   {
+            int begin = (int)((size_t)nr_groups * t / nthreads);
+            int end = (int)((size_t)nr_groups * (t + 1) / nthreads);
+            for (int i = begin; i < end; i++)
+            {
+                size_t start = (size_t)i * min_entry_count;
+                group_space[i].next_entry_count = std::min(min_entry_count, size - start);
+                group_space[i].reserve_space();
+                group_space[i].bulk_load(data, start, group_space[i].next_entry_count, clevel_mem_);
+            }
+            pmem_persist(&group_space[begin], (end - begin) * sizeof(group)); });
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    template <typename DataT>
+    typename basic_letree<Key, value_size, node_size, fanout>::TreeRoot *basic_letree<Key, value_size, node_size, fanout>::BulkLoadRoot_(DataT data, size_t size)
+    {
+        TreeRoot *new_root = new TreeRoot();
+
+        // 每 min_entry_count 个 key 一个 group，根模型只负责预测 group 下标
+        new_root->nr_groups_ = std::max(1, (int)std::ceil(1.0 * size / min_entry_count));
+        new_root->group_space = (group *)index_alloc(new_root->nr_groups_ * sizeof(group));
+        pmem_memset_persist(new_root->group_space, 0, new_root->nr_groups_ * sizeof(group));
+        new_root->lock_space = NewLockSpace_(new_root->nr_groups_);
+        if (size == 0)
+            new_root->group_space[0].Init(clevel_mem_);
+        else
+            BulkLoadGroups_(new_root->group_space, data, size);
+        TrainRoot_(new_root);
+        new_root->base_window = new_root->model.avg_window();
+        return new_root;
+    }
+
+    /**
+     * @brief 流式批量加载：输入按 bulk_load_chunk 分块读入 DRAM，块大小是 min_entry_count 的整数倍，
+     * 每块生成的 group 接在已有 group 之后；group 数组容量不够时加倍并复制 group 头，entry 数组不移动
+     */
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    template <typename InputIt>
+    typename basic_letree<Key, value_size, node_size, fanout>::TreeRoot *basic_letree<Key, value_size, node_size, fanout>::BulkLoadStream_(InputIt first, InputIt last)
+    {
+        TreeRoot *new_root = new TreeRoot();
+        std::vector<std::pair<key_type, value_type>> chunk;
+        chunk.reserve(bulk_load_chunk);
+        int nr_groups = 0;
+        int capacity = 0;
+        group *group_space = nullptr;
+        while (first != last)
+        {
+            chunk.clear();
+            for (; first != last && chunk.size() < bulk_load_chunk; ++first)
+                chunk.push_back(*first);
+            int chunk_groups = (int)((chunk.size() + min_entry_count - 1) / min_entry_count);
+            if (nr_groups + chunk_groups > capacity)
+            {
+                int new_capacity = std::max(nr_groups + chunk_groups, capacity * 2);
+                group *new_group_space = (group *)index_alloc(new_capacity * sizeof(group));
+                pmem_memset_persist(new_group_space, 0, new_capacity * sizeof(group));
+                if (group_space)
+                {
+                    pmem_memcpy_persist(new_group_space, group_space, nr_groups * sizeof(group));
+                    index_free(group_space, capacity * sizeof(group));
+                }
+                group_space = new_group_space;
+                capacity = new_capacity;
+            }
+            BulkLoadGroups_(group_space + nr_groups, chunk.data(), chunk.size());
+            nr_groups += chunk_groups;
+        }
+        if (nr_groups == 0)
+        {
+            group_space = (group *)index_alloc(sizeof(group));
+            group_space[0].Init(clevel_mem_);
+            nr_groups = capacity = 1;
+        }
+#ifndef DRAM_INDEX
+        // DRAM 中的数组不能只释放尾部，留到释放整个根时一起释放
+        if (capacity > nr_groups)
+            NVM::data_alloc->Free(group_space + nr_groups, (capacity - nr_groups) * sizeof(group));
+#endif
+
+        new_root->nr_groups_ = nr_groups;
+        new_root->group_space = group_space;
+        new_root->lock_space = NewLockSpace_(nr_groups);
+        TrainRoot_(new_root);
+        new_root->base_window = new_root->model.avg_window();
+        return new_root;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_letree<Key, value_size, node_size, fanout>::bulk_load(std::vector<std::pair<key_type, value_type>> &data)
+    {
+        TreeRoot *old_root = root();
+        SetRoot_(BulkLoadRoot_<const std::pair<key_type, value_type> *>(data.data(), data.size()));
+        if (read_cache_)
+            read_cache_->Clear();
+        if (old_root)
+            FreeRoot_(old_root);
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_letree<Key, value_size, node_size, fanout>::bulk_load(const std::pair<key_type, value_type> data[], int size)
+    {
+        TreeRoot *old_root = root();
+        SetRoot_(BulkLoadRoot_<const std::pair<key_type, value_type> *>(data, size));
+        if (read_cache_)
+            read_cache_->Clear();
+        if (old_root)
+            FreeRoot_(old_root);
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    template <typename InputIt>
+    void basic_letree<Key, value_size, node_size, fanout>::bulk_load(InputIt first, InputIt last)
+    {
+        TreeRoot *old_root = root();
+        TreeRoot *new_root;
+        if constexpr (std::is_base_of_v<std::random_access_iterator_tag,
+                                        typename std::iterator_traits<InputIt>::iterator_category>)
+            new_root = BulkLoadRoot_<InputIt>(first, last - first);
+        else
+            new_root = BulkLoadStream_(first, last);
+        SetRoot_(new_root);
+        if (read_cache_)
+            read_cache_->Clear();
+        if (old_root)
+            FreeRoot_(old_root);
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    status basic_letree<Key, value_size, node_size, fanout>::Put_(key_type key, value_type value, value_type *old)
+    {
+        status ret = status::Failed;
+    retry0:
+        if (concurrent_)
+            trans_begin();
+        {
+            EpochManager::Guard guard(epoch());
+            TreeRoot *r = root();
+            int group_id = find_group(r, key);
+            if (concurrent_)
+            {
+                pthread_mutex_lock(&r->lock_space[group_id]);
+                if (unlikely(r != root() ||
+                             (!background_expand_ && tmp_.is_tree_expand.load(std::memory_order_acquire))))
+                {
+                    pthread_mutex_unlock(&r->lock_space[group_id]);
+                    goto retry0;
+                } // 存在本线程阻塞在lock，然后另一个线程释放lock并进行ExpandTree / 替换根的situation
+
+                r->group_space[group_id].write_begin();
+                if (TmpBufferPut_(key, value, old))
+                    ret = old ? status::Exist : status::OK;
+                else if (old && r->group_space[group_id].Get(clevel_mem_, key, *old))
+                    ret = r->group_space[group_id].Update(clevel_mem_, key, value) ? status::Exist : status::Failed;
+                else
+                    ret = r->group_space[group_id].Put(clevel_mem_, key, value, &tmp_);
+                r->group_space[group_id].write_end();
+                if (ret == status::OK || ret == status::Exist)
+                    CacheUpdate_(key, value);
+                pthread_mutex_unlock(&r->lock_space[group_id]);
+            }
+            else
+            {
+                if (old && r->group_space[group_id].Get(clevel_mem_, key, *old))
+                    ret = r->group_space[group_id].Update(clevel_mem_, key, value) ? status::Exist : status::Failed;
+                else
+                    ret = r->group_space[group_id].Put(clevel_mem_, key, value, &tmp_);
+                if (ret == status::OK || ret == status::Exist)
+                    CacheUpdate_(key, value);
+            }
+        }
+        if (ret == status::Full)
+        {
+            std::lock_guard<std::mutex> lock(split_lock_);
+            split_keys_.push_back(key);
+        }
+        return ret;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    status basic_letree<Key, value_size, node_size, fanout>::Put(key_type key, value_type value)
+    {
+        return Upsert_(key, value, nullptr);
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    status basic_letree<Key, value_size, node_size, fanout>::Upsert_(key_type key, value_type value, value_type *old)
+    {
+        status ret;
+        while ((ret = Put_(key, value, old)) == status::Full)
+        { // LearnGroup 太大了
+            if (background_expand_)
+            {
+                // 请求成功后 is_tree_expand 已置位，重试时写入会被转到 tmp_buffer
+                RequestExpand_();
+                continue;
+            }
+            ExpandTree();
+        }
+        return ret;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    status basic_letree<Key, value_size, node_size, fanout>::MultiPut_(const std::pair<key_type, value_type> kvs[], int count, int &done)
+    {
+        status ret = status::Failed;
+        done = 0;
+    retry0:
+        if (concurrent_)
+            trans_begin();
+        {
+            EpochManager::Guard guard(epoch());
+            TreeRoot *r = root();
+            int group_id = find_group(r, kvs[0].first);
+            int end = count;
+            if (group_id + 1 < r->nr_groups_)
+            {
+                end = 1;
+                while (end < count && kvs[end].first < r->group_space[group_id + 1].min_key)
+                    end++;
+            }
+            if (concurrent_)
+            {
+                pthread_mutex_lock(&r->lock_space[group_id]);
+                if (unlikely(r != root() ||
+                             (!background_expand_ && tmp_.is_tree_expand.load(std::memory_order_acquire))))
+                {
+                    pthread_mutex_unlock(&r->lock_space[group_id]);
+                    goto retry0;
+                }
+
+                r->group_space[group_id].write_begin();
+                if (bentry_t::use_tmp_buffer && expand_running_.load(std::memory_order_acquire))
+                { // 扩展期间逐个写入，每个 key 都要先检查 tmp_buffer
+                    if (TmpBufferPut_(kvs[0].first, kvs[0].second, nullptr))
+                        ret = status::OK;
+                    else
+                        ret = r->group_space[group_id].Put(clevel_mem_, kvs[0].first, kvs[0].second, &tmp_);
+                    done = ret == status::OK;
+                }
+                else
+                {
+                    ret = r->group_space[group_id].MultiPut(clevel_mem_, kvs, end, done, &tmp_);
+                }
+                r->group_space[group_id].write_end();
+                for (int i = 0; i < done && read_cache_; i++)
+                    read_cache_->Update(kvs[i].first, kvs[i].second);
+                pthread_mutex_unlock(&r->lock_space[group_id]);
+            }
+            else if (end == 1)
+            { // 只有一个 key 时走 Put，省掉分段查找
+                ret = r->group_space[group_id].Put(clevel_mem_, kvs[0].first, kvs[0].second, &tmp_);
+                done = ret == status::OK;
+            }
+            else
+            {
+                ret = r->group_space[group_id].MultiPut(clevel_mem_, kvs, end, done, &tmp_);
+            }
+        }
+        if (!concurrent_)
+        {
+            for (int i = 0; i < done && read_cache_; i++)
+                read_cache_->Update(kvs[i].first, kvs[i].second);
+        }
+        return ret;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    status basic_letree<Key, value_size, node_size, fanout>::MultiPut(const std::pair<key_type, value_type> data[], int size)
+    {
+        auto key_less = [](const std::pair<key_type, value_type> &a, const std::pair<key_type, value_type> &b)
+        { return a.first < b.first; };
+        std::vector<std::pair<key_type, value_type>> sorted;
+        const std::pair<key_type, value_type> *kvs = data;
+        if (!std::is_sorted(data, data + size, key_less))
+        {
+            // 相同的 key 保持原来的先后顺序，和逐个 Put 的结果一致
+            sorted.assign(data, data + size);
+            std::stable_sort(sorted.begin(), sorted.end(), key_less);
+            kvs = sorted.data();
+        }
+        int pos = 0;
+        while (pos < size)
+        {
+            int done = 0;
+            status ret = MultiPut_(&kvs[pos], size - pos, done);
+            pos += done;
+            if (ret == status::Full)
+            { // group 满了，这个 key 交给 Put 触发扩展，剩余的 key 在新根上继续批量写入
+                Put(kvs[pos].first, kvs[pos].second);
+                pos++;
+            }
+        }
+        return status::OK;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_letree<Key, value_size, node_size, fanout>::Update(key_type key, value_type value)
+    {
+        return Update_(key, value, nullptr);
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_letree<Key, value_size, node_size, fanout>::Update_(key_type key, value_type value, const value_type *expected)
+    {
+        value_type cur;
+        if (!concurrent_)
+        {
+            TreeRoot *r = root();
+            group &g = r->group_space[find_group(r, key)];
+            if (expected && (!g.Get(clevel_mem_, key, cur) || cur != *expected))
+                return false;
+            bool ret = g.Update(clevel_mem_, key, value);
+            if (ret)
+                CacheUpdate_(key, value);
+            return ret;
+        }
+    retry0:
+        trans_begin();
+        EpochManager::Guard guard(&epoch_);
+        TreeRoot *r = root();
+        int group_id = find_group(r, key);
+        pthread_mutex_lock(&r->lock_space[group_id]);
+        if (unlikely(r != root() ||
+                     (!background_expand_ && tmp_.is_tree_expand.load(std::memory_order_acquire))))
+        { // 和 Put_ 一样，等锁期间根被替换或开始前台扩展时重试
+            pthread_mutex_unlock(&r->lock_space[group_id]);
+            goto retry0;
+        }
+        r->group_space[group_id].write_begin();
+        bool ret;
+        if (expected && r->group_space[group_id].Get(clevel_mem_, key, cur) && cur != *expected)
+            ret = false;
+        else
+            ret = r->group_space[group_id].Update(clevel_mem_, key, value);
+        r->group_space[group_id].write_end();
+#ifdef USE_TMP_WRITE_BUFFER
+        if constexpr (bentry_t::use_tmp_buffer)
+        {
+            // 持有 group 锁时检查 tmp_buffer，回放不会在两次查找之间把 key 移到新根
+            if (!ret && expand_running_.load(std::memory_order_acquire))
+            {
+                std::lock_guard<std::mutex> lock(tmp_.lock);
+                char *p = tmp_.buffer->btree_search(key);
+                if (p != NULL && (!expected || (uint64_t)p == *expected))
+                {
+                    tmp_.buffer->btree_delete(key);
+                    tmp_.buffer->btree_insert(key, (char *)value);
+                    ret = true;
+                }
+            }
+        }
+#endif
+        if (ret)
+            CacheUpdate_(key, value);
+        pthread_mutex_unlock(&r->lock_space[group_id]);
+        return ret;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_letree<Key, value_size, node_size, fanout>::Get(key_type key, value_type &value)
+    {
+        uint32_t cache_version = 0;
+        if (read_cache_ && read_cache_->Get(key, value, cache_version))
+            return true;
+        // 读操作不等待扩展：旧根在 epoch 结束前不会被回收，group 内通过版本号校验
+        EpochManager::Guard guard(epoch());
+        TreeRoot *r = root();
+        bool ret = find_fast(r, key, value) || find_slow(r, key, value) ||
+                   (concurrent_ && TmpBufferGet_(key, value));
+        // 查找期间有写者修改过这个 set 时 Fill 会放弃，不会把旧值放进缓存
+        if (ret && read_cache_)
+            read_cache_->Fill(key, value, cache_version);
+        return ret;
+    }
+
+    static ALWAYS_INLINE void prefetch_range(const void *addr, size_t len)
+    {
+        const char *p = (const char *)((uintptr_t)addr & ~(uintptr_t)(CACHE_LINE_SIZE - 1));
+        for (; p < (const char *)addr + len; p += CACHE_LINE_SIZE)
+            _mm_prefetch(p, _MM_HINT_T0);
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    int basic_letree<Key, value_size, node_size, fanout>::MultiGet(const key_type keys[], int size, value_type values[], bool found[])
+    {
+        EpochManager::Guard guard(epoch());
+        TreeRoot *r = root();
+        int group_id[multi_get_batch];
+        int entry_id[multi_get_batch];
+        uint64_t version[multi_get_batch];
+        buncket_ref bucket[multi_get_batch];
+        int hits = 0;
+        for (int base = 0; base < size; base += multi_get_batch)
+        {
+            const key_type *k = keys + base;
+            int n = std::min(multi_get_batch, size - base);
+            // 根模型在 DRAM，直接预测 group，预取 group 头和 in_group 要读的下一个 group
+            for (int i = 0; i < n; i++)
+            {
+                group_id[i] = r->predict_group(k[i]);
+                prefetch_range(&r->group_space[group_id[i]], 2 * sizeof(group));
+            }
+            // 确定 group，预取 group 内模型预测的 PointerBEntry
+            for (int i = 0; i < n; i++)
+            {
+                if (!r->in_group(group_id[i], k[i]))
+                    group_id[i] = find_group(r, k[i]);
+                const group &g = r->group_space[group_id[i]];
+                if (concurrent_)
+                    version[i] = g.read_begin();
+                entry_id[i] = g.predict_entry(k[i]);
+                prefetch_range(&g.entry_space[entry_id[i]], sizeof(bentry_t));
+            }
+            // 在预测位置附近查找 entry，定位 C 层节点并预取整个节点
+            for (int i = 0; i < n; i++)
+            {
+                const group &g = r->group_space[group_id[i]];
+                const bentry_t &entry = g.entry_space[g.exponential_search_upper_bound(entry_id[i], k[i])];
+                int pos = entry.Find_pos(k[i]);
+                if (unlikely(pos >= bentry_t::entry_count || !entry.entrys[pos].IsValid()))
+                {
+                    bucket[i] = buncket_ref();
+                    continue;
+                }
+                bucket[i] = entry.Pointer(pos, clevel_mem_);
+                prefetch_range(bucket[i].address(), sizeof(buncket_t));
+            }
+            for (int i = 0; i < n; i++)
+            {
+                value_type &value = values[base + i];
+                bool ret = bucket[i] && bucket[i]->Get(clevel_mem_, k[i], value) == status::OK;
+                if (concurrent_)
+                {
+                    // 和 Get 一样，版本号变化时重新查找，找不到时再查扩展期间的临时缓冲
+                    if (!r->group_space[group_id[i]].read_validate(version[i]))
+                        ret = find_slow(r, k[i], value);
+                    ret = ret || TmpBufferGet_(k[i], value);
+                }
+                if (found)
+                    found[base + i] = ret;
+                hits += ret;
+            }
+        }
+        return hits;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_letree<Key, value_size, node_size, fanout>::Scan(key_type start_key, int len, std::vector<std::pair<key_type, value_type>> &results)
+    {
+        results.reserve(results.size() + len);
+        return Scan(start_key, len, [&results](key_type key, value_type value)
+                    { results.emplace_back(key, value); }) == len;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    template <typename Visitor>
+    int basic_letree<Key, value_size, node_size, fanout>::Scan(key_type start_key, int len, Visitor &&visit)
+    {
+        return Scan_<false>(start_key, kMaxKey, len, visit);
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    int basic_letree<Key, value_size, node_size, fanout>::Scan(key_type start_key, int len, std::pair<key_type, value_type> results[])
+    {
+        int n = 0;
+        return Scan(start_key, len, [results, &n](key_type key, value_type value)
+                    { results[n++] = {key, value}; });
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    template <typename Visitor>
+    uint64_t basic_letree<Key, value_size, node_size, fanout>::ScanRange(key_type lo, key_type hi, Visitor &&visit)
+    {
+        if (lo >= hi)
+            return 0;
+        return Scan_<false>(lo, hi - 1, UINT64_MAX, visit);
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    uint64_t basic_letree<Key, value_size, node_size, fanout>::ScanRange(key_type lo, key_type hi, std::vector<std::pair<key_type, value_type>> &results)
+    {
+        return ScanRange(lo, hi, [&results](key_type key, value_type value)
+                         { results.emplace_back(key, value); });
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    template <typename Visitor>
+    int basic_letree<Key, value_size, node_size, fanout>::ReverseScan(key_type start_key, int len, Visitor &&visit)
+    {
+        return Scan_<true>(start_key, 0, len, visit);
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    int basic_letree<Key, value_size, node_size, fanout>::ReverseScan(key_type start_key, int len, std::pair<key_type, value_type> results[])
+    {
+        int n = 0;
+        return ReverseScan(start_key, len, [results, &n](key_type key, value_type value)
+                           { results[n++] = {key, value}; });
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    template <bool Reverse, typename Visitor>
+    uint64_t basic_letree<Key, value_size, node_size, fanout>::Scan_(key_type from, key_type to, uint64_t len, Visitor &visit)
+    {
+        EpochManager::Guard guard(epoch());
+        TreeRoot *r = root();
+#ifdef USE_TMP_WRITE_BUFFER
+        if constexpr (bentry_t::use_tmp_buffer)
+        {
+            if (concurrent_ && expand_running_.load(std::memory_order_acquire))
+            {
+                // 合并扩展期间暂存在 tmp_buffer 中的 key，只在扩展期间走这条需要分配的路径
+                key_type lo = Reverse ? to : from, hi = Reverse ? from : to;
+                std::vector<std::pair<key_type, value_type>> tree_data, tmp_data;
+                auto collect = [&tree_data](key_type key, value_type value)
+                { tree_data.emplace_back(key, value); };
+                ScanRoot_<Reverse>(r, from, to, len, collect);
+                int tmp_len = INT32_MAX;
+                tmp_.buffer->btree_search_range(lo == 0 ? 0 : lo - 1, hi, tmp_data, tmp_len);
+                tmp_data.erase(std::remove_if(tmp_data.begin(), tmp_data.end(), [lo, hi](const std::pair<key_type, value_type> &kv)
+                                              { return kv.first < lo || kv.first > hi; }),
+                               tmp_data.end());
+                if (Reverse)
+                    std::reverse(tmp_data.begin(), tmp_data.end());
+                auto before = [](key_type a, key_type b)
+                { return Reverse ? a > b : a < b; };
+                uint64_t n = 0;
+                size_t i = 0, j = 0;
+                for (; n < len && (i < tree_data.size() || j < tmp_data.size()); n++)
+                {
+                    bool from_tree = j == tmp_data.size() || (i < tree_data.size() && !before(tmp_data[j].first, tree_data[i].first));
+                    const auto &kv = from_tree ? tree_data[i++] : tmp_data[j++];
+                    visit(kv.first, kv.second);
+                }
+                return n;
+            }
+        }
+#endif
+        return ScanRoot_<Reverse>(r, from, to, len, visit);
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_letree<Key, value_size, node_size, fanout>::Delete(key_type key)
+    {
+        return Delete_(key, nullptr);
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_letree<Key, value_size, node_size, fanout>::Delete_(key_type key, value_type *old)
+    {
+        if (!concurrent_)
+        {
+            TreeRoot *r = root();
+            group &g = r->group_space[find_group(r, key)];
+            if (old && !g.Get(clevel_mem_, key, *old))
+                return false;
+            bool ret = g.Delete(clevel_mem_, key);
+            CacheErase_(key);
+            return ret;
+        }
+    retry0:
+        trans_begin();
+        EpochManager::Guard guard(&epoch_);
+        TreeRoot *r = root();
+        int group_id = find_group(r, key);
+        pthread_mutex_lock(&r->lock_space[group_id]);
+        if (unlikely(r != root() ||
+                     (!background_expand_ && tmp_.is_tree_expand.load(std::memory_order_acquire))))
+        { // 同 Update_
+            pthread_mutex_unlock(&r->lock_space[group_id]);
+            goto retry0;
+        }
+        r->group_space[group_id].write_begin();
+        bool ret = (!old || r->group_space[group_id].Get(clevel_mem_, key, *old)) &&
+                   r->group_space[group_id].Delete(clevel_mem_, key);
+        r->group_space[group_id].write_end();
+#ifdef USE_TMP_WRITE_BUFFER
+        if constexpr (bentry_t::use_tmp_buffer)
+        {
+            // 和 Update_ 一样在 group 锁内检查 tmp_buffer
+            if (expand_running_.load(std::memory_order_acquire))
+            {
+                std::lock_guard<std::mutex> lock(tmp_.lock);
+                char *p = tmp_.buffer->btree_search(key);
+                if (p != NULL)
+                {
+                    if (old)
+                        *old = (uint64_t)p;
+                    tmp_.buffer->btree_delete(key);
+                    ret = true;
+                }
+            }
+        }
+#endif
+        CacheErase_(key);
+        pthread_mutex_unlock(&r->lock_space[group_id]);
+        return ret;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    uint64_t basic_letree<Key, value_size, node_size, fanout>::DeleteRange(key_type lo, key_type hi)
+    {
+        if (lo > hi)
+            return 0;
+        uint64_t removed;
+        if (!concurrent_)
+        {
+            removed = DeleteRange_(root(), lo, hi);
+            if (read_cache_)
+                read_cache_->EraseRange(lo, hi);
+            return removed;
+        }
+        while (true)
+        {
+            // 摘除节点会修改 eentry，不能和扩展同时进行，扩展期间两种模式下都等待扩展结束
+            if (tmp_.is_tree_expand.load(std::memory_order_acquire))
+            {
+                std::unique_lock<std::mutex> lock(expand_wait_lock);
+                expand_wait_cv.wait(lock, [this]
+                                    { return !tmp_.is_tree_expand.load(std::memory_order_acquire); });
+            }
+            EpochManager::Guard guard(&epoch_);
+            if (tmp_.is_tree_expand.load(std::memory_order_acquire))
+                continue;
+            removed = 0;
+#ifdef USE_TMP_WRITE_BUFFER
+            if constexpr (bentry_t::use_tmp_buffer)
+            {
+                // 先删 tmp_buffer 再删树：回放在 tmp_.lock 内把 key 从 tmp_buffer 移到新根，
+                // 已经移走的 key 会被随后的 DeleteRange_ 删除
+                if (expand_running_.load(std::memory_order_acquire))
+                {
+                    std::vector<std::pair<key_type, value_type>> tmp_data;
+                    int len = INT32_MAX;
+                    std::lock_guard<std::mutex> lock(tmp_.lock);
+                    tmp_.buffer->btree_search_range(lo, hi, tmp_data, len);
+                    for (auto &kv : tmp_data)
+                        tmp_.buffer->btree_delete(kv.first);
+                    removed = tmp_data.size();
+                }
+            }
+#endif
+            removed += DeleteRange_(root(), lo, hi);
+            break;
+        }
+        // 树中的 key 全部删除之后再作废缓存，期间回填的旧值也会被清除
+        if (read_cache_)
+            read_cache_->EraseRange(lo, hi);
+        return removed;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    uint64_t basic_letree<Key, value_size, node_size, fanout>::DeleteRange_(TreeRoot *r, key_type lo, key_type hi)
+    {
+        uint64_t removed = 0;
+        int group_id = find_group(r, lo);
+        while (group_id < r->nr_groups_)
+        {
+            int next = group_id + 1;
+            while (next < r->nr_groups_ && r->group_space[next].nr_entries_ == 0)
+                next++;
+            key_type max_key = next < r->nr_groups_ ? r->group_space[next].min_key - 1 : kMaxKey;
+            if (concurrent_)
+            {
+                pthread_mutex_lock(&r->lock_space[group_id]);
+                r->group_space[group_id].write_begin();
+            }
+            removed += r->group_space[group_id].DeleteRange(clevel_mem_, lo, hi, max_key);
+            if (concurrent_)
+            {
+                r->group_space[group_id].write_end();
+                pthread_mutex_unlock(&r->lock_space[group_id]);
+            }
+            if (max_key >= hi)
+                break;
+            group_id = next;
+        }
+        return removed;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_letree<Key, value_size, node_size, fanout>::OpenValueLog(size_t size)
+    {
+        static_assert(sizeof(Key) <= 8 && value_size == 8, "value log stores 8-byte keys and offsets");
+        vlog_ = new ValueLog(pool_ == TempPool ? CLEVEL_PMEM_FILE "vlog-" : CLEVEL_PMEM_FILE "vlog", size, pool_);
+        if (vlog_->Opened())
+        {
+            // 日志中只有树仍然引用的记录是存活的
+            auto visit = [this](uint64_t key, uint64_t offset)
+            { vlog_->AddLive(offset); };
+            Scan_<false>(0, kMaxKey, UINT64_MAX, visit);
+        }
+        if (concurrent_)
+            gc_thread_ = std::thread(&basic_letree::GcWorker_, this);
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    uint64_t basic_letree<Key, value_size, node_size, fanout>::AppendValue_(key_type key, const void *data, uint32_t len)
+    {
+        uint64_t offset;
+        while ((offset = vlog_->Append(key, data, len)) == 0)
+        {
+            // 没有空闲段时就地回收，多个写者由日志内部的回收锁串行
+            if (CollectValueLog() == 0)
+                return 0;
+        }
+        return offset;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_letree<Key, value_size, node_size, fanout>::WakeCollector_()
+    {
+        if (likely(!vlog_->LowOnSpace()))
+            return;
+        if (concurrent_)
+            gc_req_cv_.notify_one();
+        else
+            CollectValueLog();
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    status basic_letree<Key, value_size, node_size, fanout>::PutValue(key_type key, const void *data, uint32_t len)
+    {
+        if (len > vlog_->MaxValueSize())
+            return status::Failed;
+        uint64_t offset = AppendValue_(key, data, len);
+        if (offset == 0)
+            return status::Full;
+        {
+            EpochManager::Guard guard(vlog_epoch());
+            uint64_t old;
+            if (Upsert_(key, offset, &old) == status::Exist)
+                vlog_->Release(old);
+        }
+        WakeCollector_();
+        return status::OK;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_letree<Key, value_size, node_size, fanout>::GetValue(key_type key, std::string &value)
+    {
+        EpochManager::Guard guard(vlog_epoch());
+        uint64_t offset;
+        if (!Get(key, offset))
+            return false;
+        const ValueLog::Record *r = vlog_->Read(offset);
+        value.assign(r->data, r->len);
+        return true;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_letree<Key, value_size, node_size, fanout>::DeleteValue(key_type key)
+    {
+        EpochManager::Guard guard(vlog_epoch());
+        uint64_t old;
+        if (!Delete_(key, &old))
+            return false;
+        vlog_->Release(old);
+        return true;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    size_t basic_letree<Key, value_size, node_size, fanout>::CollectValueLog()
+    {
+        return vlog_->Collect([this](uint64_t offset, const ValueLog::Record *r)
+                              {
+                                  uint64_t cur;
+                                  // 树中的偏移已经指向别处或者 key 已被删除，记录是垃圾
+                                  if (!Get(r->key, cur) || (cur & ValueLog::offset_mask) != offset)
+                                      return true;
+                                  uint64_t moved = vlog_->Append(r->key, r->data, r->len, true);
+                                  if (moved == 0)
+                                      return false;
+                                  // 检查之后有并发的写入覆盖或删除了这个 key，搬过去的副本也成为垃圾
+                                  if (!Update_(r->key, moved | (cur & ~ValueLog::offset_mask), &cur))
+                                      vlog_->Release(moved);
+                                  return true; });
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_letree<Key, value_size, node_size, fanout>::GcWorker_()
+    {
+        std::unique_lock<std::mutex> lock(gc_req_lock_);
+        while (!gc_stop_)
+        {
+            // 写者发现空闲段不多时唤醒，否则定期检查垃圾比例
+            gc_req_cv_.wait_for(lock, std::chrono::milliseconds(100));
+            if (gc_stop_)
+                break;
+            lock.unlock();
+            while (vlog_->NeedCollect() && CollectValueLog() > 0)
+                ;
+            lock.lock();
+        }
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    int basic_letree<Key, value_size, node_size, fanout>::find_group(const TreeRoot *r, const key_type &key) const
+    {
+        int lo, hi;
+        int predicted = r->predict_group(key, lo, hi);
+        int group_id = predicted;
+        int steps = 0;
+        if (r->in_group(group_id, key))
+        {
+            NoteFindGroup(0, 0);
+            return group_id;
+        }
+
+        // 在模型给出的误差范围内从预测位置向外倍增查找，再在最后一段内二分，找最后一个 min_key <= key 的 group，
+        // 查找步数随预测误差对数增长，预测准确时只读一两个 group；只读 group 本身，不访问 entry_space
+        auto before = [&](int i)
+        {
+            steps++;
+            return r->group_space[i].nr_entries_ != 0 && r->group_space[i].min_key <= key;
+        };
+        // in_group 已经读过预测位置，不计入步数
+        if (r->group_space[group_id].nr_entries_ != 0 && r->group_space[group_id].min_key <= key)
+        {
+            lo = group_id;
+            int step = 1;
+            while (lo + step <= hi && before(lo + step))
+            {
+                lo += step;
+                step *= 2;
+            }
+            hi = std::min(lo + step - 1, hi);
+        }
+        else
+        {
+            hi = group_id - 1;
+            int step = 1;
+            while (hi - step >= lo && !before(hi - step))
+            {
+                hi -= step;
+                step *= 2;
+            }
+            // hi - step 处满足条件时从那里开始二分，否则留给下面的修正
+            lo = std::max(hi - step, lo);
+            hi = std::max(hi, lo);
+        }
+        while (lo < hi)
+        {
+            int mid = (lo + hi + 1) / 2;
+            if (before(mid))
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        group_id = lo;
+
+        // 误差范围只对训练时的 key 成立，插入和空 group 可能让结果偏离，向两侧修正
+        while (group_id > 0 && (r->group_space[group_id].nr_entries_ == 0 ||
+                                (key < r->group_space[group_id].min_key)))
+        {
+            group_id--;
+            steps++;
+        }
+        while (group_id < r->nr_groups_ - 1 && r->group_space[group_id + 1].nr_entries_ != 0 &&
+               r->group_space[group_id + 1].min_key <= key)
+        {
+            group_id++;
+            steps++;
+        }
+
+        while (r->group_space[group_id].nr_entries_ == 0)
+        {
+            group_id++;
+            steps++;
+        }
+
+        NoteFindGroup(steps, std::abs(group_id - predicted));
+        return group_id;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_letree<Key, value_size, node_size, fanout>::find_fast(const TreeRoot *r, key_type key, value_type &value) const
+    {
+        int group_id = r->predict_group(key);
+        if (!r->in_group(group_id, key))
+            return false;
+        if (!concurrent_)
+            return r->group_space[group_id].fast_fail(clevel_mem_, key, value);
+        // 版本号变化时交给 find_slow 重试
+        uint64_t version = r->group_space[group_id].read_begin();
+        auto ret = r->group_space[group_id].fast_fail(clevel_mem_, key, value);
+        return ret && r->group_space[group_id].read_validate(version);
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_letree<Key, value_size, node_size, fanout>::find_slow(const TreeRoot *r, key_type key, value_type &value) const
+    {
+        if (!concurrent_)
+        {
+            int group_id = find_group(r, key);
+            return r->group_space[group_id].Get(clevel_mem_, key, value);
+        }
+        while (true)
+        {
+            int group_id = find_group(r, key);
+            uint64_t version = r->group_space[group_id].read_begin();
+            auto ret = r->group_space[group_id].Get(clevel_mem_, key, value);
+            if (r->group_space[group_id].read_validate(version))
+                return ret;
+        }
+    }
+
+    extern uint64_t scan_groups;
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    template <bool Reverse, typename Visitor>
+    uint64_t basic_letree<Key, value_size, node_size, fanout>::ScanRoot_(const TreeRoot *r, key_type from, key_type to, uint64_t len, Visitor &visit) const
+    {
+        uint64_t done = 0;
+        key_type key = from;
+        int group_id = find_group(r, key);
+        while (done < len && group_id >= 0 && group_id < r->nr_groups_)
+        {
+            const group &g = r->group_space[group_id];
+            if (g.nr_entries_ == 0)
+            {
+                group_id += Reverse ? -1 : 1;
+                continue;
+            }
+            // 之后的 group 的 key 都不小于 min_key，正向越过 to 时不必再读
+            if (!Reverse && group_id > 0 && g.min_key > to)
+                break;
+            scan_groups++;
+            // 当前还需要访问的区间，正向时 key 是下界，反向时 key 是上界
+            key_type lo = Reverse ? to : key, hi = Reverse ? key : to;
+            bool more, retry = false, last = false;
+            if (!concurrent_)
+            {
+                more = g.template VisitBuckets<Reverse>(clevel_mem_, lo, hi, [&](buncket_ref bucket)
+                                               {
+                                                   done += bucket->template Visit<Reverse>(lo, hi, std::min<uint64_t>(len - done, INT32_MAX), visit);
+                                                   return done < len; });
+            }
+            else
+            {
+                uint64_t version = g.read_begin();
+                more = g.template VisitBuckets<Reverse>(clevel_mem_, lo, hi, [&](buncket_ref bucket)
+                                               {
+                                                   std::pair<key_type, value_type> snap[buncket_ref::Capacity()];
+                                                   int n = 0;
+                                                   bucket->template Visit<Reverse>(Reverse ? to : key, Reverse ? key : to, std::min<uint64_t>(len - done, INT32_MAX),
+                                                                          [&](key_type k, value_type v)
+                                                                          { snap[n++] = {k, v}; });
+                                                   if (!g.read_validate(version))
+                                                   {
+                                                       retry = true;
+                                                       return false;
+                                                   }
+                                                   for (int i = 0; i < n; i++)
+                                                       visit(snap[i].first, snap[i].second);
+                                                   done += n;
+                                                   if (n > 0)
+                                                   {
+                                                       // 记住最后交出的 key，重试时从它之后继续
+                                                       last = snap[n - 1].first == to;
+                                                       key = Reverse ? snap[n - 1].first - 1 : snap[n - 1].first + 1;
+                                                   }
+                                                   return done < len && !last; });
+            }
+            if (last || (!more && !retry))
+                break;
+            // group 被修改过，已经交出的 key 之后可能落到别的 group，重新查找
+            group_id = retry ? find_group(r, key) : group_id + (Reverse ? -1 : 1);
+        }
+        return done;
+    }
+
+    /**
+     * @brief 生成新根，计数、分配、追加、重训练几个阶段都按 ROOT_EXPAND_THREADS 个线程并行：
+     * 1. 旧 group 按 entry 数划分成连续的区间，每个线程一个区间，先统计每个旧 group 的 entry 数；
+     * 2. 前缀和得到每个区间第一个 entry 的全局序号，新 group 按序号每 min_entry_count 个 entry 划分，
+     *    追加阶段各线程写入互不重叠的位置，不需要加锁；
+     * 3. 新 group 的分配和重训练按新 group 区间划分；
+     * 4. 最后用每个新 group 的 min_key 训练两层根模型并记录误差范围。
+     */
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    typename basic_letree<Key, value_size, node_size, fanout>::TreeRoot *basic_letree<Key, value_size, node_size, fanout>::BuildRoot_(TreeRoot *old_root)
+    {
+        TreeRoot *new_root = new TreeRoot();
+        group *group_space = old_root->group_space;
+        int nr_groups_ = old_root->nr_groups_;
+        int nthreads = std::max(1, std::min(ROOT_EXPAND_THREADS, nr_groups_));
+
+        // 按 next_entry_count 划分线程区间
+        std::vector<size_t> entry_prefix(nr_groups_ + 1, 0);
+        for (int i = 0; i < nr_groups_; i++)
+            entry_prefix[i + 1] = entry_prefix[i] + group_space[i].next_entry_count;
+
+        std::vector<int> range_start(nthreads + 1, nr_groups_);
+        range_start[0] = 0;
+        for (int t = 1, i = 0; t < nthreads; t++)
+        {
+            size_t bound = entry_prefix[nr_groups_] * t / nthreads;
+            while (i < nr_groups_ && entry_prefix[i] < bound)
+                i++;
+            range_start[t] = i;
+        }
+
+        // 统计每个旧 group 实际的 entry 数，前缀和作为 entry 的全局序号
+        RunRanges_(nthreads, [&](int t)
+                   {
+            for (int i = range_start[t]; i < range_start[t + 1]; i++)
+            {
+                size_t count = 0;
+                if (group_space[i].next_entry_count != 0)
+                {
+                    group_space[i].AdjustEntryKey(clevel_mem_);
+                    typename group::EntryIter e_iter(&group_space[i]);
+                    while (!e_iter.end())
+                    {
+                        count++;
+                        e_iter.next();
+                    }
+                }
+                entry_prefix[i + 1] = count;
+            } });
+        for (int i = 0; i < nr_groups_; i++)
+            entry_prefix[i + 1] += entry_prefix[i];
+        size_t entry_count = entry_prefix[nr_groups_];
+
+        int new_nr_groups = std::max(1, (int)std::ceil(1.0 * entry_count / min_entry_count));
+        new_root->nr_groups_ = new_nr_groups;
+        group *new_group_space = (group *)index_alloc(new_nr_groups * sizeof(group));
+        pmem_memset_persist(new_group_space, 0, new_nr_groups * sizeof(group));
+        new_root->group_space = new_group_space;
+        new_root->lock_space = NewLockSpace_(new_nr_groups);
+
+        auto new_range = [&](int t, int &begin, int &end)
+        {
+            begin = (int)((size_t)new_nr_groups * t / nthreads);
+            end = (int)((size_t)new_nr_groups * (t + 1) / nthreads);
+        };
+
+        RunRanges_(nthreads, [&](int t)
+                   {
+            int begin, end;
+            new_range(t, begin, end);
+            for (int i = begin; i < end; i++)
+            {
+                new_group_space[i].next_entry_count = std::min(min_entry_count, entry_count - i * min_entry_count);
+                if (new_group_space[i].next_entry_count == 0)
+                    continue;
+                new_group_space[i].reserve_space();
+            } });
+
+        RunRanges_(nthreads, [&](int t)
+                   {
+            size_t seq = entry_prefix[range_start[t]];
+            for (int i = range_start[t]; i < range_start[t + 1]; i++)
+            {
+                typename group::EntryIter e_iter(&group_space[i]);
+                while (!e_iter.end())
+                {
+                    new_group_space[seq / min_entry_count].append_entry(seq % min_entry_count, &(*e_iter));
+                    seq++;
+                    e_iter.next();
+                }
+            } });
+
+        RunRanges_(nthreads, [&](int t)
+                   {
+            int begin, end;
+            new_range(t, begin, end);
+            for (int i = begin; i < end; i++)
+            {
+                if (new_group_space[i].next_entry_count == 0)
+                    continue;
+                new_group_space[i].nr_entries_ = new_group_space[i].next_entry_count;
+                new_group_space[i].re_tarin();
+            }
+            pmem_persist(&new_group_space[begin], (end - begin) * sizeof(group)); });
 
-#ifdef MULTI_THREAD
-        // std::mutex *lock_space;
-        pthread_mutex_t *lock_space;
-        std::mutex expand_wait_lock;
-        std::condition_variable expand_wait_cv;
-#ifndef USE_TMP_WRITE_BUFFER
-        std::atomic_bool is_tree_expand;
-#endif
-#endif
-    };
+        TrainRoot_(new_root);
+        new_root->base_window = new_root->model.avg_window();
+        // std::cout << "root_expand, old_groups: " << nr_groups_ << " new_groups: " << new_nr_groups << std::endl;
+        return new_root;
+    }
 
-    void letree::bulk_load(std::vector<std::pair<uint64_t, uint64_t>> &data)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_letree<Key, value_size, node_size, fanout>::TrainRoot_(TreeRoot *r)
     {
-        size_t size = data.size();
-        int group_id = 0;
-
-        if (nr_groups_ != 0)
-        {
-#ifdef MULTI_THREAD
-            if (lock_space)
-                delete[] lock_space;
-#endif
-        }
+        std::vector<key_type> first_keys(r->nr_groups_);
+        for (int i = 0; i < r->nr_groups_; i++)
+            first_keys[i] = r->group_space[i].nr_entries_ == 0 ? (i == 0 ? 0 : first_keys[i - 1])
+                                                               : r->group_space[i].min_key;
+        r->model.init(first_keys.begin(), first_keys.size(), std::ceil(1.0 * r->nr_groups_ / root_leaf_groups));
+    }
 
-        model.init<std::vector<std::pair<uint64_t, uint64_t>> &, std::pair<uint64_t, uint64_t>>(data, size, size / 256, first_key);
-        nr_groups_ = size / min_entry_count;
-        group_space = (group *)NVM::data_alloc->alloc_aligned(nr_groups_ * sizeof(group));
-        pmem_memset_persist(group_space, 0, nr_groups_ * sizeof(group));
-#ifdef MULTI_THREAD
-        // lock_space = new std::mutex[nr_groups_];
-        lock_space = new pthread_mutex_t[nr_groups_];
-        for (int i = 0; i < nr_groups_; i++)
-            lock_space[i] = PTHREAD_MUTEX_INITIALIZER;
-#endif
-        for (int i = 0; i < size; i++)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    typename basic_letree<Key, value_size, node_size, fanout>::TreeRoot *basic_letree<Key, value_size, node_size, fanout>::RebuildRoot_(TreeRoot *old_root)
+    {
+        std::vector<key_type> split_keys;
         {
-            group_id = model.predict(data[i].first) / min_entry_count;
-            group_id = std::min(std::max(0, group_id), (int)nr_groups_ - 1);
-
-            group_space[group_id].inc_entry_count();
+            std::lock_guard<std::mutex> lock(split_lock_);
+            split_keys.swap(split_keys_);
         }
-        size_t start = 0;
-        for (int i = 0; i < nr_groups_; i++)
+#ifdef LOCAL_SPLIT
+        if (!split_keys.empty() && !old_root->degraded())
         {
-            if (group_space[i].next_entry_count == 0)
-                continue;
-            group_space[i].reserve_space();
-            group_space[i].bulk_load(data, start, group_space[i].next_entry_count, clevel_mem_);
-            start += group_space[i].next_entry_count;
+            TreeRoot *new_root = SplitRoot_(old_root, split_keys);
+            if (new_root)
+            {
+                root_split_times++;
+                return new_root;
+            }
         }
+#endif
+        root_expand_times++;
+        return BuildRoot_(old_root);
     }
 
-    void letree::bulk_load(const std::pair<uint64_t, uint64_t> data[], int size)
+#ifdef LOCAL_SPLIT
+    /**
+     * @brief 局部分裂，只处理 next_entry_count 超过 max_entry_count 的 group：
+     * 1. 被分裂的 group 按 min_entry_count 个 entry 拆成多个新 group；
+     * 2. 其余 group 连同 eentry 数组原样复制到新的 group 数组，只有 O(group 数) 的复制，
+     *    eentry 数组转给新根，旧根释放时跳过；
+     * 3. 重新训练根模型，误差窗口相对全量重建时变大太多后由 RebuildRoot_ 改为全量重建。
+     */
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    typename basic_letree<Key, value_size, node_size, fanout>::TreeRoot *basic_letree<Key, value_size, node_size, fanout>::SplitRoot_(TreeRoot *old_root, const std::vector<key_type> &split_keys)
     {
-        int group_id = 0;
+        group *group_space = old_root->group_space;
+        int nr_groups_ = old_root->nr_groups_;
 
-        if (nr_groups_ != 0)
+        std::vector<int> split_ids;
+        for (auto key : split_keys)
         {
-#ifdef MULTI_THREAD
-            if (lock_space)
-                delete[] lock_space;
-#endif
+            int group_id = find_group(old_root, key);
+            if ((size_t)group_space[group_id].next_entry_count > max_entry_count)
+                split_ids.push_back(group_id);
         }
+        if (split_ids.empty())
+            return nullptr;
+        std::sort(split_ids.begin(), split_ids.end());
+        split_ids.erase(std::unique(split_ids.begin(), split_ids.end()), split_ids.end());
 
-        model.init<const std::pair<uint64_t, uint64_t>[], std::pair<uint64_t, uint64_t>>(data, size, size / 256, first_key);
-        nr_groups_ = size / min_entry_count;
-        group_space = (group *)NVM::data_alloc->alloc_aligned(nr_groups_ * sizeof(group));
-        pmem_memset_persist(group_space, 0, nr_groups_ * sizeof(group));
-#ifdef MULTI_THREAD
-        // lock_space = new std::mutex[nr_groups_];
-        lock_space = new pthread_mutex_t[nr_groups_];
-        for (int i = 0; i < nr_groups_; i++)
-            lock_space[i] = PTHREAD_MUTEX_INITIALIZER;
-#endif
-        for (int i = 0; i < size; i++)
+        std::vector<size_t> split_counts(split_ids.size(), 0);
+        int new_nr_groups = nr_groups_;
+        for (size_t s = 0; s < split_ids.size(); s++)
         {
-            group_id = model.predict(data[i].first) / min_entry_count;
-            group_id = std::min(std::max(0, group_id), (int)nr_groups_ - 1);
-            group_space[group_id].inc_entry_count();
+            group_space[split_ids[s]].AdjustEntryKey(clevel_mem_);
+            typename group::EntryIter e_iter(&group_space[split_ids[s]]);
+            while (!e_iter.end())
+            {
+                split_counts[s]++;
+                e_iter.next();
+            }
+            new_nr_groups += (int)std::ceil(1.0 * split_counts[s] / min_entry_count) - 1;
         }
-        size_t start = 0;
+
+        TreeRoot *new_root = new TreeRoot();
+        new_root->nr_groups_ = new_nr_groups;
+        group *new_group_space = (group *)index_alloc(new_nr_groups * sizeof(group));
+        pmem_memset_persist(new_group_space, 0, new_nr_groups * sizeof(group));
+        new_root->group_space = new_group_space;
+        new_root->lock_space = NewLockSpace_(new_nr_groups);
+
+        int new_id = 0;
+        size_t s = 0;
         for (int i = 0; i < nr_groups_; i++)
         {
-            if (group_space[i].next_entry_count == 0)
+            if (s < split_ids.size() && split_ids[s] == i)
+            {
+                size_t remain = split_counts[s++];
+                typename group::EntryIter e_iter(&group_space[i]);
+                while (remain > 0)
+                {
+                    group &g = new_group_space[new_id++];
+                    g.next_entry_count = std::min(min_entry_count, remain);
+                    g.reserve_space();
+                    for (int pos = 0; pos < g.next_entry_count; pos++)
+                    {
+                        g.append_entry(pos, &(*e_iter));
+                        e_iter.next();
+                    }
+                    g.nr_entries_ = g.next_entry_count;
+                    g.re_tarin();
+                    remain -= g.next_entry_count;
+                }
                 continue;
-            group_space[i].reserve_space();
-            group_space[i].bulk_load(data, start, group_space[i].next_entry_count, clevel_mem_);
-            start += group_space[i].next_entry_count;
+            }
+            memcpy((void *)&new_group_space[new_id], (void *)&group_space[i], sizeof(group));
+            new_group_space[new_id++].version_.store(0, std::memory_order_relaxed);
         }
+        pmem_persist(new_group_space, new_nr_groups * sizeof(group));
+
+        TrainRoot_(new_root);
+        new_root->base_window = old_root->base_window;
+        old_root->entries_moved = true;
+        old_root->split_groups = split_ids;
+        return new_root;
     }
+#endif
 
-    status letree::Put(uint64_t key, uint64_t value)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_letree<Key, value_size, node_size, fanout>::CommitRoot_(const TreeRoot *r)
     {
-        status ret = status::Failed;
-    retry0:
-#ifdef MULTI_THREAD
-        trans_begin();
+        if (pool_ == TempPool)
+            return;
+        LetreeHead *head = Head_();
+        bool valid = head->magic == LetreeHead::kMagic;
+        uint64_t next = valid ? head->root + 1 : 0;
+        LetreeRoot &slot = head->slots[next & 1];
+#ifdef DRAM_INDEX
+        slot.group_offset = (char *)r->records - (char *)NVM::data_alloc->BaseAddr();
+#else
+        slot.group_offset = (char *)r->group_space - (char *)NVM::data_alloc->BaseAddr();
 #endif
+        slot.nr_groups = r->nr_groups_;
+        NVM::Mem_persist(&slot, sizeof(slot));
+        if (head->clean)
         {
-            int group_id = find_group(key);
-#ifdef MULTI_THREAD
-            pthread_mutex_lock(&lock_space[group_id]);
-            if (unlikely(is_tree_expand.load(std::memory_order_acquire)))
-            {
-                pthread_mutex_unlock(&lock_space[group_id]);
-                goto retry0;
-            } // 存在本线程阻塞在lock，然后另一个线程释放lock并进行ExpandTree的situation
-
-#endif
-            ret = group_space[group_id].Put(clevel_mem_, key, value);
-#ifdef MULTI_THREAD
-            pthread_mutex_unlock(&lock_space[group_id]);
-#endif
+            head->clean = 0;
+            NVM::Mem_persist(&head->clean, sizeof(head->clean));
         }
-
-        if (ret == status::Full)
-        { // LearnGroup 太大了
-            ExpandTree();
-            goto retry0;
+        head->root = next;
+        NVM::Mem_persist(&head->root, sizeof(head->root));
+        if (!valid)
+        {
+            head->key_size = sizeof(key_type);
+            head->value_size = value_size;
+            head->node_size = node_size;
+            head->fanout = fanout;
+            NVM::Mem_persist(&head->key_size, 4 * sizeof(uint32_t));
+            head->magic = LetreeHead::kMagic;
+            NVM::Mem_persist(&head->magic, sizeof(head->magic));
         }
-        return ret;
     }
 
-    bool letree::Update(uint64_t key, uint64_t value)
+#ifdef DRAM_INDEX
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_letree<Key, value_size, node_size, fanout>::PersistGroups_(TreeRoot *r)
     {
-#ifdef MULTI_THREAD
-        trans_begin();
-#endif
-        int group_id = find_group(key);
-#ifdef MULTI_THREAD
-        pthread_mutex_lock(&lock_space[group_id]);
+        if (r->records == nullptr)
+        {
+            r->records = (GroupRecord<Key> *)NVM::data_alloc->alloc_aligned(r->nr_groups_ * sizeof(GroupRecord<Key>));
+            for (int i = 0; i < r->nr_groups_; i++)
+            {
+                r->records[i].min_key = r->group_space[i].min_key;
+                r->records[i].entry_record = r->group_space[i].entry_record_;
+            }
+            pmem_persist(r->records, r->nr_groups_ * sizeof(GroupRecord<Key>));
+        }
+        for (int i = 0; i < r->nr_groups_; i++)
+            r->group_space[i].record_ = &r->records[i];
+    }
 #endif
-        auto ret = group_space[group_id].Update(clevel_mem_, key, value);
-        return ret;
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_letree<Key, value_size, node_size, fanout>::MarkClean_()
+    {
+        LetreeHead *head = Head_();
+        head->data_used = NVM::data_alloc->Used();
+        head->clevel_used = clevel_mem_->Used();
+        NVM::Mem_persist(&head->data_used, 2 * sizeof(uint64_t));
+        head->clean = 1;
+        NVM::Mem_persist(&head->clean, sizeof(head->clean));
     }
 
-    bool letree::Get(uint64_t key, uint64_t &value)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_letree<Key, value_size, node_size, fanout>::Recover()
     {
-#ifdef MULTI_THREAD
-        trans_begin();
+        const LetreeHead *head = Head_();
+        if (!clevel_mem_->Opened() || !NVM::data_alloc->Opened() || head->magic != LetreeHead::kMagic)
+            return false;
+        if (head->key_size != sizeof(key_type) || head->value_size != value_size ||
+            head->node_size != node_size || head->fanout != fanout)
+            return false;
+        char *data_base = (char *)NVM::data_alloc->BaseAddr();
+        const LetreeRoot &slot = head->slots[head->root & 1];
+        TreeRoot *r = new TreeRoot();
+        r->nr_groups_ = slot.nr_groups;
+#ifdef DRAM_INDEX
+        // group 在 DRAM 重建，PM 上只有 min_key 和 entry 数组副本的位置
+        const size_t group_bytes = sizeof(GroupRecord<Key>);
+        r->records = (GroupRecord<Key> *)(data_base + slot.group_offset);
+        r->group_space = (group *)index_alloc(r->nr_groups_ * sizeof(group));
+        memset((void *)r->group_space, 0, r->nr_groups_ * sizeof(group));
+#else
+        const size_t group_bytes = sizeof(group);
+        r->group_space = (group *)(data_base + slot.group_offset);
+#endif
+        r->lock_space = NewLockSpace_(r->nr_groups_);
+
+        // 各线程负责一段连续的 group，恢复 entry_space 并统计已使用的最高位置
+        int nthreads = std::max(1, std::min(ROOT_EXPAND_THREADS, r->nr_groups_));
+        std::vector<uint64_t> data_used(nthreads, 0), clevel_used(nthreads, 0);
+        RunRanges_(nthreads, [&](int t)
+                   {
+            int begin = (int)((size_t)r->nr_groups_ * t / nthreads);
+            int end = (int)((size_t)r->nr_groups_ * (t + 1) / nthreads);
+            for (int i = begin; i < end; i++)
+            {
+                group &g = r->group_space[i];
+#ifdef DRAM_INDEX
+                g.min_key = r->records[i].min_key;
+                g.entry_record_ = r->records[i].entry_record;
 #endif
-        if (find_fast(key, value))
+                const char *end = g.Recover(data_base, head->clean);
+                if (end == nullptr)
+                    continue;
+                data_used[t] = std::max(data_used[t], (uint64_t)(end - data_base));
+                if (head->clean)
+                    continue;
+                // 非正常关闭时节点的指纹和排序下标可能没有和记录一起持久化，顺便重建
+                for (int j = 0; j < g.nr_entries_; j++)
+                {
+                    const bentry_t &entry = g.entry_space[j];
+                    for (int pos = 0; pos < entry.buf.entries && entry.entrys[pos].IsValid(); pos++)
+                    {
+                        buncket_ref bucket = entry.Pointer(pos, clevel_mem_);
+                        bucket->RebuildIndex();
+                        clevel_used[t] = std::max(clevel_used[t], (uint64_t)bucket.address() + sizeof(buncket_t) - clevel_mem_->BaseAddr());
+                    }
+                }
+            }
+            pmem_persist(&r->group_space[begin], (end - begin) * sizeof(group)); });
+
+        if (head->clean)
         {
-            return true;
+            NVM::data_alloc->SetUsed(head->data_used);
+            clevel_mem_->SetUsed(head->clevel_used);
+        }
+        else
+        {
+            uint64_t groups_end = slot.group_offset + r->nr_groups_ * group_bytes;
+            NVM::data_alloc->SetUsed(std::max(groups_end, *std::max_element(data_used.begin(), data_used.end())));
+            clevel_mem_->SetUsed(*std::max_element(clevel_used.begin(), clevel_used.end()));
         }
-        return find_slow(key, value);
+        TrainRoot_(r);
+        r->base_window = r->model.avg_window();
+        SetRoot_(r);
+        StartWorkers_();
+        return true;
     }
 
-    bool letree::Scan(uint64_t start_key, int len, std::vector<std::pair<uint64_t, uint64_t>> &results)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_letree<Key, value_size, node_size, fanout>::FreeRoot_(TreeRoot *r)
     {
-#ifdef MULTI_THREAD
-        trans_begin();
-#endif
-        int length = len;
-        if (scan_fast(start_key, length, results))
+        // eentry 指向的 C 层节点被新根继续引用，这里只释放 B 层数组
+        if (r->entries_moved)
         {
-            return true;
+            for (int i : r->split_groups)
+                r->group_space[i].~group();
         }
-        bool ret = scan_slow(start_key, length, results);
-        return ret;
+        else
+        {
+            for (int i = 0; i < r->nr_groups_; i++)
+            {
+                if (r->group_space[i].nr_entries_ != 0)
+                    r->group_space[i].~group();
+            }
+        }
+        index_free(r->group_space, r->nr_groups_ * sizeof(group));
+#ifdef DRAM_INDEX
+        if (r->records)
+            NVM::data_alloc->Free(r->records, r->nr_groups_ * sizeof(GroupRecord<Key>));
+#endif
+        if (r->lock_space)
+            delete[] r->lock_space;
+        delete r;
     }
 
-    bool letree::Delete(uint64_t key)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_letree<Key, value_size, node_size, fanout>::ExpandTree()
     {
-#ifdef MULTI_THREAD
-        trans_begin();
-#endif
-        int group_id = find_group(key);
-#ifdef MULTI_THREAD
-        pthread_mutex_lock(&lock_space[group_id]);
-#endif
-        auto ret = group_space[group_id].Delete(clevel_mem_, key);
-#ifdef MULTI_THREAD
-        pthread_mutex_unlock(&lock_space[group_id]);
-#endif
-        return ret;
+        // Show();
+        if (!concurrent_)
+        {
+            TreeRoot *old_root = root();
+            SetRoot_(RebuildRoot_(old_root));
+            FreeRoot_(old_root);
+            return;
+        }
+        bool b1 = false, b2 = true;
+        if (!expand_running_.compare_exchange_strong(b1, b2, std::memory_order_acq_rel))
+        {
+            std::this_thread::yield(); // 其他线程正在扩展
+            return;
+        }
+        ExpandLoop_();
     }
 
-    int letree::find_group(const uint64_t &key) const
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_letree<Key, value_size, node_size, fanout>::RequestExpand_()
     {
-        int group_id = model.predict(key) / min_entry_count;
-        group_id = std::min(std::max(0, group_id), (int)nr_groups_ - 1);
-
-        while (group_id > 0 && (group_space[group_id].nr_entries_ == 0 ||
-                                (key < group_space[group_id].entry_space[0].entry_key)))
+        bool b1 = false;
+        if (expand_running_.compare_exchange_strong(b1, true, std::memory_order_acq_rel))
         {
-            group_id--;
+            // 先置位，使前台写者马上开始使用 tmp_buffer，而不是等维护线程被唤醒
+            tmp_.is_tree_expand.store(true, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> lock(expand_req_lock_);
+            }
+            expand_req_cv_.notify_one();
+        }
+        else if (!tmp_.is_tree_expand.load(std::memory_order_acquire))
+        {
+            // 上一次扩展正在回放 tmp_buffer
+            std::this_thread::yield();
         }
-
-        while (group_space[group_id].nr_entries_ == 0)
-            group_id++;
-
-        return group_id;
     }
 
-    bool letree::find_fast(uint64_t key, uint64_t &value) const
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_letree<Key, value_size, node_size, fanout>::ExpandWorker_()
     {
-        int group_id = model.predict(key) / min_entry_count;
-        group_id = std::min(std::max(0, group_id), (int)nr_groups_ - 1);
-        auto ret = group_space[group_id].fast_fail(clevel_mem_, key, value);
-        return ret;
+        std::unique_lock<std::mutex> lock(expand_req_lock_);
+        while (true)
+        {
+            expand_req_cv_.wait(lock, [this]
+                                { return expand_stop_ || expand_running_.load(std::memory_order_acquire); });
+            if (expand_stop_)
+                return;
+            lock.unlock();
+            ExpandLoop_();
+            lock.lock();
+        }
     }
 
-    bool letree::find_slow(uint64_t key, uint64_t &value) const
+    /**
+     * @brief 扩展过程，前台扩展和后台扩展共用，整个过程中读操作不阻塞：
+     * 1. 等待没看到 is_tree_expand 的写者退出，此后旧根的 eentry 数组不再被修改；
+     * 2. 在旁边生成新根并原子替换 root_；
+     * 3. 等待旧根上的操作全部结束后清除 is_tree_expand，再等待写 tmp_buffer 的写者结束，回收旧根；
+     * 4. 把 tmp_buffer 回放到新根，回放时若 group 又满了则再扩展一次。
+     * 前台模式下写者在 is_tree_expand 置位期间阻塞在 trans_begin，后台模式下写者转写 tmp_buffer。
+     */
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void basic_letree<Key, value_size, node_size, fanout>::ExpandLoop_()
     {
-        int group_id = find_group(key);
-        auto ret = group_space[group_id].Get(clevel_mem_, key, value);
-        return ret;
+        bool drained;
+        do
+        {
+            tmp_.is_tree_expand.store(true, std::memory_order_release);
+            epoch_.Synchronize();
+            TreeRoot *old_root = root();
+            SetRoot_(RebuildRoot_(old_root));
+            epoch_.Synchronize();
+            {
+                std::lock_guard<std::mutex> lock(expand_wait_lock);
+                tmp_.is_tree_expand.store(false, std::memory_order_release);
+            }
+            expand_wait_cv.notify_all();
+            epoch_.Synchronize();
+            FreeRoot_(old_root);
+            drained = DrainTmpBuffer_();
+        } while (!drained);
+        expand_running_.store(false, std::memory_order_release);
     }
 
-    bool letree::scan_fast(uint64_t start_key, int &len, std::vector<std::pair<uint64_t, uint64_t>> &results) const
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_letree<Key, value_size, node_size, fanout>::DrainTmpBuffer_()
     {
-        int group_id = model.predict(start_key) / min_entry_count;
-        group_id = std::min(std::max(0, group_id), (int)nr_groups_ - 1);
-        if (group_space[group_id].scan_fast_fail(clevel_mem_, start_key))
+#ifdef USE_TMP_WRITE_BUFFER
+        if constexpr (bentry_t::use_tmp_buffer)
         {
-            scan_slow(start_key, len, results, group_id);
-            return true;
+            std::vector<std::pair<key_type, value_type>> tmp_data;
+            int len = INT32_MAX;
+            tmp_.buffer->btree_search_range(0, UINT64_MAX, tmp_data, len);
+            for (auto &kv : tmp_data)
+            {
+                // 持有 group 锁和 tmp_.lock 把 key 从 tmp_buffer 移到新根，前台写者持有 group 锁时 key 只在其中一处。
+                // 快照之后前台可能已经修改或删除了这个 key，写入的是 tmp_buffer 中当前的值，key 不在了就跳过。
+                // 回放期间 is_tree_expand 已清除，group::Put 不会再转写 tmp_buffer；
+                // 先写入新根再从 tmp_buffer 删除，保证并发的 Get 总能在其中之一找到
+                EpochManager::Guard guard(&epoch_);
+                TreeRoot *r = root();
+                int group_id = find_group(r, kv.first);
+                status ret = status::OK;
+                pthread_mutex_lock(&r->lock_space[group_id]);
+                {
+                    std::lock_guard<std::mutex> lock(tmp_.lock);
+                    char *p = tmp_.buffer->btree_search(kv.first);
+                    if (p != NULL)
+                    {
+                        r->group_space[group_id].write_begin();
+                        ret = r->group_space[group_id].Put(clevel_mem_, kv.first, (uint64_t)p);
+                        r->group_space[group_id].write_end();
+                        if (ret != status::Full)
+                            tmp_.buffer->btree_delete(kv.first);
+                    }
+                }
+                pthread_mutex_unlock(&r->lock_space[group_id]);
+                if (ret == status::Full)
+                    return false;
+            }
         }
-        return false;
+#endif
+        return true;
     }
 
-    extern uint64_t scan_groups;
-
-    bool letree::scan_slow(uint64_t start_key, int &len, std::vector<std::pair<uint64_t, uint64_t>> &results, int fast_group_id) const
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_letree<Key, value_size, node_size, fanout>::TmpBufferGet_(key_type key, value_type &value) const
     {
-        int group_id = 0;
-        if (fast_group_id != 0)
-        {
-            group_id = fast_group_id;
-        }
-        else
-        {
-            group_id = find_group(start_key);
-        }
-        int tmp = 0;
-        auto ret = group_space[group_id].Scan(clevel_mem_, start_key, len, results, true);
-        tmp++;
-        while (!ret && group_id < nr_groups_ - 1)
+#ifdef USE_TMP_WRITE_BUFFER
+        if constexpr (bentry_t::use_tmp_buffer)
         {
-            ++group_id;
-            while (group_space[group_id].nr_entries_ == 0)
+            if (expand_running_.load(std::memory_order_acquire))
             {
-                ++group_id;
+                char *ret = tmp_.buffer->btree_search(key);
+                if (ret != NULL)
+                {
+                    value = (uint64_t)ret;
+                    return true;
+                }
             }
-            ret = group_space[group_id].Scan(clevel_mem_, start_key, len, results, false);
-            tmp++;
         }
-        scan_groups += tmp;
-        if (len > 0)
-        {
-            std::cout << len << std::endl;
-        }
-        return 0;
+#endif
+        return false;
     }
 
-    void letree::ExpandTree()
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool basic_letree<Key, value_size, node_size, fanout>::TmpBufferPut_(key_type key, value_type value, value_type *old)
     {
-        size_t entry_count = 0;
-        int entry_seq = 0;
-
-        // Show();
-#ifdef MULTI_THREAD
-        bool b1 = false, b2 = true;
-        if (!is_tree_expand.compare_exchange_strong(b1, b2, std::memory_order_acquire))
-            return;
-#endif
-
+#ifdef USE_TMP_WRITE_BUFFER
+        if constexpr (bentry_t::use_tmp_buffer)
         {
-            /*采用一层线性模型*/
-            LearnModel::rmi_line_model<uint64_t>::builder_t bulder(&model);
-            // 遍历一遍group的所有entry的entrykey生成模型
-            for (int i = 0; i < nr_groups_; i++)
+            // 否则写入树中的新值会在回放时被 tmp_buffer 中的旧值覆盖
+            if (expand_running_.load(std::memory_order_acquire))
             {
-                if (group_space[i].next_entry_count == 0)
-                    continue;
-                entry_count += group_space[i].next_entry_count;
-                group_space[i].AdjustEntryKey(clevel_mem_);
-                group::EntryIter e_iter(&group_space[i]);
-                // int sample = std::ceil(1.0 * group_space[i].next_entry_count / min_entry_count);
-                while (!e_iter.end())
+                std::lock_guard<std::mutex> lock(tmp_.lock);
+                char *p = tmp_.buffer->btree_search(key);
+                if (p != NULL)
                 {
-                    bulder.add((*e_iter).entry_key, entry_seq);
-                    e_iter.next();
-                    entry_seq++;
+                    if (old)
+                        *old = (uint64_t)p;
+                    tmp_.buffer->btree_delete(key);
+                    tmp_.buffer->btree_insert(key, (char *)value);
+                    return true;
                 }
             }
-            bulder.build();
         }
-        int new_nr_groups = std::ceil(1.0 * entry_count / min_entry_count);
-        group *new_group_space = (group *)NVM::data_alloc->alloc_aligned(new_nr_groups * sizeof(group));
-        pmem_memset_persist(new_group_space, 0, new_nr_groups * sizeof(group));
-#ifdef MULTI_THREAD
-        // std::mutex *new_lock_space = new std::mutex[new_nr_groups];
-        pthread_mutex_t *new_lock_space = new pthread_mutex_t[new_nr_groups];
-        for (int i = 0; i < new_nr_groups; i++)
-            new_lock_space[i] = PTHREAD_MUTEX_INITIALIZER;
 #endif
-        int group_id = 0;
+        return false;
+    }
 
-        for (int i = 0; i < nr_groups_; i++)
+    /**
+     * @brief 双向迭代器，每次把一个 C 层节点的记录排好序复制到迭代器内部，
+     * next/prev 在节点内移动，越过节点边界时再按 group → PointerBEntry → 节点 的顺序加载相邻节点。
+     * 迭代器不持有 epoch，不能和 ExpandTree 并发使用
+     */
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    class basic_letree<Key, value_size, node_size, fanout>::Iter
+    {
+    public:
+        Iter(basic_letree *tree) : Iter(tree, 0) {}
+
+        Iter(basic_letree *tree, key_type start_key) : tree_(tree), root_(tree->root())
         {
-            group::EntryIter e_iter(&group_space[i]);
-            while (!e_iter.end())
-            {
-                group_id = model.predict((*e_iter).entry_key) / min_entry_count;
-                group_id = std::min(std::max(0, group_id), (int)new_nr_groups - 1);
-                new_group_space[group_id].inc_entry_count();
-                e_iter.next();
-            }
+            Seek(start_key);
         }
 
-        for (int i = 0; i < new_nr_groups; i++)
+        ~Iter()
         {
-            if (new_group_space[i].next_entry_count == 0)
-                continue;
-            new_group_space[i].reserve_space();
         }
 
-        for (int i = 0; i < nr_groups_; i++)
+        key_type key() const
         {
-            group::EntryIter e_iter(&group_space[i]);
-            while (!e_iter.end())
-            {
-                group_id = model.predict((*e_iter).entry_key) / min_entry_count;
-                group_id = std::min(std::max(0, group_id), (int)new_nr_groups - 1);
-                new_group_space[group_id].append_entry(&(*e_iter));
-                // assert((*e_iter).entry_key >= prev_key);
-                // prev_key = (*e_iter).entry_key;
-                e_iter.next();
-            }
+            return keys_[idx_];
         }
 
-        for (int i = 0; i < new_nr_groups; i++)
+        value_type value() const
         {
-            if (new_group_space[i].next_entry_count == 0)
-                continue;
-            new_group_space[i].re_tarin();
+            return values_[idx_];
         }
-        pmem_persist(new_group_space, new_nr_groups * sizeof(group));
-        if (nr_groups_ != 0)
+
+        // 定位到第一个 >= key 的记录
+        void Seek(key_type key)
         {
-#ifdef MULTI_THREAD
-            if (lock_space)
-                delete[] lock_space;
-#endif
+            Locate_(key);
+            idx_ = std::lower_bound(keys_, keys_ + count_, key) - keys_;
+            if (idx_ == count_)
+                SkipForward_();
         }
-        // std::cout << "root_expand, old_groups: " << nr_groups_ << " new_groups: " << new_nr_groups << std::endl;
-        nr_groups_ = new_nr_groups;
-        group_space = new_group_space;
-        root_expand_times++;
-#ifdef MULTI_THREAD
-        lock_space = new_lock_space;
-        is_tree_expand.store(false);
-        expand_wait_cv.notify_all();
-#ifdef USE_TMP_WRITE_BUFFER
-        std::vector<std::pair<uint64_t, uint64_t>> tmp_data;
-        int len = INT32_MAX;
-        tmp_buffer->btree_search_range(0, UINT64_MAX, tmp_data, len);
-        if (len)
+
+        // 定位到最后一个 <= key 的记录
+        void SeekForPrev(key_type key)
         {
-            for (int i = 0; i < len; i++)
-            {
-                Put(tmp_data[i].first, tmp_data[i].second); // write back
-            }
-            delete tmp_buffer;
-            tmp_buffer = new FastFair::btree();
+            Locate_(key);
+            idx_ = std::upper_bound(keys_, keys_ + count_, key) - keys_ - 1;
+            if (idx_ < 0)
+                SkipBackward_();
         }
-#endif
-#endif
-    }
 
-    class letree::Iter
-    {
-    public:
-        Iter(letree *tree) : tree_(tree), group_id_(0), giter(&tree->group_space[0], tree->clevel_mem_)
+        bool next()
         {
-            while (giter.end())
-            {
-                group_id_++;
-                if (group_id_ >= tree_->nr_groups_)
-                    break;
-                new (&giter) group::Iter(&tree_->group_space[group_id_], tree_->clevel_mem_);
-            }
+            if (end())
+                return false;
+            if (++idx_ < count_)
+                return true;
+            return SkipForward_();
         }
-        Iter(letree *tree, uint64_t start_key) : tree_(tree), group_id_(0),
-                                                 giter(&tree->group_space[0], tree->clevel_mem_)
+
+        bool prev()
         {
-            group_id_ = tree->find_group(start_key);
-            new (&giter) group::Iter(&tree->group_space[group_id_], start_key, tree->clevel_mem_);
+            if (end())
+                return false;
+            if (--idx_ >= 0)
+                return true;
+            return SkipBackward_();
         }
-        ~Iter()
+
+        bool end() const
+        {
+            return idx_ < 0 || idx_ >= count_;
+        }
+
+    private:
+        const bentry_t &Entry_() const
         {
+            return root_->group_space[group_id_].entry_space[entry_id_];
         }
 
-        uint64_t key()
+        static int Nodes_(const bentry_t &entry)
         {
-            return giter.key();
+            return std::min<int>(entry.buf.entries, bentry_t::entry_count);
         }
 
-        uint64_t value()
+        void Load_()
         {
-            return giter.value();
+            count_ = 0;
+            Entry_().Pointer(pos_, tree_->clevel_mem_)->Visit(0, kMaxKey, buncket_ref::Capacity(), [this](key_type k, value_type v)
+                                                               {
+                                                                   keys_[count_] = k;
+                                                                   values_[count_++] = v; });
         }
 
-        bool next()
+        // 定位到 key 所在的节点，group 为空时停在它的开头，由 Skip*_ 移到相邻的 group
+        void Locate_(key_type key)
         {
-            if (group_id_ < tree_->nr_groups_ && giter.next())
-            {
-                return true;
-            }
-            while (giter.end())
+            group_id_ = tree_->find_group(root_, key);
+            const group &g = root_->group_space[group_id_];
+            entry_id_ = 0;
+            pos_ = 0;
+            count_ = 0;
+            if (g.nr_entries_ == 0)
+                return;
+            entry_id_ = g.find_entry(key);
+            pos_ = std::min(Entry_().Find_pos(key), Nodes_(Entry_()) - 1);
+            Load_();
+        }
+
+        // 移到下一个非空节点的第一个记录，没有时返回 false
+        bool SkipForward_()
+        {
+            while (true)
             {
-                group_id_++;
-                if (group_id_ >= tree_->nr_groups_)
-                    break;
-                new (&giter) group::Iter(&tree_->group_space[group_id_], tree_->clevel_mem_);
+                const group *g = &root_->group_space[group_id_];
+                if (entry_id_ < g->nr_entries_ && pos_ + 1 < Nodes_(Entry_()))
+                {
+                    pos_++;
+                }
+                else if (entry_id_ + 1 < g->nr_entries_)
+                {
+                    entry_id_++;
+                    pos_ = 0;
+                }
+                else
+                {
+                    do
+                    {
+                        group_id_++;
+                    } while (group_id_ < root_->nr_groups_ && root_->group_space[group_id_].nr_entries_ == 0);
+                    if (group_id_ >= root_->nr_groups_)
+                    {
+                        group_id_ = root_->nr_groups_ - 1;
+                        count_ = idx_ = 0;
+                        return false;
+                    }
+                    entry_id_ = 0;
+                    pos_ = 0;
+                }
+                Load_();
+                if (count_ > 0)
+                {
+                    idx_ = 0;
+                    return true;
+                }
             }
-
-            return group_id_ < tree_->nr_groups_;
         }
 
-        bool end()
+        // 移到上一个非空节点的最后一个记录，没有时返回 false
+        bool SkipBackward_()
         {
-            return group_id_ >= tree_->nr_groups_;
+            while (true)
+            {
+                if (pos_ > 0)
+                {
+                    pos_--;
+                }
+                else if (entry_id_ > 0)
+                {
+                    entry_id_--;
+                    pos_ = Nodes_(Entry_()) - 1;
+                }
+                else
+                {
+                    do
+                    {
+                        group_id_--;
+                    } while (group_id_ >= 0 && root_->group_space[group_id_].nr_entries_ == 0);
+                    if (group_id_ < 0)
+                    {
+                        group_id_ = 0;
+                        count_ = idx_ = 0;
+                        return false;
+                    }
+                    entry_id_ = root_->group_space[group_id_].nr_entries_ - 1;
+                    pos_ = Nodes_(Entry_()) - 1;
+                }
+                Load_();
+                if (count_ > 0)
+                {
+                    idx_ = count_ - 1;
+                    return true;
+                }
+            }
         }
 
-    private:
-        letree *tree_;
-        group::Iter giter;
+        basic_letree *tree_;
+        const TreeRoot *root_;
         int group_id_;
+        int entry_id_;
+        int pos_;
+        int count_;
+        int idx_;
+        key_type keys_[buncket_ref::Capacity()];
+        value_type values_[buncket_ref::Capacity()];
     };
 
 } // namespace letree
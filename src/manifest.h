@@ -1,3 +1,5 @@
+#pragma once
+
 #include <filesystem>
 #include <libpmem.h>
 #include <libpmemobj++/persistent_ptr.hpp>
@@ -66,4 +68,32 @@ namespace letree
 
   }; // End of LearnIndexHead
 
+  // 根记录：当前根的 group 数组在数据池中的位置
+  struct LetreeRoot
+  {
+    uint64_t group_offset;
+    uint64_t nr_groups;
+  };
+
+  /**
+   * letree 记录在 C 层内存池开头的头部，重启时据此恢复。
+   * 根记录有两份，新根先写入不在使用的一份并持久化，再用一次 8 字节原子写更新 root 切换过去，
+   * 扩展在任何时刻中断，重启后都能找到完整的旧根或新根
+   */
+  struct LetreeHead
+  {
+    static const uint64_t kMagic = 0x4c45545245453037UL; // "LETREE07"
+
+    uint64_t magic;
+    uint64_t root;         // 根切换的次数，slots[root & 1] 是当前根
+    LetreeRoot slots[2];
+    uint64_t clean;        // 正常关闭时为 1，此时下面两个分配位置有效
+    uint64_t data_used;
+    uint64_t clevel_used;
+    uint32_t key_size;     // 创建时树的 key 和值宽度、C 层节点大小和 PointerBEntry 的节点个数，按其他参数打开时拒绝恢复
+    uint32_t value_size;
+    uint32_t node_size;
+    uint32_t fanout;
+  }; // End of LetreeHead
+
 } // namespace letree
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <cstdint>
 #include <iostream>
@@ -7,6 +8,8 @@
 #include <vector>
 #include <shared_mutex>
 #include <cmath>
+#include <type_traits>
+#include <x86intrin.h>
 #include "letree_config.h"
 #include "bitops.h"
 #include "nvm_alloc.h"
@@ -14,19 +17,34 @@
 #include "kvbuffer.h"
 #include "clevel.h"
 #include "pmem.h"
+#include "simd_search.h"
 #include "fast-fair/btree.h"
 
-#define UBUCKET_SIZE 256 // datanode size, default 256B
-
 #define USE_TMP_WRITE_BUFFER // for multi_thread version: disable datanode spliting when expanding tree, create a temporary write buffer instead
 using namespace std;
 
 namespace letree
 {
-#ifdef USE_TMP_WRITE_BUFFER
-    std::atomic_bool is_tree_expand;
-    FastFair::btree *tmp_buffer;
-#endif
+    /**
+     * @brief 扩展期间的临时写缓冲，每棵树持有一份，通过参数传给 PointerBEntry::Put / MultiPut。
+     * is_tree_expand 置位期间不能修改 eentry，写不进 C 层节点的 key 暂存在 buffer 中
+     */
+    struct TmpWriteBuffer
+    {
+        std::atomic_bool is_tree_expand{false};
+        FastFair::btree *buffer = nullptr;
+        std::mutex lock;
+
+        ~TmpWriteBuffer() { delete buffer; }
+
+        bool Expanding() const { return is_tree_expand.load(std::memory_order_acquire); }
+
+        void Put(uint64_t key, uint64_t value)
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            buffer->btree_insert(key, (char *)value);
+        }
+    };
 
 #define USE_DELETE_0
     // Less then 64 bits
@@ -856,18 +874,53 @@ namespace letree
 
 #endif
 
+    extern uint64_t scan_buckets;
+
+    typedef unsigned __int128 uint128_t;
+
+    // 按字节数选择记录中 key 和 value 的整数类型
+    template <const size_t size>
+    struct uint_of;
+
+    template <>
+    struct uint_of<4>
+    {
+        typedef uint32_t type;
+    };
+
+    template <>
+    struct uint_of<8>
+    {
+        typedef uint64_t type;
+    };
+
+    template <>
+    struct uint_of<16>
+    {
+        typedef uint128_t type;
+    };
+
     /**
-     * @brief 有序的C层节点，
-     *
-     * @tparam bucket_size
-     * @tparam value_size
-     * @tparam key_size
-     * @tparam max_entry_count
+     * @brief 无序 C 层节点，key 和 value 的宽度由 key_size / value_size 决定，
+     * 记录紧密排列，每个节点能放的记录数在编译时确定（256B 节点：4+4 字节 24 条，8+8 字节 14 条，16+16 字节 7 条）。
+     * 头部之后是每条记录 1 字节的指纹，和 entries 在同一个 cache line，查找先用一条 SIMD 指令比较所有指纹，
+     * 只读取指纹相同的记录，key 不存在时通常只访问第一个 cache line。
+     * 指纹之后是前 sorted 条记录按 key 排序的下标（不超过 16 条记录时每个 4 位，否则 8 位），
+     * 同样在第一个 cache line 里随 entries 一起 flush。插入只追加到无序的尾部，不读其他记录，
+     * 尾部攒到 max_tail 条时才整体重新排序一次；分裂、Load 和区间删除本来就要读所有 key，顺便重新排序，删除时就地维护。
+     * Scan、Visit、Iter 和 Expand_ 在有序部分上二分，只需给尾部的几条记录排序再归并。
+     * 指纹和排序下标都可以由记录重新算出，非正常关闭后由 RebuildIndex 重建
      */
-    template <const size_t bucket_size = 128, const size_t value_size = 8, const size_t key_size = 8,
-              const size_t max_entry_count = 256>
-    class __attribute__((aligned(64))) SortBuncket
-    { // without SortBuncket main key
+
+    template <const size_t bucket_size = 256, const size_t value_size = 8, const size_t key_size = 8,
+              const size_t max_entry_count = 64>
+    class __attribute__((aligned(64))) UnSortBuncket
+    {
+    public:
+        typedef typename uint_of<key_size>::type key_type;
+        typedef typename uint_of<value_size>::type value_type;
+
+    private:
         struct entry;
 
         ALWAYS_INLINE size_t maxEntrys(int idx) const
@@ -887,105 +940,292 @@ namespace letree
             return (void *)&records[idx].ptr;
         }
 
-        // 插入一个KV对，仿照FastFair写的，先移动指针，再移动key
-        status PutBufKV(uint64_t new_key, uint64_t value, int &data_index, bool flush = true);
+        status PutBufKV(key_type new_key, value_type value, int &data_index, bool flush = true);
 
-#ifdef USE_DELETE_0
-        bool remove_key(uint64_t key, uint64_t *value);
-#else
-        bool remove_key(uint64_t key, uint64_t *value);
-#endif
+        bool remove_key(key_type key, value_type *value, int idx);
 
-        status SetValue(int pos, uint64_t value)
+        status SetValue(int pos, value_type value)
         {
             memcpy(pvalue(pos), &value, value_size);
-#ifndef USE_MEM
-            clflush(pvalue(pos));
-#ifdef TEST_PMEM_SIZE
-            NVM::pmem_size += CACHE_LINE_SIZE;
-#endif
+            FlushRange_(pvalue(pos), value_size);
             fence();
-#endif
             return status::OK;
         }
 
+        // 记录紧密排列，可能跨 cache line
+        static void FlushRange_(const void *addr, size_t len)
+        {
+            const char *end = (const char *)addr + len;
+            for (char *line = (char *)((uint64_t)addr & ~(CACHE_LINE_SIZE - 1)); line < end; line += CACHE_LINE_SIZE)
+            {
+                clflush(line);
+#ifdef TEST_PMEM_SIZE
+                NVM::pmem_size += CACHE_LINE_SIZE;
+#endif
+            }
+        }
+
+        int getSortedIndex(int sorted_index[]) const;
+
+        // 第 rank 小的记录的下标
+        ALWAYS_INLINE int Order_(int rank) const
+        {
+            if constexpr (order_bits == 4)
+                return (order[rank >> 1] >> ((rank & 1) * 4)) & 0xf;
+            else
+                return order[rank];
+        }
+
+        ALWAYS_INLINE void SetOrder_(int rank, int idx)
+        {
+            if constexpr (order_bits == 4)
+                order[rank >> 1] = (order[rank >> 1] & (0xf0 >> ((rank & 1) * 4))) | (idx << ((rank & 1) * 4));
+            else
+                order[rank] = idx;
+        }
+
+        // 有序部分中第 rank 小的 key，越界的下标（并发写入时读到一半的 order）截断到 run 之内，结果由调用者校验版本号
+        ALWAYS_INLINE key_type SortedKey_(int rank, int run) const
+        {
+            return key(std::min(Order_(rank), run - 1));
+        }
+
+        // 有序部分的 run 条记录中小于 k（Inclusive 时不大于 k）的个数，二分查找排序下标
+        template <bool Inclusive = false>
+        int Rank_(key_type k, int run) const
+        {
+            int lo = 0, hi = run;
+            while (lo < hi)
+            {
+                int mid = (lo + hi) / 2;
+                key_type mk = SortedKey_(mid, run);
+                if (Inclusive ? mk <= k : mk < k)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            return lo;
+        }
+
+        /**
+         * @brief 删除下标为 pos 的记录、最后一条记录 last 移到 pos 之前维护排序下标：
+         * 删除的是尾部的记录时不变；尾部为空时去掉 pos 并把 last 改成 pos；
+         * 否则去掉 pos 之后把从尾部移过来的记录按 key 插入有序部分，有序部分的长度不变
+         */
+        void EraseOrder_(int pos, int last)
+        {
+            int run = sorted;
+            if (pos >= run)
+                return;
+            int r = 0;
+            while (Order_(r) != pos)
+                r++;
+            for (; r < run - 1; r++)
+                SetOrder_(r, Order_(r + 1));
+            if (last < run)
+            {
+                if (pos != last)
+                {
+                    for (r = 0; Order_(r) != last; r++)
+                        ;
+                    SetOrder_(r, pos);
+                }
+                sorted = run - 1;
+                return;
+            }
+            // 去掉 pos 之后前 run - 1 个排序下标仍可能指向 run - 1 号记录，不能用 Rank_（它把下标截断到 run 之内），
+            // 这里没有并发写者，直接顺序比较
+            int rank = 0;
+            while (rank < run - 1 && key(Order_(rank)) < key(last))
+                rank++;
+            for (r = run - 1; r > rank; r--)
+                SetOrder_(r, Order_(r - 1));
+            SetOrder_(rank, pos);
+        }
+
+        // 所有记录重新排序，之后整个节点都是有序部分
+        void SortOrder_()
+        {
+            int sorted_index[entry_count];
+            int n = getSortedIndex(sorted_index);
+            for (int i = 0; i < n; i++)
+                SetOrder_(i, sorted_index[i]);
+            sorted = n;
+        }
+
+        /**
+         * @brief 按 key 顺序把 [lo, hi] 内最多 len 条记录的下标交给 fn，Reverse 为 true 时从大到小。
+         * 有序部分在排序下标上二分找到起点，尾部在栈上插入排序后和有序部分归并，不做任何分配
+         */
+        template <bool Reverse, typename Fn>
+        int VisitSorted_(key_type lo, key_type hi, int len, Fn &&fn) const
+        {
+            // 并发读可能读到写了一半的 entries 和 sorted，限制在 records 范围内，由调用者校验版本号
+            int count = std::min<int>(entries, entry_count);
+            int run = std::min<int>(sorted, count);
+            uint8_t tail[entry_count];
+            int t = 0;
+            for (int i = run; i < count; i++)
+            {
+                key_type k = key(i);
+                if (k < lo || k > hi)
+                    continue;
+                int j = t++;
+                for (; j > 0 && (Reverse ? key(tail[j - 1]) < k : key(tail[j - 1]) > k); j--)
+                    tail[j] = tail[j - 1];
+                tail[j] = i;
+            }
+            const int step = Reverse ? -1 : 1;
+            const int r_end = Reverse ? -1 : run;
+            int r = Reverse ? Rank_<true>(hi, run) - 1 : Rank_(lo, run);
+            int n = 0, j = 0;
+            while (n < len)
+            {
+                int i = -1;
+                if (r != r_end)
+                {
+                    i = std::min(Order_(r), run - 1);
+                    if (Reverse ? key(i) < lo : key(i) > hi)
+                    {
+                        r = r_end;
+                        i = -1;
+                    }
+                }
+                if (j < t && (i < 0 || (Reverse ? key(tail[j]) > key(i) : key(tail[j]) < key(i))))
+                    i = tail[j++];
+                else if (i >= 0)
+                    r += step;
+                else
+                    break;
+                fn(i);
+                n++;
+            }
+            return n;
+        }
+
+        void FlushMeta_(int first, int n)
+        {
+            if (meta_in_header_line)
+                return;
+            FlushRange_(&fingerprints[first], n);
+            FlushRange_(order, OrderBytes_(entry_count));
+        }
+
+        ALWAYS_INLINE static uint8_t Fingerprint_(key_type key)
+        {
+            uint64_t k = (uint64_t)key;
+            if constexpr (key_size > 8)
+                k ^= (uint64_t)(key >> 64);
+            return (k * 0x9e3779b97f4a7c15UL) >> 56;
+        }
+
     public:
         class Iter;
 
-        SortBuncket(uint64_t key, int prefix_len) : entries(0), last_pos(0), next_bucket(nullptr)
+        UnSortBuncket(key_type key, int prefix_len) : next_bucket(nullptr), entries(0), sorted(0)
         {
             next_bucket = nullptr;
-            max_entries = std::min(buf_size / (value_size + key_size), max_entry_count);
+            max_entries = std::min(entry_count, max_entry_count);
             // std::cout << "Max Entry size is:" <<  max_entries << std::endl;
         }
 
-        explicit SortBuncket(uint64_t key, uint64_t value, int prefix_len);
+        explicit UnSortBuncket(key_type key, value_type value, int prefix_len);
 
-        ~SortBuncket()
+        ~UnSortBuncket()
         {
         }
 
-        status Load(uint64_t *keys, uint64_t *values, int count);
+        status Load(key_type *keys, value_type *values, int count);
 
-        // 节点分裂
-        status Expand_(CLevel::MemControl *mem, SortBuncket *&next, uint64_t &split_key, int &prefix_len);
+        status Expand_(CLevel::MemControl *mem,
+                       UnSortBuncket *&next, key_type &split_key, int &prefix_len);
 
-        SortBuncket *Next()
+        UnSortBuncket *Next()
         {
             return next_bucket;
         }
 
-        int Find(uint64_t target, bool &find) const;
+        template <simd::Isa isa = simd::kIsa>
+        int Find(key_type target, bool &find) const;
 
-        ALWAYS_INLINE int LinearFind(uint64_t target, bool &find) const
+        ALWAYS_INLINE value_type value(int idx) const
         {
-            int i = 0;
-            for (; i < last_pos && target > records[i].key; i++)
-                ;
-            find = (i < last_pos) && (target == records[i].key);
-            return i;
+            // the const bit mask will be generated during compile
+            return records[idx].ptr;
         }
 
-        ALWAYS_INLINE uint64_t value(int idx) const
+        // 节点最多容纳的记录数，Visit 的调用者据此在栈上准备缓冲区
+        static constexpr int Capacity()
         {
-            // the const bit mask will be generated during compile
-            return records[idx].ptr;
+            return entry_count;
         }
 
-        ALWAYS_INLINE uint64_t key(int idx) const
+        ALWAYS_INLINE key_type key(int idx) const
         {
             return records[idx].key;
         }
 
-        ALWAYS_INLINE uint64_t min_key() const
+        ALWAYS_INLINE key_type min_key() const
         {
-#ifdef USE_DELETE_0
-            for (int i = 0; records[i].key != 0; i++)
+            key_type min_key = key(0);
+            for (int i = 1; i < entries; i++)
             {
-                return records[0].key;
+                if (key(i) < min_key)
+                {
+                    min_key = key(i);
+                }
             }
-#else
-            return records[0].key;
-#endif
+            return min_key;
         }
 
-        status Put(CLevel::MemControl *mem, uint64_t key, uint64_t value);
+        status Put(CLevel::MemControl *mem, key_type key, value_type value);
 
-        status Update(CLevel::MemControl *mem, uint64_t key, uint64_t value);
+        // 批量追加，返回写入的个数，节点写满时剩余的 key 由调用者处理
+        int PutBatch(const std::pair<key_type, value_type> kvs[], int count);
 
-        status Get(CLevel::MemControl *mem, uint64_t key, uint64_t &value) const;
+        // 删除 [lo, hi] 内的 key，剩余的记录原地压缩，返回删除的个数
+        int DeleteRange(key_type lo, key_type hi);
+
+        // 清空节点，整个节点被区间删除覆盖但不能释放时使用
+        void Clear()
+        {
+            entries = 0;
+            sorted = 0;
+            clflush(&header);
+            fence();
+        }
 
-        status Scan(CLevel::MemControl *mem, uint64_t start_key, int &len, std::vector<std::pair<uint64_t, uint64_t>> &results, bool if_first) const;
+        status Update(CLevel::MemControl *mem, key_type key, value_type value);
 
-        status Delete(CLevel::MemControl *mem, uint64_t key, uint64_t *value);
+        status Get(CLevel::MemControl *mem, key_type key, value_type &value) const;
+
+        status Scan(CLevel::MemControl *mem, key_type start_key, int &len, std::vector<std::pair<key_type, value_type>> &results, bool if_first) const;
+
+        /**
+         * @brief 把 [lo, hi] 内的记录按 key 顺序交给 visit(key, value)，最多 len 个，
+         * Reverse 为 true 时从大到小
+         * @return 访问的记录个数
+         */
+        template <bool Reverse = false, typename Visitor>
+        int Visit(key_type lo, key_type hi, int len, Visitor &&visit) const
+        {
+            scan_buckets++;
+            return VisitSorted_<Reverse>(lo, hi, len, [&](int i)
+                                         { visit(key(i), value(i)); });
+        }
+
+        status Delete(CLevel::MemControl *mem, key_type key, value_type *value);
 
         void Show() const
         {
-            std::cout << "This: " << this << ", entry count: " << entries << std::endl;
-            for (int i = 0; i < entries; i++)
-            {
-                std::cout << "key: " << key(i) << ", value: " << value(i) << std::endl;
-            }
+            std::cout << entries << ", ";
+            // std::cout << "This: " << this << ", entry count: " << entries << std::endl;
+            // for (int i = 0; i < entries; i++)
+            // {
+            //     std::cout << "key: " << key(i) << ", value: " << value(i);
+            //     // std::cout << "key: " << key(i) << ", value: " << value(i) << std::endl;
+            // }
+            // std::cout << std::endl;
         }
 
         uint64_t EntryCount() const
@@ -996,29 +1236,71 @@ namespace letree
         void SetInvalid() {}
         bool IsValid() { return false; }
 
+        // 按记录重新计算指纹和排序下标，恢复时节点可能停在它们和 entries 只持久化了一部分的状态
+        void RebuildIndex()
+        {
+            for (int i = 0; i < entries; i++)
+                fingerprints[i] = Fingerprint_(key(i));
+            sorted = 0;
+            SortOrder_();
+            FlushRange_(&header, RecordsOffset_(entry_count) - 8);
+            fence();
+        }
+
     private:
         // Frist 8 byte head
-        struct entry
+        struct __attribute__((packed)) entry
         {
-            uint64_t key;
-            uint64_t ptr;
+            key_type key;
+            value_type ptr;
         };
 
-        const static size_t buf_size = bucket_size - (8 + 4);
+        const static size_t header_size = 8 + 2 + 1;
         const static size_t entry_size = (key_size + value_size);
-        const static size_t entry_count = (buf_size / entry_size);
+        // 排序下标的宽度，按 entries 的上限（8 位）和节点大小估计
+        const static size_t order_bits = (bucket_size - header_size) / (entry_size + 1) <= 16 ? 4 : 8;
+
+        static constexpr size_t OrderBytes_(size_t n)
+        {
+            return (n * order_bits + 7) / 8;
+        }
+
+        // n 条记录时记录的起始位置，指纹和排序下标之后按 16 字节对齐，8+8 字节时每条记录不跨 cache line
+        static constexpr size_t RecordsOffset_(size_t n)
+        {
+            return (header_size + n + OrderBytes_(n) + 15) & ~(size_t)15;
+        }
+
+        static constexpr size_t FitEntries_()
+        {
+            size_t n = (bucket_size - header_size) / (entry_size + 1);
+            while (RecordsOffset_(n) + n * entry_size > bucket_size)
+                n--;
+            return n;
+        }
 
-        SortBuncket *next_bucket;
+        const static size_t entry_count = FitEntries_();
+        const static size_t order_size = RecordsOffset_(entry_count) - header_size - entry_count;
+        // 指纹和排序下标都在 header 所在的 cache line 时，随 entries 一起 flush
+        const static bool meta_in_header_line = header_size + entry_count + OrderBytes_(entry_count) <= CACHE_LINE_SIZE;
+        static_assert(sizeof(entry) == entry_size, "records are packed");
+        static_assert(order_bits == 8 || entry_count <= 16, "4-bit order holds at most 16 records");
+        // 无序尾部的长度上限，超过时 Put 把整个节点重新排序
+        const static size_t max_tail = std::max<size_t>(2, entry_count / 4);
+
+        UnSortBuncket *next_bucket;
         union
         {
-            uint32_t header;
+            uint16_t header;
             struct
             {
-                uint16_t last_pos : 8;    // 最后一个位置
-                uint16_t entries : 8;     // 键值对个数
+                uint16_t entries : 8;
                 uint16_t max_entries : 8; // MSB
             };
         };
+        uint8_t sorted; // 有序部分的长度：records[0, sorted) 按 order 有序，之后是追加的无序尾部
+        uint8_t fingerprints[entry_count];
+        uint8_t order[order_size];
         // char buf[buf_size];
         entry records[entry_count];
 
@@ -1028,270 +1310,140 @@ namespace letree
         public:
             Iter() {}
 
-            Iter(const SortBuncket *bucket, uint64_t prefix_key, uint64_t start_key)
-                : cur_(bucket), prefix_key(prefix_key)
+            // 通过 VisitSorted_ 沿持久的排序下标从 start_key 开始访问，只给尾部排序，不重排整个节点
+            Iter(const UnSortBuncket *bucket, uint64_t prefix_key, key_type start_key)
+                : cur_(bucket), prefix_key(prefix_key), idx_(0), count_(0)
             {
-                if (unlikely(start_key <= prefix_key))
-                {
-                    idx_ = 0;
-                    return;
-                }
-                else
-                {
-                    bool find = false;
-                    idx_ = cur_->Find(start_key, find);
-                }
+                key_type lo = unlikely(start_key <= prefix_key) ? 0 : start_key;
+                cur_->template VisitSorted_<false>(lo, ~key_type(0), entry_count, [this](int i)
+                                                   { sorted_index_[count_++] = i; });
             }
 
-            Iter(const SortBuncket *bucket, uint64_t prefix_key)
-                : cur_(bucket), prefix_key(prefix_key)
+            Iter(const UnSortBuncket *bucket, uint64_t prefix_key)
+                : Iter(bucket, prefix_key, 0)
             {
-                idx_ = 0;
             }
 
-            ALWAYS_INLINE uint64_t key() const
+            ALWAYS_INLINE key_type key() const
             {
-                return cur_->key(idx_);
+                if (idx_ < count_)
+                    return cur_->key(sorted_index_[idx_]);
+                else
+                    return 0;
             }
 
-            ALWAYS_INLINE uint64_t value() const
+            ALWAYS_INLINE value_type value() const
             {
-                return cur_->value(idx_);
+                if (idx_ < count_)
+                    return cur_->value(sorted_index_[idx_]);
+                else
+                    return 0;
             }
 
             // return false if reachs end
             ALWAYS_INLINE bool next()
             {
-                idx_++;
-                while (cur_->key(idx_) == 0 && idx_ < cur_->last_pos)
-                {
-                    idx_++;
-                }
-                if (idx_ >= cur_->last_pos)
+                if (idx_ >= count_ - 1)
                 {
                     return false;
                 }
                 else
                 {
+                    idx_++;
                     return true;
                 }
             }
 
             ALWAYS_INLINE bool end() const
             {
-                return cur_ == nullptr ? true : (idx_ >= cur_->last_pos ? true : false);
+                return cur_ == nullptr ? true : (idx_ >= count_ ? true : false);
             }
 
             bool operator==(const Iter &iter) const { return idx_ == iter.idx_ && cur_ == iter.cur_; }
             bool operator!=(const Iter &iter) const { return idx_ != iter.idx_ || cur_ != iter.cur_; }
 
         private:
+            const UnSortBuncket *cur_;
             uint64_t prefix_key;
-            const SortBuncket *cur_;
-            int idx_; // current index in node
+            int idx_;   // current index in sorted_index_
+            int count_; // 从 start_key 开始的记录数
+            int sorted_index_[entry_count];
         };
     };
 
     template <const size_t bucket_size, const size_t value_size, const size_t key_size,
               const size_t max_entry_count>
-    status SortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        PutBufKV(uint64_t new_key, uint64_t value, int &data_index, bool flush)
+    status UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
+        PutBufKV(key_type new_key, value_type value, int &data_index, bool flush)
     {
-        if (entries >= max_entries)
+        if (data_index >= max_entries)
         {
             return status::Full;
         }
-        if (entries == 0)
-        { // this page is empty
-            records[0].key = new_key;
-            records[0].ptr = value;
-            records[1].ptr = 0;
-#ifndef USE_MEM
-            fence();
-#endif
-            return status::OK;
-        }
+        records[data_index].key = new_key;
+        records[data_index].ptr = value;
+        fingerprints[data_index] = Fingerprint_(new_key);
+        if (flush)
         {
-            if (last_pos >= max_entries - 1 && last_pos != entries)
-            {
-                for (int i = last_pos - 1; i >= 0; i--)
-                {
-                    if (key(i) == 0)
-                    {
-                        for (; i < last_pos; i++)
-                        {
-                            records[i].ptr = records[i + 1].ptr;
-                            records[i].key = records[i + 1].key;
-#ifndef USE_MEM
-                            if (!flush)
-                                continue;
-                            uint64_t records_ptr = (uint64_t)(&records[i]);
-                            int remainder = records_ptr % CACHE_LINE_SIZE;
-                            bool do_flush = (remainder == 0) ||
-                                            ((((int)(remainder + sizeof(entry)) / CACHE_LINE_SIZE) == 1) && ((remainder + sizeof(entry)) % CACHE_LINE_SIZE) != 0);
-                            if (do_flush)
-                            {
-                                clflush((char *)records_ptr);
-#ifdef TEST_PMEM_SIZE
-                                NVM::pmem_size += CACHE_LINE_SIZE;
-#endif
-                            }
-#endif
-                        }
-                        break;
-                    }
-                }
-                last_pos--;
-            }
-
-            int inserted = 0;
-            //                 if (entries < max_entries - 1)
-            //                 {
-            //                     records[entries + 1].ptr = records[i].ptr;
-            // #ifndef USE_MEM
-            //                     if ((uint64_t)pvalue(i + 1) % CACHE_LINE_SIZE == 0)
-            //                     {
-            //                         if (flush)
-            //                             clflush(pvalue(i + 1));
-            //                     }
-            // #endif
-            //                 }
-            for (int i = last_pos - 1; i >= 0; i--)
-            {
-                if (new_key < records[i].key)
-                {
-                    records[i + 1].ptr = records[i].ptr;
-                    records[i + 1].key = records[i].key;
-#ifndef USE_MEM
-                    if (!flush)
-                        continue;
-                    uint64_t records_ptr = (uint64_t)(&records[i + 1]);
-                    int remainder = records_ptr % CACHE_LINE_SIZE;
-                    bool do_flush = (remainder == 0) ||
-                                    ((((int)(remainder + sizeof(entry)) / CACHE_LINE_SIZE) == 1) && ((remainder + sizeof(entry)) % CACHE_LINE_SIZE) != 0);
-                    if (do_flush)
-                    {
-                        clflush((char *)records_ptr);
-#ifdef TEST_PMEM_SIZE
-                        NVM::pmem_size += CACHE_LINE_SIZE;
-#endif
-                    }
-#endif
-                }
-                else
-                {
-                    records[i + 1].ptr = records[i].ptr;
-                    records[i + 1].key = new_key;
-                    records[i + 1].ptr = value;
-#ifndef USE_MEM
-                    if (flush)
-                    {
-                        clflush((char *)&records[i + 1]);
-#ifdef TEST_PMEM_SIZE
-                        NVM::pmem_size += CACHE_LINE_SIZE;
-#endif
-                    }
-
-                    inserted = 1;
-#endif
-                    break;
-                }
-            }
-            if (inserted == 0)
-            {
-                records[0].key = new_key;
-                records[0].ptr = value;
-#ifndef USE_MEM
-                if (flush)
-                {
-                    clflush((char *)&records[0]);
-#ifdef TEST_PMEM_SIZE
-                    NVM::pmem_size += CACHE_LINE_SIZE;
-#endif
-                }
-
-#endif
-            }
+            FlushRange_(&records[data_index], entry_size);
+            if (!meta_in_header_line)
+                FlushRange_(&fingerprints[data_index], 1);
         }
-#ifndef USE_MEM
         fence();
-#endif
         return status::OK;
     }
 
-#ifdef USE_DELETE_0
     template <const size_t bucket_size, const size_t value_size, const size_t key_size,
               const size_t max_entry_count>
-    bool SortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        remove_key(uint64_t key, uint64_t *value)
+    bool UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
+        remove_key(key_type key, value_type *value, int idx)
     {
-        for (int i = 0; records[i].key != 0 && i < last_pos; ++i)
+        bool find = false;
+        int pos = Find(key, find);
+        if (find)
         {
-            if (records[i].key == key)
-            {
-                // simply set zero
-                records[i].key = 0;
-                records[i].ptr = 0;
+            EraseOrder_(pos, idx - 1);
+            if (pos == idx - 1)
                 return true;
-            }
-        }
-        return false;
-    }
-#else
-    template <const size_t bucket_size, const size_t value_size, const size_t key_size,
-              const size_t max_entry_count>
-    bool SortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        remove_key(uint64_t key, uint64_t *value)
-    {
-        bool shift = false;
-        int i;
-        for (i = 0; records[i].ptr != 0; ++i)
-        {
-            if (!shift && records[i].key == key)
+            else
             {
                 if (value)
-                    *value = records[i].ptr;
-                if (i != 0)
-                {
-                    records[i].ptr = records[i - 1].ptr;
-                }
-                shift = true;
-            }
-
-            if (shift)
-            {
-                records[i].key = records[i + 1].key;
-                records[i].ptr = records[i + 1].ptr;
-                uint64_t records_ptr = (uint64_t)(&records[i]);
-                int remainder = records_ptr % CACHE_LINE_SIZE;
-                bool do_flush = (remainder == 0) ||
-                                ((((int)(remainder + sizeof(entry)) / CACHE_LINE_SIZE) == 1) &&
-                                 ((remainder + sizeof(entry)) % CACHE_LINE_SIZE) != 0);
-                if (do_flush)
-                {
-                    clflush((char *)records_ptr);
-                }
+                    *value = records[pos].ptr;
+                records[pos].key = records[idx - 1].key;
+                records[pos].ptr = records[idx - 1].ptr;
+                fingerprints[pos] = fingerprints[idx - 1];
+                FlushMeta_(pos, 1);
+                return true;
             }
         }
-        return shift;
+        return false;
+    }
+
+    template <const size_t bucket_size, const size_t value_size, const size_t key_size,
+              const size_t max_entry_count>
+    int UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
+        getSortedIndex(int sorted_index[]) const
+    {
+        int n = 0;
+        return VisitSorted_<false>(0, ~key_type(0), entry_count, [&](int i)
+                                   { sorted_index[n++] = i; });
     }
-#endif
 
     template <const size_t bucket_size, const size_t value_size, const size_t key_size,
               const size_t max_entry_count>
-    SortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        SortBuncket(uint64_t key, uint64_t value, int prefix_len) : entries(0), last_pos(0), next_bucket(nullptr)
+    UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
+        UnSortBuncket(key_type key, value_type value, int prefix_len) : next_bucket(nullptr), entries(0), sorted(0)
     {
         next_bucket = nullptr;
-        max_entries = std::min(buf_size / (value_size + key_size), max_entry_count);
+        max_entries = std::min(entry_count, max_entry_count);
         // std::cout << "Max Entry size is:" <<  max_entries << std::endl;
         Put(nullptr, key, value);
     }
 
     template <const size_t bucket_size, const size_t value_size, const size_t key_size,
               const size_t max_entry_count>
-    status SortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        Load(uint64_t *keys, uint64_t *values, int count)
+    status UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
+        Load(key_type *keys, value_type *values, int count)
     {
         assert(entries == 0 && count < max_entries);
 
@@ -1300,99 +1452,115 @@ namespace letree
             assert(pvalue(target_idx) > pkey(target_idx));
             memcpy(pkey(target_idx), &keys[target_idx], key_size);
             memcpy(pvalue(target_idx), &values[count - target_idx - 1], value_size);
+            fingerprints[target_idx] = Fingerprint_(keys[target_idx]);
             entries++;
-            last_pos++;
         }
+        sorted = 0;
+        SortOrder_();
         NVM::Mem_persist(this, sizeof(*this));
         return status::OK;
     }
 
     template <const size_t bucket_size, const size_t value_size, const size_t key_size,
               const size_t max_entry_count>
-    status SortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        Expand_(CLevel::MemControl *mem, SortBuncket *&next, uint64_t &split_key, int &prefix_len)
+    status UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
+        Expand_(CLevel::MemControl *mem,
+                UnSortBuncket *&next, key_type &split_key, int &prefix_len)
     {
         // int expand_pos = entries / 2;
-
-        next = new (mem->Allocate<SortBuncket>()) SortBuncket(key(last_pos / 2), prefix_len);
-        // int idx = 0;
-        split_key = key(last_pos / 2);
-        prefix_len = 0;
+        int sorted_index_[entry_count];
+        // std::cout << "expand call getSortedIndex" << std::endl;
+        getSortedIndex(sorted_index_);
+        split_key = key(sorted_index_[entries / 2]);
+        // 搬走一半记录之后剩下的记录整体重新排序，搬的过程中不逐条维护排序下标
+        sorted = 0;
+        // std::cout << "entries:" << entries << std::endl;
+        //  for(int i = 0; i < entries; i++) {
+        //  std::cout << "key(" << i << "):" << key(i) << std::endl;
+        //  std::cout << "Sorted_index_[" << i << "]):" << sorted_index_[i] << std::endl;
+        // }
+        if (key(sorted_index_[0]) >= split_key)
+        {
+            std::cerr << "split_key_index" << entries / 2 << "split_key:" << (uint64_t)split_key << "fisrt key: " << (uint64_t)key(sorted_index_[0]) << std::endl;
+            std::cout << "split_key is not the middle key" << std::endl;
+        }
+        assert(key(sorted_index_[0]) < split_key);
+        next = new (mem->Allocate<UnSortBuncket>()) UnSortBuncket(split_key, prefix_len);
+        // next = new (NVM::data_alloc->alloc(sizeof(UnSortBuncket))) UnSortBuncket(split_key, prefix_len);
         int idx = 0;
-        int m = (int)ceil(last_pos / 2);
-        for (int i = m; i < last_pos; i++)
+        prefix_len = 0;
+        for (int i = entries / 2; i < entries; i++)
         {
             // next->Put(nullptr, key(i), value(i));
-            if (key(i) != 0)
-            {
-                next->PutBufKV(key(i), value(i), idx, false);
-                next->entries++;
-                next->last_pos++;
-            }
+            next->PutBufKV(key(sorted_index_[i]), value(sorted_index_[i]), idx, false);
+            idx++;
+            // next->entries++;
+            // clflush(&next->header);
         }
+        next->entries = entries - entries / 2;
+        // 搬过去的记录本来就按 key 排列
+        for (int i = 0; i < next->entries; i++)
+            next->SetOrder_(i, i);
+        next->sorted = next->entries;
         next->next_bucket = this->next_bucket;
         NVM::Mem_persist(next, sizeof(*next));
+        idx = entries;
+        for (int i = entries / 2; i < entries; i++)
+        {
+            // uint64_t *value_;
+            remove_key(key(sorted_index_[i]), nullptr, idx);
+            fence();
+            idx--;
 
-        records[m].ptr = 0;
-#ifndef USE_MEM
-        clflush(&records[last_pos / 2].ptr);
-#ifdef TEST_PMEM_SIZE
-        NVM::pmem_size += CACHE_LINE_SIZE;
-#endif
-#endif
+            // old
+            //  remove_key(key(sorted_index_[i]), nullptr,idx);
+            //  fence();
+            //  entries--;
+            // clflush(&header);
+        }
+        entries = entries / 2;
+        SortOrder_();
         this->next_bucket = next;
-#ifndef USE_MEM
-        fence();
-#endif
-        entries = entries - next->entries;
-        last_pos = m;
-#ifndef USE_MEM
-        clflush(&header);
-#ifdef TEST_PMEM_SIZE
-        NVM::pmem_size += CACHE_LINE_SIZE;
-#endif
         fence();
-#endif
+        NVM::Mem_persist(this, sizeof(*this));
         mem->expand_times++;
         return status::OK;
     }
 
     template <const size_t bucket_size, const size_t value_size, const size_t key_size,
               const size_t max_entry_count>
-    int SortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        Find(uint64_t target, bool &find) const
+    template <simd::Isa isa>
+    int UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
+        Find(key_type target, bool &find) const
     {
-        int left = 0;
-        int right = entries - 1;
-        while (left <= right)
+        // 一次比较所有指纹，只有指纹相同的记录才读出 key 比较
+        const uint8_t fp = Fingerprint_(target);
+        int count = std::min<int>(entries, entry_count);
+        for (int base = 0; base < count; base += 64)
         {
-            int middle = (left + right) / 2;
-            uint64_t mid_key = key(middle);
-            if (mid_key == target)
-            {
-                find = true;
-                return middle;
-            }
-            else if (mid_key > target)
-            {
-                right = middle - 1;
-            }
-            else
+            uint64_t mask = simd::MatchBytes<isa>(&fingerprints[base], fp, std::min(count - base, 64));
+            while (mask)
             {
-                left = middle + 1;
+                int i = base + __builtin_ctzll(mask);
+                if (key(i) == target)
+                {
+                    find = true;
+                    return i;
+                }
+                mask &= mask - 1;
             }
         }
         find = false;
-        return left;
+        return entries;
     }
 
     template <const size_t bucket_size, const size_t value_size, const size_t key_size,
               const size_t max_entry_count>
-    status SortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        Put(CLevel::MemControl *mem, uint64_t key, uint64_t value)
+    status UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
+        Put(CLevel::MemControl *mem, key_type key, value_type value)
     {
         status ret = status::OK;
-        int idx = 0;
+        int idx = entries;
         // Common::timers["CLevel_times"].start();
         ret = PutBufKV(key, value, idx);
         if (ret != status::OK)
@@ -1400,25 +1568,119 @@ namespace letree
             return ret;
         }
         entries++;
-        last_pos++;
-#ifndef USE_MEM
+        // 尾部攒到 max_tail 条时整体重新排序一次，读者需要排序的尾部不会更长
+        if (entries - sorted >= (int)max_tail && entries < max_entries)
+        {
+            SortOrder_();
+            if (!meta_in_header_line)
+                FlushRange_(order, OrderBytes_(entry_count));
+        }
         clflush(&header);
 #ifdef TEST_PMEM_SIZE
         NVM::pmem_size += CACHE_LINE_SIZE;
-#endif
 #endif
         // Common::timers["CLevel_times"].end();
         return status::OK;
     }
 
+    /**
+     * @brief 一次追加多个 KV，写入的记录每个 cache line 只 flush 一次，
+     * 所有记录持久化之后再修改 entries，和 Put 一样保证崩溃时不会看到未写完的记录
+     */
     template <const size_t bucket_size, const size_t value_size, const size_t key_size,
               const size_t max_entry_count>
-    status SortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        Update(CLevel::MemControl *mem, uint64_t key, uint64_t value)
+    int UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
+        PutBatch(const std::pair<key_type, value_type> kvs[], int count)
+    {
+        int n = std::min(count, (int)max_entries - (int)entries);
+        if (n <= 0)
+        {
+            return 0;
+        }
+        // 节点没有无序尾部、这一批升序且都大于已有的 key 时（批量加载），直接接在有序部分之后
+        bool extend = sorted == entries && (entries == 0 || kvs[0].first > SortedKey_(entries - 1, entries));
+        for (int i = 0; i < n; i++)
+        {
+            records[entries + i].key = kvs[i].first;
+            records[entries + i].ptr = kvs[i].second;
+            fingerprints[entries + i] = Fingerprint_(kvs[i].first);
+            extend = extend && (i == 0 || kvs[i].first > kvs[i - 1].first);
+        }
+        if (extend)
+        {
+            for (int i = 0; i < n; i++)
+                SetOrder_(entries + i, entries + i);
+        }
+        FlushRange_(&records[entries], n * entry_size);
+        FlushMeta_(entries, n);
+        fence();
+        if (extend)
+            sorted = entries + n;
+        entries += n;
+        clflush(&header);
+#ifdef TEST_PMEM_SIZE
+        NVM::pmem_size += CACHE_LINE_SIZE;
+#endif
+        return n;
+    }
+
+    template <const size_t bucket_size, const size_t value_size, const size_t key_size,
+              const size_t max_entry_count>
+    int UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
+        DeleteRange(key_type lo, key_type hi)
+    {
+        int n = 0;
+        int first_moved = entries;
+        int8_t moved_to[entry_count];
+        for (int i = 0; i < entries; i++)
+        {
+            moved_to[i] = -1;
+            if (records[i].key >= lo && records[i].key <= hi)
+                continue;
+            if (n != i)
+            {
+                records[n] = records[i];
+                fingerprints[n] = fingerprints[i];
+                first_moved = std::min(first_moved, n);
+            }
+            moved_to[i] = n++;
+        }
+        int removed = entries - n;
+        if (removed == 0)
+        {
+            return 0;
+        }
+        // 剩下的记录相对位置不变，有序部分仍在前面，按原来的排序下标取出留下的记录
+        int run = 0;
+        for (int r = 0; r < sorted; r++)
+        {
+            int to = moved_to[Order_(r)];
+            if (to >= 0)
+                SetOrder_(run++, to);
+        }
+        sorted = run;
+        // 先持久化移动过的记录，再修改 entries
+        if (first_moved < n)
+            FlushRange_(&records[first_moved], (n - first_moved) * entry_size);
+        FlushMeta_(first_moved, n - std::min(first_moved, n));
+        fence();
+        entries = n;
+        clflush(&header);
+#ifdef TEST_PMEM_SIZE
+        NVM::pmem_size += CACHE_LINE_SIZE;
+#endif
+        fence();
+        return removed;
+    }
+
+    template <const size_t bucket_size, const size_t value_size, const size_t key_size,
+              const size_t max_entry_count>
+    status UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
+        Update(CLevel::MemControl *mem, key_type key, value_type value)
     {
         bool find = false;
         int pos = Find(key, find);
-        if (!find || this->value(pos) == 0)
+        if (!find)
         {
             // Show();
             return status::NoExist;
@@ -1429,16 +1691,14 @@ namespace letree
 
     template <const size_t bucket_size, const size_t value_size, const size_t key_size,
               const size_t max_entry_count>
-    status SortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        Get(CLevel::MemControl *mem, uint64_t key, uint64_t &value) const
+    status UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
+        Get(CLevel::MemControl *mem, key_type key, value_type &value) const
     {
         bool find = false;
-        // int pos = Find(key, find);
-        int pos = LinearFind(key, find);
-        if (!find || this->value(pos) == 0)
+        int pos = Find(key, find);
+        if (!find)
         {
             // Show();
-            // assert(0);
             return status::NoExist;
         }
         value = this->value(pos);
@@ -1447,57 +1707,14 @@ namespace letree
 
     template <const size_t bucket_size, const size_t value_size, const size_t key_size,
               const size_t max_entry_count>
-    status SortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        Scan(CLevel::MemControl *mem, uint64_t start_key, int &len, std::vector<std::pair<uint64_t, uint64_t>> &results, bool if_first) const
+    status UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
+        Scan(CLevel::MemControl *mem, key_type start_key, int &len, std::vector<std::pair<key_type, value_type>> &results, bool if_first) const
     {
-        int pos = 0;
-        if (start_key != 0)
-        {
-            bool find = false;
-            // int pos = Find(key, find);
-            int pos = LinearFind(start_key, find);
-            if (!find || this->value(pos) == 0)
-            {
-                // Show();
-                // assert(0);
-                return status::NoExist;
-            }
-        }
-        for (; pos < this->last_pos && len > 0; ++pos)
-        {
-            if (this->key(pos) != 0)
-            {
-                results.push_back({this->key(pos), this->value(pos)});
-                --len;
-            }
-        }
-        if (this->next_bucket == nullptr)
-        {
-            if (len > 0)
-            {
-                return status::Failed;
-            }
-            return status::OK;
-        }
-        SortBuncket *next_ = this->next_bucket;
-        while (len > 0)
-        {
-            int i = 0;
-            for (; i < next_->last_pos && len > 0; i++)
-            {
-                if (next_->key(i) != 0)
-                {
-                    results.push_back({next_->key(i), next_->value(i)});
-                    --len;
-                }
-            }
-            if (next_->next_bucket == nullptr)
-            {
-                break;
-            }
-            next_ = next_->next_bucket;
-        }
-        // cout << "in entry:" << len << endl;
+        scan_buckets++;
+        // if_first 时从 start_key 开始，否则从节点的第一条记录开始；
+        // VisitSorted_ 在排序下标上二分找到起点，只给尾部排序，最多访问 len 条
+        len -= VisitSorted_<false>(if_first ? start_key : 0, ~key_type(0), len, [&](int i)
+                                   { results.push_back({this->key(i), this->value(i)}); });
         if (len > 0)
         {
             return status::Failed;
@@ -1507,558 +1724,706 @@ namespace letree
 
     template <const size_t bucket_size, const size_t value_size, const size_t key_size,
               const size_t max_entry_count>
-    status SortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        Delete(CLevel::MemControl *mem, uint64_t key, uint64_t *value)
+    status UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
+        Delete(CLevel::MemControl *mem, key_type key, value_type *value)
     {
-        auto ret = remove_key(key, value);
+        auto ret = remove_key(key, value, entries);
         if (!ret)
         {
             return status::NoExist;
         }
         fence();
         entries--;
-#ifndef USE_MEM
         clflush(&header);
 #ifdef TEST_PMEM_SIZE
         NVM::pmem_size += CACHE_LINE_SIZE;
 #endif
         fence();
-#endif
         return status::OK;
     }
 
-    template <const size_t bucket_size = 256, const size_t value_size = 8, const size_t key_size = 8,
-              const size_t max_entry_count = 64>
-    class __attribute__((aligned(64))) UnSortBuncket
+    /**
+     * @brief 有序 C 层节点，读和扫描多、插入少的区间使用（见 LayoutStats）。
+     * 记录紧密排列，起始位置按记录宽度对齐，一条记录不会跨 cache line。
+     * 前 run 条记录按 key 升序，之后是最多 max_tail 条按追加顺序排列的尾部（with_tail 为 false 时没有尾部）。
+     * 头部的 8 字节是记录条数、有序部分的长度和已删除记录的位图，一次写入即可持久化：
+     * 1. 查找先在有序部分上用 SIMD 比较（8 字节 key）或二分，找不到时再顺序比较尾部的几条记录；
+     * 2. 比所有 key 都大的 key 在尾部为空时追加到有序部分，其他 key 追加到尾部，插入只写一条记录和头部；
+     *    删除只在位图中标记，更新 value 原地写；
+     * 3. 尾部写满之后再插入，或节点满了但有已删除的记录时，Put 返回 Failed，
+     *    由 PointerBEntry 把尾部归并进有序部分、去掉已删除的记录，写一个新节点替换这个节点，分裂时同样整体重排。
+     * Visit 只需给尾部的几条记录排序再和有序部分归并。节点里没有可以重建的索引，RebuildIndex 为空
+     */
+    template <const size_t bucket_size = 256, const size_t value_size = 8, const size_t key_size = 8, const bool with_tail = true>
+    class __attribute__((aligned(64))) SortBuncket
     {
-        struct entry;
+    public:
+        typedef typename uint_of<key_size>::type key_type;
+        typedef typename uint_of<value_size>::type value_type;
 
-        ALWAYS_INLINE size_t maxEntrys(int idx) const
+        SortBuncket(key_type key, int prefix_len) : header(0)
         {
-            return max_entries;
         }
 
-        ALWAYS_INLINE void *pkey(int idx) const
+        // 节点最多容纳的记录数，Visit 的调用者据此在栈上准备缓冲区
+        static constexpr int Capacity()
         {
-            //   return (void*)&buf[idx*(value_size + key_size)];
-            return (void *)&records[idx].key;
+            return entry_count;
         }
 
-        ALWAYS_INLINE void *pvalue(int idx) const
+        // 无序尾部最多的记录数
+        static constexpr int TailCapacity()
         {
-            //   return (void*)&buf[idx*(value_size + key_size) + key_size];
-            return (void *)&records[idx].ptr;
+            return max_tail;
         }
 
-        status PutBufKV(uint64_t new_key, uint64_t value, int &data_index, bool flush = true);
-
-        bool remove_key(uint64_t key, uint64_t *value, int idx);
-
-        status SetValue(int pos, uint64_t value)
+        ALWAYS_INLINE key_type key(int idx) const
         {
-            memcpy(pvalue(pos), &value, value_size);
-            clflush(pvalue(pos));
-#ifdef TEST_PMEM_SIZE
-            NVM::pmem_size += CACHE_LINE_SIZE;
-#endif
-            fence();
-            return status::OK;
+            return records[idx].key;
         }
 
-        int getSortedIndex(int sorted_index[]) const;
-
-    public:
-        class Iter;
-
-        UnSortBuncket(uint64_t key, int prefix_len) : entries(0), next_bucket(nullptr)
+        ALWAYS_INLINE value_type value(int idx) const
         {
-            next_bucket = nullptr;
-            max_entries = std::min(buf_size / (value_size + key_size), max_entry_count);
-            // std::cout << "Max Entry size is:" <<  max_entries << std::endl;
+            return records[idx].ptr;
         }
 
-        explicit UnSortBuncket(uint64_t key, uint64_t value, int prefix_len);
-
-        ~UnSortBuncket()
-        {
+        /**
+         * @brief 查找 target，找到时返回它的下标；找不到时返回有序部分中第一个不小于 target 的位置
+         */
+        template <simd::Isa isa = simd::kIsa>
+        ALWAYS_INLINE int Find(key_type target, bool &find) const
+        {
+            int n = Count_();
+            int run = Run_(n);
+            int i = LowerBound_<isa>(target, run);
+            find = i < run && key(i) == target && !Deleted_(i);
+            if (find || !with_tail)
+                return i;
+            for (int j = run; j < TailEnd_(n, run); j++)
+            {
+                if (key(j) == target && !Deleted_(j))
+                {
+                    find = true;
+                    return j;
+                }
+            }
+            return i;
         }
 
-        status Load(uint64_t *keys, uint64_t *values, int count);
-
-        status Expand_(CLevel::MemControl *mem,
-                       UnSortBuncket *&next, uint64_t &split_key, int &prefix_len);
-
-        UnSortBuncket *Next()
+        ALWAYS_INLINE key_type min_key() const
         {
-            return next_bucket;
+            int n = Count_();
+            int run = Run_(n);
+            int min = -1;
+            for (int i = 0; i < run; i++)
+            {
+                if (!Deleted_(i))
+                {
+                    min = i;
+                    break;
+                }
+            }
+            for (int i = run; i < TailEnd_(n, run); i++)
+            {
+                if (!Deleted_(i) && (min < 0 || key(i) < key(min)))
+                    min = i;
+            }
+            return key(min < 0 ? 0 : min);
         }
 
-        int Find(uint64_t target, bool &find) const;
-
-        ALWAYS_INLINE uint64_t value(int idx) const
+        // 尾部写满，或节点写满但其中有已删除的记录时返回 Failed，由调用者重写节点；所有记录都有效且写满时返回 Full
+        status Put(CLevel::MemControl *mem, key_type key, value_type value)
         {
-            // the const bit mask will be generated during compile
-            return records[idx].ptr;
+            std::pair<key_type, value_type> kv(key, value);
+            if (PutBatch(&kv, 1) == 1)
+                return status::OK;
+            return EntryCount() == entry_count ? status::Full : status::Failed;
         }
 
-        ALWAYS_INLINE uint64_t key(int idx) const
-        {
-            return records[idx].key;
-        }
+        // 批量写入升序的一段，返回写入的个数，其余的 key 由调用者处理
+        int PutBatch(const std::pair<key_type, value_type> kvs[], int count);
 
-        ALWAYS_INLINE uint64_t min_key() const
+        // 在位图中标记 [lo, hi] 内的 key，返回删除的个数
+        int DeleteRange(key_type lo, key_type hi);
+
+        // 清空节点，整个节点被区间删除覆盖但不能释放时使用
+        void Clear()
         {
-            uint64_t min_key = key(0);
-            for (int i = 1; i < entries; i++)
-            {
-                if (key(i) < min_key)
-                {
-                    min_key = key(i);
-                }
-            }
-            return min_key;
+            header = 0;
+            clflush(&header);
+            fence();
         }
 
-        status Put(CLevel::MemControl *mem, uint64_t key, uint64_t value);
+        status Update(CLevel::MemControl *mem, key_type key, value_type value);
 
-        status Update(CLevel::MemControl *mem, uint64_t key, uint64_t value);
+        status Get(CLevel::MemControl *mem, key_type key, value_type &value) const
+        {
+            bool find;
+            int pos = Find(key, find);
+            if (!find)
+                return status::NoExist;
+            value = this->value(pos);
+            return status::OK;
+        }
 
-        status Get(CLevel::MemControl *mem, uint64_t key, uint64_t &value) const;
+        status Scan(CLevel::MemControl *mem, key_type start_key, int &len, std::vector<std::pair<key_type, value_type>> &results, bool if_first) const
+        {
+            // if_first 时从 start_key 开始，否则从节点的第一条记录开始
+            len -= Visit(if_first ? start_key : 0, ~key_type(0), len, [&results](key_type k, value_type v)
+                         { results.push_back({k, v}); });
+            return len > 0 ? status::Failed : status::OK;
+        }
 
-        status Scan(CLevel::MemControl *mem, uint64_t start_key, int &len, std::vector<std::pair<uint64_t, uint64_t>> &results, bool if_first) const;
+        /**
+         * @brief 把 [lo, hi] 内的记录按 key 顺序交给 visit(key, value)，最多 len 个，
+         * Reverse 为 true 时从大到小
+         * @return 访问的记录个数
+         */
+        template <bool Reverse = false, typename Visitor>
+        int Visit(key_type lo, key_type hi, int len, Visitor &&visit) const;
 
-        status Delete(CLevel::MemControl *mem, uint64_t key, uint64_t *value);
+        status Delete(CLevel::MemControl *mem, key_type key, value_type *value);
 
         void Show() const
         {
-            std::cout << entries << ", ";
-            // std::cout << "This: " << this << ", entry count: " << entries << std::endl;
-            // for (int i = 0; i < entries; i++)
-            // {
-            //     std::cout << "key: " << key(i) << ", value: " << value(i);
-            //     // std::cout << "key: " << key(i) << ", value: " << value(i) << std::endl;
-            // }
-            // std::cout << std::endl;
+            std::cout << EntryCount() << ", ";
         }
 
         uint64_t EntryCount() const
         {
-            return entries;
+            int n = Count_();
+            return n - __builtin_popcountll(deleted & simd::LowBits(n));
         }
 
-        void SetInvalid() {}
-        bool IsValid() { return false; }
+        void RebuildIndex()
+        {
+        }
 
     private:
-        // Frist 8 byte head
         struct entry
         {
-            uint64_t key;
-            uint64_t ptr;
+            key_type key;
+            value_type ptr;
         };
 
-        const static size_t buf_size = bucket_size - (8 + 8);
-        const static size_t entry_size = (key_size + value_size);
-        const static size_t entry_count = (buf_size / entry_size);
+        const static size_t header_size = 8;
+        const static size_t entry_size = key_size + value_size;
+        // 记录按自身宽度对齐（最多对齐到 cache line），写入一条记录只涉及一个 cache line
+        const static size_t records_offset = std::max(header_size, std::min<size_t>(entry_size, CACHE_LINE_SIZE));
+        // 位图有 48 位
+        const static size_t entry_count = std::min<size_t>((bucket_size - records_offset) / entry_size, 48);
+        // 尾部的长度上限，和 UnSortBuncket 的 max_tail 一样取节点的四分之一
+        const static size_t max_tail = with_tail ? std::max<size_t>(2, entry_count / 4) : 0;
+        static_assert(sizeof(entry) == entry_size, "records are packed");
 
-        UnSortBuncket *next_bucket;
-        union
+        // 并发读者可能读到正在被复用的节点，记录条数截断到容量之内，结果由调用者校验版本号
+        ALWAYS_INLINE int Count_() const
         {
-            uint32_t header;
-            struct
-            {
-                uint16_t entries : 8;
-                uint16_t max_entries : 8; // MSB
-            };
-        };
-        // char buf[buf_size];
-        entry records[entry_count];
+            return std::min<int>(entries, entry_count);
+        }
 
-    public:
-        class Iter
+        ALWAYS_INLINE int Run_(int n) const
         {
-        public:
-            Iter() {}
+            return std::min<int>(run, n);
+        }
 
-            Iter(const UnSortBuncket *bucket, uint64_t prefix_key, uint64_t start_key)
-                : cur_(bucket), prefix_key(prefix_key)
-            {
-                // std::cout << "iter call getSortedIndex" << std::endl;
-                cur_->getSortedIndex(sorted_index_);
-                if (unlikely(start_key <= prefix_key))
-                {
-                    idx_ = 0;
-                    return;
-                }
-                else
-                {
-                    for (int i = 0; i < cur_->entries; i++)
-                    {
-                        if (cur_->key(sorted_index_[i]) >= start_key)
-                        {
-                            idx_ = i;
-                            return;
-                        }
-                    }
-                    idx_ = cur_->entries;
-                    return;
-                }
-            }
+        // 尾部的结束位置，同样截断到 max_tail 之内
+        ALWAYS_INLINE int TailEnd_(int n, int run) const
+        {
+            return std::min<int>(n, run + max_tail);
+        }
 
-            Iter(const UnSortBuncket *bucket, uint64_t prefix_key)
-                : cur_(bucket), prefix_key(prefix_key)
-            {
-                // std::cout << "iter2 call getSortedIndex" << std::endl;
-                cur_->getSortedIndex(sorted_index_);
-                idx_ = 0;
-            }
+        ALWAYS_INLINE bool Deleted_(int i) const
+        {
+            return (deleted >> i) & 1;
+        }
 
-            ALWAYS_INLINE uint64_t key() const
+        // 有序部分的 run 条记录中第一个不小于 target 的位置，已删除的记录仍然有序，一起参与查找
+        template <simd::Isa isa = simd::kIsa>
+        ALWAYS_INLINE int LowerBound_(key_type target, int run) const
+        {
+            if constexpr (key_size == 8 && entry_size == 16)
             {
-                if (idx_ < cur_->entries)
-                    return cur_->key(sorted_index_[idx_]);
-                else
-                    return 0;
+                return simd::FirstGreater<entry_size, false, isa>(&records[0].key, target, run);
             }
-
-            ALWAYS_INLINE uint64_t value() const
+            int lo = 0, hi = run;
+            while (lo < hi)
             {
-                if (idx_ < cur_->entries)
-                    return cur_->value(sorted_index_[idx_]);
+                int mid = (lo + hi) / 2;
+                if (key(mid) < target)
+                    lo = mid + 1;
                 else
-                    return 0;
+                    hi = mid;
             }
+            return lo;
+        }
 
-            // return false if reachs end
-            ALWAYS_INLINE bool next()
-            {
-                if (idx_ >= cur_->entries - 1)
-                {
-                    return false;
-                }
-                else
-                {
-                    idx_++;
-                    return true;
-                }
-            }
+        // 修改后的头部一次写入并持久化
+        void SetHeader_(uint64_t h)
+        {
+            fence();
+            header = h;
+            clflush(&header);
+#ifdef TEST_PMEM_SIZE
+            NVM::pmem_size += CACHE_LINE_SIZE;
+#endif
+            fence();
+        }
 
-            ALWAYS_INLINE bool end() const
+        union
+        {
+            uint64_t header;
+            struct
             {
-                return cur_ == nullptr ? true : (idx_ >= cur_->entries ? true : false);
-            }
-
-            bool operator==(const Iter &iter) const { return idx_ == iter.idx_ && cur_ == iter.cur_; }
-            bool operator!=(const Iter &iter) const { return idx_ != iter.idx_ || cur_ != iter.cur_; }
-
-        private:
-            uint64_t prefix_key;
-            const UnSortBuncket *cur_;
-            int idx_; // current index in sorted_index_
-            int sorted_index_[16];
+                uint64_t entries : 8;  // 记录条数，包括尾部和已删除的
+                uint64_t run : 8;      // 有序部分的长度
+                uint64_t deleted : 48; // 已删除的记录
+            };
+        };
+        union
+        {
+            alignas(records_offset) entry records[entry_count];
+            char space_[bucket_size - records_offset]; // 大节点中 48 条记录之后留空，和 UnSortBuncket 一样大，共用空闲链表
         };
     };
 
-    template <const size_t bucket_size, const size_t value_size, const size_t key_size,
-              const size_t max_entry_count>
-    status UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        PutBufKV(uint64_t new_key, uint64_t value, int &data_index, bool flush)
+    template <const size_t bucket_size, const size_t value_size, const size_t key_size, const bool with_tail>
+    int SortBuncket<bucket_size, value_size, key_size, with_tail>::
+        PutBatch(const std::pair<key_type, value_type> kvs[], int count)
     {
-        if (data_index >= max_entries)
+        int n = entries;
+        int new_run = run;
+        int put = 0;
+        // 尾部为空时，比已有 key 都大的一段直接延长有序部分
+        if (new_run == n)
         {
-            return status::Full;
+            while (put < count && n + put < (int)entry_count &&
+                   (n + put == 0 || kvs[put].first > (put == 0 ? key(n - 1) : kvs[put - 1].first)))
+            {
+                records[n + put].key = kvs[put].first;
+                records[n + put].ptr = kvs[put].second;
+                put++;
+            }
+            new_run = n + put;
         }
-        records[data_index].key = new_key;
-        records[data_index].ptr = value;
-        if (flush)
+        while (put < count && n + put < (int)entry_count && n + put - new_run < (int)max_tail)
         {
-            clflush((char *)&records[data_index]);
-#ifdef TEST_PMEM_SIZE
-            NVM::pmem_size += CACHE_LINE_SIZE;
-#endif
+            records[n + put].key = kvs[put].first;
+            records[n + put].ptr = kvs[put].second;
+            put++;
         }
-        fence();
-        return status::OK;
+        if (put == 0)
+        {
+            return 0;
+        }
+        NVM::Mem_persist(&records[n], put * entry_size);
+        // 位图中 entries 之后的位总是 0
+        SetHeader_((header & ~0xffffUL) | (uint64_t)(n + put) | ((uint64_t)new_run << 8));
+        return put;
     }
 
-    template <const size_t bucket_size, const size_t value_size, const size_t key_size,
-              const size_t max_entry_count>
-    bool UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        remove_key(uint64_t key, uint64_t *value, int idx)
+    template <const size_t bucket_size, const size_t value_size, const size_t key_size, const bool with_tail>
+    template <bool Reverse, typename Visitor>
+    int SortBuncket<bucket_size, value_size, key_size, with_tail>::
+        Visit(key_type lo, key_type hi, int len, Visitor &&visit) const
     {
-        bool find = false;
-        int pos = Find(key, find);
-        if (find)
+        scan_buckets++;
+        int n = Count_();
+        int run = Run_(n);
+        // 尾部在 [lo, hi] 内的记录在栈上插入排序，再和有序部分归并，和 UnSortBuncket 的 VisitSorted_ 相同
+        uint8_t tail[max_tail + 1];
+        int t = 0;
+        for (int i = run; i < TailEnd_(n, run); i++)
+        {
+            key_type k = key(i);
+            if (Deleted_(i) || k < lo || k > hi)
+                continue;
+            int j = t++;
+            for (; j > 0 && (Reverse ? key(tail[j - 1]) < k : key(tail[j - 1]) > k); j--)
+                tail[j] = tail[j - 1];
+            tail[j] = i;
+        }
+        const int step = Reverse ? -1 : 1;
+        const int r_end = Reverse ? -1 : run;
+        int r;
+        if (Reverse)
+            r = (hi == ~key_type(0) ? run : LowerBound_(hi + 1, run)) - 1;
+        else
+            r = lo == 0 ? 0 : LowerBound_(lo, run);
+        int visited = 0, j = 0;
+        while (visited < len)
         {
-            if (pos == idx - 1)
-                return true;
+            int i = -1;
+            if (r != r_end)
+            {
+                i = r;
+                if (Reverse ? key(i) < lo : key(i) > hi)
+                {
+                    r = r_end;
+                    i = -1;
+                }
+            }
+            if (j < t && (i < 0 || (Reverse ? key(tail[j]) > key(i) : key(tail[j]) < key(i))))
+                i = tail[j++];
+            else if (i >= 0)
+                r += step;
             else
+                break;
+            if (!Deleted_(i))
             {
-                if (value)
-                    *value = records[pos].ptr;
-                records[pos].key = records[idx - 1].key;
-                records[pos].ptr = records[idx - 1].ptr;
-                return true;
+                visit(key(i), value(i));
+                visited++;
             }
         }
-        return false;
+        return visited;
     }
 
-    template <const size_t bucket_size, const size_t value_size, const size_t key_size,
-              const size_t max_entry_count>
-    int UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        getSortedIndex(int sorted_index[]) const
+    template <const size_t bucket_size, const size_t value_size, const size_t key_size, const bool with_tail>
+    int SortBuncket<bucket_size, value_size, key_size, with_tail>::
+        DeleteRange(key_type lo, key_type hi)
     {
-        uint64_t keys[entries];
-        for (int i = 0; i < entries; ++i)
+        int n = entries;
+        int run = this->run;
+        uint64_t mask = 0;
+        for (int i = LowerBound_(lo, run); i < run && key(i) <= hi; i++)
+            mask |= 1UL << i;
+        for (int i = run; i < n; i++)
         {
-            keys[i] = key(i); // prefix does not matter
-            sorted_index[i] = i;
+            if (key(i) >= lo && key(i) <= hi)
+                mask |= 1UL << i;
         }
-        std::sort(&sorted_index[0], &sorted_index[entries],
-                  [&keys](uint64_t a, uint64_t b)
-                  { return keys[a] < keys[b]; });
-        return entries;
+        mask &= ~(uint64_t)deleted;
+        if (mask == 0)
+        {
+            return 0;
+        }
+        SetHeader_(header | (mask << 16));
+        return __builtin_popcountll(mask);
     }
 
-    template <const size_t bucket_size, const size_t value_size, const size_t key_size,
-              const size_t max_entry_count>
-    UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        UnSortBuncket(uint64_t key, uint64_t value, int prefix_len) : entries(0), next_bucket(nullptr)
+    template <const size_t bucket_size, const size_t value_size, const size_t key_size, const bool with_tail>
+    status SortBuncket<bucket_size, value_size, key_size, with_tail>::
+        Update(CLevel::MemControl *mem, key_type key, value_type value)
     {
-        next_bucket = nullptr;
-        max_entries = std::min(buf_size / (value_size + key_size), max_entry_count);
-        // std::cout << "Max Entry size is:" <<  max_entries << std::endl;
-        Put(nullptr, key, value);
+        bool find;
+        int pos = Find(key, find);
+        if (!find)
+        {
+            return status::NoExist;
+        }
+        records[pos].ptr = value;
+        NVM::Mem_persist(&records[pos].ptr, value_size);
+        return status::OK;
     }
 
-    template <const size_t bucket_size, const size_t value_size, const size_t key_size,
-              const size_t max_entry_count>
-    status UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        Load(uint64_t *keys, uint64_t *values, int count)
+    template <const size_t bucket_size, const size_t value_size, const size_t key_size, const bool with_tail>
+    status SortBuncket<bucket_size, value_size, key_size, with_tail>::
+        Delete(CLevel::MemControl *mem, key_type key, value_type *value)
     {
-        assert(entries == 0 && count < max_entries);
-
-        for (int target_idx = 0; target_idx < count; target_idx++)
+        bool find;
+        int pos = Find(key, find);
+        if (!find)
         {
-            assert(pvalue(target_idx) > pkey(target_idx));
-            memcpy(pkey(target_idx), &keys[target_idx], key_size);
-            memcpy(pvalue(target_idx), &values[count - target_idx - 1], value_size);
-            entries++;
+            return status::NoExist;
         }
-        NVM::Mem_persist(this, sizeof(*this));
+        if (value)
+            *value = this->value(pos);
+        SetHeader_(header | (1UL << (pos + 16)));
         return status::OK;
     }
 
-    template <const size_t bucket_size, const size_t value_size, const size_t key_size,
-              const size_t max_entry_count>
-    status UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        Expand_(CLevel::MemControl *mem,
-                UnSortBuncket *&next, uint64_t &split_key, int &prefix_len)
+    // C 层节点的访问计数表，定义在 enviroment.cc，见 LayoutStats。高 16 位是表的槽数的对数，低 48 位是表的地址
+    extern std::atomic<uint64_t> layout_table;
+
+    /**
+     * @brief C 层节点被读、插入和扫描的次数，按节点地址散列到 DRAM 中的表里，不写 PM 也不加锁，
+     * 并发时丢掉几次计数、不同节点落到同一个槽都只影响布局的选择。
+     * 点查每个线程每 read_sample 次才记一次，热点节点的读者大多不写这张表，乐观读仍然不写共享内存。
+     * 表的槽数随 C 层节点个数增长（Reserve），每个节点大约一个槽；
+     * 某个计数满了时三个计数一起减半，较早的访问逐渐不再起作用。
+     * 节点分裂时按它的计数为分出的两个节点选择布局（PreferSorted），新节点的计数清零
+     */
+    class LayoutStats
     {
-        // int expand_pos = entries / 2;
-        int sorted_index_[entry_count];
-        // std::cout << "expand call getSortedIndex" << std::endl;
-        getSortedIndex(sorted_index_);
-        split_key = key(sorted_index_[entries / 2]);
-        // std::cout << "entries:" << entries << std::endl;
-        //  for(int i = 0; i < entries; i++) {
-        //  std::cout << "key(" << i << "):" << key(i) << std::endl;
-        //  std::cout << "Sorted_index_[" << i << "]):" << sorted_index_[i] << std::endl;
-        // }
-        if (key(sorted_index_[0]) >= split_key)
+    public:
+        enum Op
         {
-            std::cerr << "split_key_index" << entries / 2 << "split_key:" << split_key << "fisrt key: " << key(sorted_index_[0]) << std::endl;
-            std::cout << "split_key is not the middle key" << std::endl;
+            Read,
+            Insert,
+            Scan,
+        };
+
+        static const int min_slot_bits = 13;
+        static const int read_sample = 16;
+
+        ALWAYS_INLINE static void Note(const void *node, Op op)
+        {
+            if (op == Read)
+            {
+                static thread_local int countdown = read_sample;
+                if (--countdown != 0)
+                    return;
+                countdown = read_sample;
+            }
+            std::atomic<uint64_t> &slot = Slot_(node);
+            uint64_t v = slot.load(std::memory_order_relaxed);
+            if (((v >> (op * bits)) & max_count) == max_count)
+                v = (v >> 1) & halve_mask;
+            slot.store(v + (1UL << (op * bits)), std::memory_order_relaxed);
         }
-        assert(key(sorted_index_[0]) < split_key);
-        next = new (mem->Allocate<UnSortBuncket>()) UnSortBuncket(split_key, prefix_len);
-        // next = new (NVM::data_alloc->alloc(sizeof(UnSortBuncket))) UnSortBuncket(split_key, prefix_len);
-        int idx = 0;
-        prefix_len = 0;
-        for (int i = entries / 2; i < entries; i++)
+
+        static void Reset(const void *node)
         {
-            // next->Put(nullptr, key(i), value(i));
-            next->PutBufKV(key(sorted_index_[i]), value(sorted_index_[i]), idx, false);
-            idx++;
-            // next->entries++;
-            // clflush(&next->header);
+            Slot_(node).store(0, std::memory_order_relaxed);
         }
-        next->entries = entries - entries / 2;
-        next->next_bucket = this->next_bucket;
-        NVM::Mem_persist(next, sizeof(*next));
-        idx = entries;
-        for (int i = entries / 2; i < entries; i++)
+
+        // 节点被替换成新节点时计数跟着搬过去
+        static void Move(const void *from, const void *to)
         {
-            // uint64_t *value_;
-            remove_key(key(sorted_index_[i]), nullptr, idx);
-            fence();
-            idx--;
+            Slot_(to).store(Slot_(from).load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
 
-            // old
-            //  remove_key(key(sorted_index_[i]), nullptr,idx);
-            //  fence();
-            //  entries--;
-            // clflush(&header);
+        /**
+         * @brief 按 C 层节点个数扩大计数表，分裂时调用。表只会翻倍增长，换表时计数清零；
+         * 旧表不释放，并发的 Note 可能还在使用，所有旧表加起来不超过当前的表
+         */
+        static void Reserve(size_t nodes)
+        {
+            uint64_t old = layout_table.load(std::memory_order_acquire);
+            int slot_bits = old >> 48;
+            if ((nodes >> slot_bits) == 0)
+                return;
+            while ((nodes >> slot_bits) != 0)
+                slot_bits++;
+            std::atomic<uint64_t> *table = new std::atomic<uint64_t>[1UL << slot_bits]();
+            if (!layout_table.compare_exchange_strong(old, ((uint64_t)slot_bits << 48) | (uint64_t)table,
+                                                      std::memory_order_acq_rel))
+                delete[] table;
         }
-        entries = entries / 2;
-        this->next_bucket = next;
-        fence();
-        NVM::Mem_persist(this, sizeof(*this));
-        mem->expand_times++;
-        return status::OK;
-    }
 
-    template <const size_t bucket_size, const size_t value_size, const size_t key_size,
-              const size_t max_entry_count>
-    int UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        Find(uint64_t target, bool &find) const
-    {
-        for (int i = 0; i < entries; i++)
+        /**
+         * @brief 有序节点每次扫描省下的代价超过每次插入（尾部写满时写一个新节点）和点查（不能只比较指纹）多出的代价时使用有序布局，
+         * 权重按 search_bench 中两种节点的 visit 和查找周期数，以及插入时多写的 cache line 数估计
+         */
+        static bool PreferSorted(const void *node)
         {
-            if (key(i) == target)
-            {
-                find = true;
-                return i;
-            }
+            uint64_t v = Slot_(node).load(std::memory_order_relaxed);
+            uint64_t reads = v & max_count, inserts = (v >> bits) & max_count, scans = v >> (2 * bits);
+            return scans * scan_gain > inserts * insert_cost + reads * read_sample * read_cost;
         }
-        find = false;
-        return entries;
-    }
 
-    template <const size_t bucket_size, const size_t value_size, const size_t key_size,
-              const size_t max_entry_count>
-    status UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        Put(CLevel::MemControl *mem, uint64_t key, uint64_t value)
+    private:
+        static const int bits = 21;
+        static const uint64_t max_count = (1UL << bits) - 1;
+        static const uint64_t halve_mask = (max_count >> 1) * (1 | (1UL << bits) | (1UL << (2 * bits)));
+        // 256 字节节点上测得：visit 在尾部为空时少约 160 周期，尾部写满时和无序节点相当，取平均；
+        // 命中查找多约 35 周期；写时复制插入约 700 周期，有 3 条记录的尾部时每 4 次插入中间才重写一次节点
+        static const uint64_t scan_gain = 100;
+        static const uint64_t insert_cost = 200;
+        static const uint64_t read_cost = 35;
+
+        ALWAYS_INLINE static std::atomic<uint64_t> &Slot_(const void *node)
+        {
+            uint64_t t = layout_table.load(std::memory_order_acquire);
+            std::atomic<uint64_t> *table = (std::atomic<uint64_t> *)(t & ((1UL << 48) - 1));
+            return table[(((uintptr_t)node >> 6) * 0x9e3779b97f4a7c15UL) >> (64 - (t >> 48))];
+        }
+    };
+
+    /**
+     * @brief C 层节点的句柄，按 eentry 记录的布局把操作分派到 UnSortBuncket 或 SortBuncket，用法和节点指针相同。
+     * 两种节点一样大，共用 MemControl 的同一个空闲链表；sorted_t 和 unsorted_t 相同时只有一种布局，分派在编译期去掉。
+     * Get、Visit 和插入顺便记入 LayoutStats
+     */
+    template <typename unsorted_t, typename sorted_t>
+    class BuncketRef
     {
-        status ret = status::OK;
-        int idx = entries;
-        // Common::timers["CLevel_times"].start();
-        ret = PutBufKV(key, value, idx);
-        if (ret != status::OK)
+    public:
+        typedef typename unsorted_t::key_type key_type;
+        typedef typename unsorted_t::value_type value_type;
+
+        static constexpr bool adaptive = !std::is_same<unsorted_t, sorted_t>::value;
+        static_assert(sizeof(sorted_t) == sizeof(unsorted_t), "both layouts share one free list");
+
+        BuncketRef() : node_(nullptr), sorted_(false) {}
+
+        BuncketRef(void *node, bool sorted) : node_(node), sorted_(adaptive && sorted) {}
+
+        // 分配一个给定布局的空节点
+        static BuncketRef Create(CLevel::MemControl *mem, key_type key, bool sorted)
         {
-            return ret;
+            void *node;
+            if (adaptive && sorted)
+                node = new (mem->Allocate<sorted_t>()) sorted_t(key, 0);
+            else
+                node = new (mem->Allocate<unsorted_t>()) unsorted_t(key, 0);
+            LayoutStats::Reset(node);
+            return BuncketRef(node, sorted);
+        }
+
+        void Free(CLevel::MemControl *mem) const
+        {
+            mem->Free((unsorted_t *)node_);
+        }
+
+        // 两种布局中较大的容量
+        static constexpr int Capacity()
+        {
+            return std::max(unsorted_t::Capacity(), sorted_t::Capacity());
+        }
+
+        static constexpr int Capacity(bool sorted)
+        {
+            return adaptive && sorted ? sorted_t::Capacity() : unsorted_t::Capacity();
+        }
+
+        ALWAYS_INLINE void *address() const
+        {
+            return node_;
+        }
+
+        ALWAYS_INLINE bool sorted() const
+        {
+            return sorted_;
+        }
+
+        explicit operator bool() const
+        {
+            return node_ != nullptr;
+        }
+
+        ALWAYS_INLINE const BuncketRef *operator->() const
+        {
+            return this;
+        }
+
+        status Get(CLevel::MemControl *mem, key_type key, value_type &value) const
+        {
+            Note_(LayoutStats::Read);
+            return Dispatch_([&](auto *node)
+                             { return node->Get(mem, key, value); });
+        }
+
+        template <bool Reverse = false, typename Visitor>
+        int Visit(key_type lo, key_type hi, int len, Visitor &&visit) const
+        {
+            Note_(LayoutStats::Scan);
+            return Dispatch_([&](auto *node)
+                             { return node->template Visit<Reverse>(lo, hi, len, visit); });
+        }
+
+        // 按 key 顺序取出所有记录，返回个数，改变布局或重写节点时使用，不计入 LayoutStats
+        int Records(std::pair<key_type, value_type> out[]) const
+        {
+            int n = 0;
+            Dispatch_([&](auto *node)
+                      { return node->Visit(0, ~key_type(0), Capacity(), [&](key_type k, value_type v)
+                                           { out[n++] = {k, v}; }); });
+            return n;
+        }
+
+        status Put(CLevel::MemControl *mem, key_type key, value_type value) const
+        {
+            Note_(LayoutStats::Insert);
+            return Dispatch_([&](auto *node)
+                             { return node->Put(mem, key, value); });
+        }
+
+        int PutBatch(const std::pair<key_type, value_type> kvs[], int count) const
+        {
+            Note_(LayoutStats::Insert);
+            return Fill(kvs, count);
+        }
+
+        // 写入新建的节点，kvs 升序，不计入 LayoutStats
+        int Fill(const std::pair<key_type, value_type> kvs[], int count) const
+        {
+            return Dispatch_([&](auto *node)
+                             { return node->PutBatch(kvs, count); });
+        }
+
+        status Update(CLevel::MemControl *mem, key_type key, value_type value) const
+        {
+            return Dispatch_([&](auto *node)
+                             { return node->Update(mem, key, value); });
+        }
+
+        status Delete(CLevel::MemControl *mem, key_type key, value_type *value) const
+        {
+            return Dispatch_([&](auto *node)
+                             { return node->Delete(mem, key, value); });
+        }
+
+        int DeleteRange(key_type lo, key_type hi) const
+        {
+            return Dispatch_([&](auto *node)
+                             { return node->DeleteRange(lo, hi); });
+        }
+
+        status Scan(CLevel::MemControl *mem, key_type start_key, int &len, std::vector<std::pair<key_type, value_type>> &results, bool if_first) const
+        {
+            return Dispatch_([&](auto *node)
+                             { return node->Scan(mem, start_key, len, results, if_first); });
         }
-        entries++;
-        clflush(&header);
-#ifdef TEST_PMEM_SIZE
-        NVM::pmem_size += CACHE_LINE_SIZE;
-#endif
-        // Common::timers["CLevel_times"].end();
-        return status::OK;
-    }
 
-    template <const size_t bucket_size, const size_t value_size, const size_t key_size,
-              const size_t max_entry_count>
-    status UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        Update(CLevel::MemControl *mem, uint64_t key, uint64_t value)
-    {
-        bool find = false;
-        int pos = Find(key, find);
-        if (!find)
+        void Clear() const
         {
-            // Show();
-            return status::NoExist;
+            Dispatch_([](auto *node)
+                      { node->Clear(); });
         }
-        SetValue(pos, value);
-        return status::OK;
-    }
 
-    template <const size_t bucket_size, const size_t value_size, const size_t key_size,
-              const size_t max_entry_count>
-    status UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        Get(CLevel::MemControl *mem, uint64_t key, uint64_t &value) const
-    {
-        bool find = false;
-        int pos = Find(key, find);
-        if (!find)
+        key_type min_key() const
         {
-            // Show();
-            return status::NoExist;
+            return Dispatch_([](auto *node)
+                             { return node->min_key(); });
         }
-        value = this->value(pos);
-        return status::OK;
-    }
 
-    extern uint64_t scan_buckets;
+        uint64_t EntryCount() const
+        {
+            return Dispatch_([](auto *node)
+                             { return node->EntryCount(); });
+        }
 
-    template <const size_t bucket_size, const size_t value_size, const size_t key_size,
-              const size_t max_entry_count>
-    status UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        Scan(CLevel::MemControl *mem, uint64_t start_key, int &len, std::vector<std::pair<uint64_t, uint64_t>> &results, bool if_first) const
-    {
-        scan_buckets++;
-        if (if_first)
+        void RebuildIndex() const
         {
-            // scan from start_key;
-            int sorted_index_[entries];
-            getSortedIndex(sorted_index_);
-            for (int i = sorted_index_[0]; i < entries && len > 0; i++)
-            {
-                if (this->key(sorted_index_[i]) >= start_key)
-                {
-                    results.push_back({this->key(sorted_index_[i]), this->value(sorted_index_[i])});
-                    --len;
-                }
-            }
+            Dispatch_([](auto *node)
+                      { node->RebuildIndex(); });
         }
-        else
+
+        void Show() const
         {
-            int pos = 0;
-            if (len >= this->entries - pos)
-            {
-                for (; pos < this->entries; pos++)
-                {
-                    results.push_back({this->key(pos), this->value(pos)});
-                    --len;
-                }
-            }
-            else
-            {
-                int sorted_index_[entries];
-                getSortedIndex(sorted_index_);
-                while (len > 0)
-                {
-                    results.push_back({this->key(pos), this->value(pos)});
-                    --len;
-                }
-            }
+            Dispatch_([](auto *node)
+                      { node->Show(); });
         }
-        if (len > 0)
+
+    private:
+        template <typename Fn>
+        ALWAYS_INLINE decltype(auto) Dispatch_(Fn &&fn) const
         {
-            return status::Failed;
+            if constexpr (adaptive)
+            {
+                if (sorted_)
+                    return fn((sorted_t *)node_);
+            }
+            return fn((unsorted_t *)node_);
         }
-        return status::OK;
-    }
 
-    template <const size_t bucket_size, const size_t value_size, const size_t key_size,
-              const size_t max_entry_count>
-    status UnSortBuncket<bucket_size, value_size, key_size, max_entry_count>::
-        Delete(CLevel::MemControl *mem, uint64_t key, uint64_t *value)
-    {
-        auto ret = remove_key(key, value, entries);
-        if (!ret)
+        ALWAYS_INLINE void Note_(LayoutStats::Op op) const
         {
-            return status::NoExist;
+            if constexpr (adaptive)
+                LayoutStats::Note(node_, op);
         }
-        fence();
-        entries--;
-        clflush(&header);
-#ifdef TEST_PMEM_SIZE
-        NVM::pmem_size += CACHE_LINE_SIZE;
-#endif
-        fence();
-        return status::OK;
-    }
+
+        void *node_;
+        bool sorted_;
+    };
 
     // typedef Buncket<256, 8> buncket_t;
     // typedef SortBuncket<256, 8> buncket_t;
-    typedef UnSortBuncket<UBUCKET_SIZE, 8> buncket_t;
     // c层节点的定义， C层节点需支持Put，Get，Update，Delete
     // C层节点内部需要实现一个Iter作为迭代器，
 
-    static_assert(sizeof(buncket_t) == UBUCKET_SIZE);
-
+    template <typename buncket_t>
     class __attribute__((packed)) BuncketPointer
     {
 
@@ -2069,7 +2434,7 @@ namespace letree
 
         ALWAYS_INLINE bool HasSetup() const { return !(pointer_[0] & 1); };
 
-        void Setup(CLevel::MemControl *mem, uint64_t key, int prefix_len)
+        void Setup(CLevel::MemControl *mem, typename buncket_t::key_type key, int prefix_len)
         {
             //        buncket_t *buncket = new (NVM::data_alloc->alloc(sizeof(buncket_t))) buncket_t(key, prefix_len);
             buncket_t *buncket = new (mem->Allocate<buncket_t>()) buncket_t(key, prefix_len);
@@ -2077,7 +2442,7 @@ namespace letree
             memcpy(pointer_, &pointer, sizeof(pointer_));
         }
 
-        void Setup(CLevel::MemControl *mem, buncket_t *buncket, uint64_t key, int prefix_len)
+        void Setup(CLevel::MemControl *mem, void *buncket, typename buncket_t::key_type key, int prefix_len)
         {
             uint64_t pointer = (uint64_t)(buncket)-mem->BaseAddr();
             memcpy(pointer_, &pointer, sizeof(pointer_));
@@ -2094,10 +2459,11 @@ namespace letree
      * @ BuncketPointer C层节点指针的封装，仿照Combotree以6bit的偏移代替8字节的指针
      */
 
-    struct eentry
+    template <typename Key, typename buncket_t>
+    struct basic_eentry
     {
-        uint64_t entry_key;
-        BuncketPointer pointer; // 6B指针
+        Key entry_key;
+        BuncketPointer<buncket_t> pointer; // 6B指针
         union
         {
             uint16_t meta;
@@ -2105,26 +2471,51 @@ namespace letree
             {
                 uint16_t prefix_bytes : 4; // LSB
                 uint16_t suffix_bytes : 4;
-                uint16_t entries : 4;
-                uint16_t max_entries : 4; // MSB
+                uint16_t entries : 4;     // entrys[0] 的 entries 和 max_entries 合起来是 PointerBEntry::buf.entries，
+                uint16_t max_entries : 3; // 节点个数只通过 PointerBEntry::buf.entries 读写，fanout 可以超过 15
+                uint16_t sorted : 1; // MSB，指向的节点是 SortBuncket，见 BuncketRef
             };
         } buf;
-        uint64_t DataCount(const CLevel::MemControl *mem) const
-        {
-            return pointer.pointer(mem->BaseAddr())->EntryCount();
-        }
         void SetInvalid() { buf.meta = 0; }
         bool IsValid() const { return buf.meta != 0; }
     };
 
+#ifdef DRAM_INDEX
+    // DRAM_INDEX 时 PointerBEntry 在 DRAM，group 修改 entry 期间把它在 PM 上的副本放在这里
+    extern thread_local void *bentry_copy;
+#endif
+
+    /**
+     * @brief Key 是 uint32_t、uint64_t 或 uint128_t，value_size 是 4、8 或 16，
+     * C 层节点的记录宽度随之变化，eentry 中的 entry_key 和 Key 一样宽。
+     * node_size 是 C 层节点的字节数（64 的倍数，默认 UBUCKET_SIZE），fanout 是每个 PointerBEntry 的 C 层节点个数（默认 BENTRY_FANOUT），
+     * 8 字节 key 时 PointerBEntry 占 16 * fanout 字节，fanout 为 4 时正好一个 cache line
+     */
+    template <typename Key = uint64_t, const size_t value_size = 8, const size_t node_size = UBUCKET_SIZE, const int fanout = BENTRY_FANOUT>
     struct PointerBEntry
     {
-        static const int entry_count = 4;
+        typedef Key key_type;
+        typedef typename uint_of<value_size>::type value_type;
+        typedef UnSortBuncket<node_size, value_size, sizeof(Key)> buncket_t;
+#ifdef ADAPTIVE_LAYOUT
+        typedef SortBuncket<node_size, value_size, sizeof(Key)> sorted_buncket_t;
+#else
+        typedef buncket_t sorted_buncket_t;
+#endif
+        typedef BuncketRef<buncket_t, sorted_buncket_t> buncket_ref;
+        typedef basic_eentry<Key, buncket_t> eentry;
+        static_assert(sizeof(buncket_t) == node_size, "node_size must be a multiple of 64");
+        static_assert(fanout >= 2 && fanout < 128, "buf.entries holds at most 127 nodes");
+
+        // 扩展期间的临时写缓冲 tmp_buffer 是 FAST&FAIR，key 和 value 都是 8 字节
+        static constexpr bool use_tmp_buffer = sizeof(Key) == 8 && value_size == 8;
+
+        static const int entry_count = fanout;
         union
         {
             struct
             {
-                uint64_t entry_key; // min key
+                Key entry_key; // min key
                 char pointer[6];
                 union
                 {
@@ -2133,22 +2524,22 @@ namespace letree
                     {
                         uint16_t prefix_bytes : 4; // LSB
                         uint16_t suffix_bytes : 4;
-                        uint16_t entries : 8; // 实际记录的是entrys的数目
-                        // uint16_t max_entries : 4; // MSB
+                        uint16_t entries : 7; // 实际记录的是entrys的数目
+                        uint16_t : 1;         // entrys[0] 的 sorted 位
                     };
                 } buf;
             };
-            struct eentry entrys[entry_count];
+            eentry entrys[entry_count];
         };
 
-        ALWAYS_INLINE buncket_t *Pointer(int i, const CLevel::MemControl *mem) const
+        ALWAYS_INLINE buncket_ref Pointer(int i, const CLevel::MemControl *mem) const
         {
-            return (entrys[i].pointer.pointer(mem->BaseAddr()));
+            return buncket_ref(entrys[i].pointer.pointer(mem->BaseAddr()), entrys[i].buf.sorted);
         }
 
-        PointerBEntry(uint64_t key, int prefix_len, CLevel::MemControl *mem = nullptr);
+        PointerBEntry(key_type key, int prefix_len, CLevel::MemControl *mem = nullptr);
 
-        PointerBEntry(uint64_t key, uint64_t value, int prefix_len, CLevel::MemControl *mem = nullptr);
+        PointerBEntry(key_type key, value_type value, int prefix_len, CLevel::MemControl *mem = nullptr);
 
         PointerBEntry(const eentry *entry, CLevel::MemControl *mem = nullptr);
 
@@ -2159,7 +2550,9 @@ namespace letree
          */
         void AdjustEntryKey(CLevel::MemControl *mem)
         {
-            entry_key = Pointer(0, mem)->min_key();
+            // 区间删除可能留下空节点，此时 min_key 读到的是已删除的记录
+            if (Pointer(0, mem)->EntryCount() != 0)
+                entry_key = Pointer(0, mem)->min_key();
         }
 
         /**
@@ -2168,17 +2561,93 @@ namespace letree
          * @param key
          * @return int
          */
-        int Find_pos(uint64_t key) const;
+        template <simd::Isa isa = simd::kIsa>
+        int Find_pos(key_type key) const;
+
+        status Put(CLevel::MemControl *mem, key_type key, value_type value, bool *split = nullptr, TmpWriteBuffer *tmp = nullptr);
+
+        /**
+         * @brief 写入一段有序的 key，落在同一个 C 层节点的 key 一次写入，
+         * 返回 Full 时 done 之前的 key 已经写入，splits 记录节点分裂次数
+         */
+        status MultiPut(CLevel::MemControl *mem, const std::pair<key_type, value_type> kvs[], int count, int &done, int &splits,
+                        TmpWriteBuffer *tmp = nullptr);
+
+        bool Update(CLevel::MemControl *mem, key_type key, value_type value);
+
+        bool Get(CLevel::MemControl *mem, key_type key, value_type &value) const;
+
+        bool Scan(CLevel::MemControl *mem, key_type start_key, int &len, std::vector<std::pair<key_type, value_type>> &results, bool if_first) const;
+
+        /**
+         * @brief 按 key 顺序把可能包含 [lo, hi] 内 key 的 C 层节点交给 fn，Reverse 为 true 时从 hi 所在节点往前。
+         * 范围之外的节点不会被读取
+         * @return 本 entry 之后(Reverse 时之前)还可能有范围内的 key 返回 true；fn 返回 false 或者越过范围时返回 false
+         */
+        template <bool Reverse = false, typename BucketFn>
+        bool VisitBuckets(const CLevel::MemControl *mem, key_type lo, key_type hi, BucketFn &&fn) const
+        {
+            int nodes = std::min<int>(buf.entries, entry_count);
+            if (Reverse)
+            {
+                for (int pos = std::min(Find_pos(hi), nodes - 1); pos >= 0; pos--)
+                {
+                    // 每个节点的 entry_key 是其中 key 的下界，到达 lo 所在的节点之后前面的节点都不用再读
+                    if (!entrys[pos].IsValid() || !fn(Pointer(pos, mem)) || entrys[pos].entry_key <= lo)
+                        return false;
+                }
+                return true;
+            }
+            for (int pos = Find_pos(lo); pos < nodes && entrys[pos].IsValid(); pos++)
+            {
+                if (entrys[pos].entry_key > hi && pos != 0)
+                    return false;
+                if (!fn(Pointer(pos, mem)))
+                    return false;
+            }
+            return true;
+        }
+
+        bool Delete(CLevel::MemControl *mem, key_type key, value_type *value);
+
+        /**
+         * @brief 删除 [lo, hi] 内的 key，max_key 是路由到本 entry 的最大 key。
+         * 整个落在区间内的 C 层节点直接摘除并归还给 mem，边界上的节点逐个删除；
+         * 所有节点都被覆盖时不做修改，dropped 等于节点个数，由调用者整体去掉本 entry
+         * @param dropped 被覆盖的节点个数
+         * @return 删除的 key 个数
+         */
+        int DeleteRange(CLevel::MemControl *mem, key_type lo, key_type hi, key_type max_key, int &dropped);
 
-        status Put(CLevel::MemControl *mem, uint64_t key, uint64_t value, bool *split = nullptr);
+        // 只保留第一个节点并清空，其余节点归还给 mem，返回归还的节点个数
+        int Truncate(CLevel::MemControl *mem);
 
-        bool Update(CLevel::MemControl *mem, uint64_t key, uint64_t value);
+        // 整个 entry 被去掉之后归还它的所有节点
+        void FreeBuckets(CLevel::MemControl *mem);
 
-        bool Get(CLevel::MemControl *mem, uint64_t key, uint64_t &value) const;
+        /**
+         * @brief 把升序且不在节点中的 kvs 的前一部分和第 pos 个节点的记录合并，写成同样布局的新节点替换它，
+         * 有序节点的尾部写满、不能原地插入时使用，尾部同时归并进有序部分。新节点和 eentry 持久化之后再归还旧节点
+         * @return 写入的个数，节点写满时剩下的 key 由调用者处理
+         */
+        int Rewrite_(CLevel::MemControl *mem, int pos, const std::pair<key_type, value_type> kvs[], int count);
 
-        bool Scan(CLevel::MemControl *mem, uint64_t start_key, int &len, std::vector<std::pair<uint64_t, uint64_t>> &results, bool if_first) const;
+        /**
+         * @brief 分裂写满的第 pos 个节点，按它的访问计数为两半选择布局（见 LayoutStats）：
+         * 两半都写成新节点，持久化 eentry 之后才归还旧节点，崩溃时 eentry 要么指向完整的旧节点，要么指向两个新节点
+         */
+        void Split_(CLevel::MemControl *mem, int pos);
 
-        bool Delete(CLevel::MemControl *mem, uint64_t key, uint64_t *value);
+        // 修改 eentry 后的持久化点，entry 在 DRAM 时写到 PM 上的副本
+        void Persist() const
+        {
+#ifdef DRAM_INDEX
+            if (bentry_copy)
+                pmem_memcpy_persist(bentry_copy, this, sizeof(PointerBEntry));
+#else
+            NVM::Mem_persist(&entrys[0], sizeof(PointerBEntry));
+#endif
+        }
 
         void Show(CLevel::MemControl *mem)
         {
@@ -2188,7 +2657,7 @@ namespace letree
             {
                 // std::cout << "Entry key: " << entrys[i].entry_key << std::endl;
                 // (entrys[i].pointer.pointer(mem->BaseAddr()))->Show();
-                total += (entrys[i].pointer.pointer(mem->BaseAddr()))->EntryCount();
+                total += Pointer(i, mem)->EntryCount();
                 count++;
             }
             // std::cout << "Average entrys: " << total / count << std::endl;
@@ -2202,96 +2671,18 @@ namespace letree
             {
                 // std::cout << "Entry key: " << entrys[i].entry_key << std::endl;
                 // (entrys[i].pointer.pointer(mem->BaseAddr()))->Show();
-                total += (entrys[i].pointer.pointer(mem->BaseAddr()))->EntryCount();
+                total += Pointer(i, mem)->EntryCount();
                 count++;
             }
             return total / count;
         }
 
         // Only use when expand
-        status Load(CLevel::MemControl *mem, uint64_t *keys, uint64_t *values, int count);
+        status Load(CLevel::MemControl *mem, key_type *keys, value_type *values, int count);
 
         void SetInvalid() { entrys[0].buf.meta = 0; }
         bool IsValid() { return entrys[0].buf.meta != 0; }
 
-        class Iter
-        {
-        public:
-            Iter() {}
-
-            Iter(const PointerBEntry *entry, const CLevel::MemControl *mem)
-                : entry_(entry), mem_(mem)
-            {
-                if (!entry_)
-                    return;
-                if (entry_->entrys[0].IsValid())
-                {
-                    new (&biter_) buncket_t::Iter(entry_->Pointer(0, mem), entry_->entrys[0].buf.prefix_bytes);
-                }
-                cur_idx = 0;
-            }
-
-            Iter(const PointerBEntry *entry, const CLevel::MemControl *mem, uint64_t start_key)
-                : entry_(entry), mem_(mem)
-            {
-                int pos = entry_->Find_pos(start_key);
-                if (unlikely(!entry_->entrys[pos].IsValid()))
-                {
-                    cur_idx = entry_count;
-                    return;
-                }
-                cur_idx = pos;
-                if (entry_->entrys[pos].IsValid())
-                {
-                    new (&biter_) buncket_t::Iter(entry_->Pointer(pos, mem), entry_->entrys[pos].buf.prefix_bytes, start_key);
-                    if (biter_.end())
-                    {
-                        next();
-                    }
-                }
-            }
-
-            ALWAYS_INLINE uint64_t key() const
-            {
-                return biter_.key();
-            }
-
-            ALWAYS_INLINE uint64_t value() const
-            {
-                return biter_.value();
-            }
-
-            ALWAYS_INLINE bool next()
-            {
-                if (cur_idx < entry_->buf.entries && biter_.next())
-                {
-                    return true;
-                }
-                else if (cur_idx < entry_->buf.entries - 1)
-                {
-                    cur_idx++;
-                    new (&biter_) buncket_t::Iter(entry_->Pointer(cur_idx, mem_), entry_->entrys[cur_idx].buf.prefix_bytes);
-                    if (biter_.end())
-                        return false;
-                    return true;
-                }
-                cur_idx = entry_->buf.entries;
-                return false;
-            }
-
-            ALWAYS_INLINE bool end() const
-            {
-                return cur_idx >= entry_->buf.entries;
-            }
-
-        private:
-            const PointerBEntry *entry_;
-            int cur_idx;
-            const CLevel::MemControl *mem_;
-            buncket_t::Iter biter_;
-        };
-        using NoSortIter = Iter;
-
         class EntryIter
         {
         public:
@@ -2319,17 +2710,17 @@ namespace letree
                 cur_idx++;
                 // std::cout << "cur_idx:" << cur_idx << std::endl;
                 // std::cout << "entry_->buf.entries:" << entry_->entrys[0].buf.entries << std::endl;
-                if (cur_idx < entry_->entrys[0].buf.entries)
+                if (cur_idx < entry_->buf.entries)
                 {
                     return true;
                 }
-                cur_idx = entry_->entrys[0].buf.entries;
+                cur_idx = entry_->buf.entries;
                 return false;
             }
 
             ALWAYS_INLINE bool end() const
             {
-                return cur_idx >= entry_->entrys[0].buf.entries;
+                return cur_idx >= entry_->buf.entries;
             }
 
         private:
@@ -2338,33 +2729,39 @@ namespace letree
         };
     };
 
-    PointerBEntry::PointerBEntry(uint64_t key, int prefix_len, CLevel::MemControl *mem)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    PointerBEntry<Key, value_size, node_size, fanout>::PointerBEntry(key_type key, int prefix_len, CLevel::MemControl *mem)
     {
         memset(this, 0, sizeof(PointerBEntry));
         entrys[0].buf.prefix_bytes = prefix_len;
         entrys[0].buf.suffix_bytes = 8 - prefix_len;
-        entrys[0].buf.entries = 1;
+        buf.entries = 1;
         entrys[0].entry_key = key;
         entrys[0].pointer.Setup(mem, key, prefix_len);
 #ifndef USE_MEM
-        clflush((void *)&entrys[0]);
+        // fanout 大于 4 时 entry 跨多个 cache line，清零的部分也要持久化
+        for (size_t offset = 0; offset < sizeof(PointerBEntry); offset += CACHE_LINE_SIZE)
+        {
+            clflush((char *)this + offset);
 #ifdef TEST_PMEM_SIZE
-        NVM::pmem_size += CACHE_LINE_SIZE;
+            NVM::pmem_size += CACHE_LINE_SIZE;
 #endif
+        }
 #endif
         //   clevel.Setup(mem, buf.suffix_bytes);
         // std::cout << "Entry key: " << key << std::endl;
     }
 
-    PointerBEntry::PointerBEntry(uint64_t key, uint64_t value, int prefix_len, CLevel::MemControl *mem)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    PointerBEntry<Key, value_size, node_size, fanout>::PointerBEntry(key_type key, value_type value, int prefix_len, CLevel::MemControl *mem)
     {
         memset(this, 0, sizeof(PointerBEntry));
         entrys[0].buf.prefix_bytes = prefix_len;
         entrys[0].buf.suffix_bytes = 8 - prefix_len;
-        entrys[0].buf.entries = 1;
+        buf.entries = 1;
         entrys[0].entry_key = key;
         entrys[0].pointer.Setup(mem, key, prefix_len);
-        (entrys[0].pointer.pointer(mem->BaseAddr()))->Put(mem, key, value);
+        Pointer(0, mem)->Put(mem, key, value);
 #ifndef USE_MEM
         NVM::Mem_persist(&entrys[0], sizeof(PointerBEntry));
 // #ifdef TEST_PMEM_SIZE
@@ -2374,11 +2771,12 @@ namespace letree
         // std::cout << "Entry key: " << key << std::endl;
     }
 
-    PointerBEntry::PointerBEntry(const eentry *entry, CLevel::MemControl *mem)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    PointerBEntry<Key, value_size, node_size, fanout>::PointerBEntry(const eentry *entry, CLevel::MemControl *mem)
     {
         memset(this, 0, sizeof(PointerBEntry));
         entrys[0] = *entry;
-        entrys[0].buf.entries = 1;
+        buf.entries = 1;
 #ifndef USE_MEM
         NVM::Mem_persist(&entrys[0], sizeof(PointerBEntry));
 // #ifdef TEST_PMEM_SIZE
@@ -2388,8 +2786,16 @@ namespace letree
         // std::cout << "Entry key: " << key << std::endl;
     }
 
-    int PointerBEntry::Find_pos(uint64_t key) const
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    template <simd::Isa isa>
+    int PointerBEntry<Key, value_size, node_size, fanout>::Find_pos(key_type key) const
     {
+        if constexpr (sizeof(Key) == 8 && sizeof(eentry) == 16)
+        {
+            // 最后一个 entry_key <= key 的节点，即第一个大于 key 的节点的前一个
+            int first = simd::FirstGreater<sizeof(eentry), true, isa>(&entrys[0].entry_key, key, buf.entries);
+            return first == 0 ? 0 : first - 1;
+        }
         // int pos = 0;
         // while (pos < buf.entries && entrys[pos].IsValid() && entrys[pos].entry_key <= key)
         //     pos++;
@@ -2420,39 +2826,42 @@ namespace letree
         return ppos;
     }
 
-    bool PointerBEntry::Update(CLevel::MemControl *mem, uint64_t key, uint64_t value)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool PointerBEntry<Key, value_size, node_size, fanout>::Update(CLevel::MemControl *mem, key_type key, value_type value)
     {
         int pos = Find_pos(key);
         if (unlikely(pos >= entry_count || !entrys[pos].IsValid()))
         {
             return false;
         }
-        auto ret = (entrys[pos].pointer.pointer(mem->BaseAddr()))->Update(mem, key, value);
+        auto ret = Pointer(pos, mem)->Update(mem, key, value);
         return ret == status::OK;
     }
 
-    bool PointerBEntry::Get(CLevel::MemControl *mem, uint64_t key, uint64_t &value) const
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool PointerBEntry<Key, value_size, node_size, fanout>::Get(CLevel::MemControl *mem, key_type key, value_type &value) const
     {
         int pos = Find_pos(key);
         if (unlikely(pos >= entry_count || !entrys[pos].IsValid()))
         {
             return false;
         }
-        auto ret = (entrys[pos].pointer.pointer(mem->BaseAddr()))->Get(mem, key, value);
+        auto ret = Pointer(pos, mem)->Get(mem, key, value);
         // if(ret != status::OK) {
         //     printf("get key false\n");
         // }
         return ret == status::OK;
     }
 
-    bool PointerBEntry::Scan(CLevel::MemControl *mem, uint64_t start_key, int &len, std::vector<std::pair<uint64_t, uint64_t>> &results, bool if_first) const
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool PointerBEntry<Key, value_size, node_size, fanout>::Scan(CLevel::MemControl *mem, key_type start_key, int &len, std::vector<std::pair<key_type, value_type>> &results, bool if_first) const
     {
         int pos = 0;
         status ret;
         if (if_first)
         {
             pos = 0;
-            ret = (entrys[pos].pointer.pointer(mem->BaseAddr()))->Scan(mem, 0, len, results, if_first);
+            ret = Pointer(pos, mem)->Scan(mem, 0, len, results, if_first);
         }
         else
         {
@@ -2461,40 +2870,193 @@ namespace letree
             {
                 return false;
             }
-            ret = (entrys[pos].pointer.pointer(mem->BaseAddr()))->Scan(mem, start_key, len, results, false);
+            ret = Pointer(pos, mem)->Scan(mem, start_key, len, results, false);
         }
         pos++;
-        while (ret == status::Failed && pos < entrys[0].buf.entries)
+        while (ret == status::Failed && pos < buf.entries)
         {
-            ret = (entrys[pos].pointer.pointer(mem->BaseAddr()))->Scan(mem, start_key, len, results, false);
+            ret = Pointer(pos, mem)->Scan(mem, start_key, len, results, false);
         }
         return ret == status::OK ? true : false;
     }
 
-    bool PointerBEntry::Delete(CLevel::MemControl *mem, uint64_t key, uint64_t *value)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    bool PointerBEntry<Key, value_size, node_size, fanout>::Delete(CLevel::MemControl *mem, key_type key, value_type *value)
     {
         int pos = Find_pos(key);
         if (unlikely(pos >= entry_count || !entrys[pos].IsValid()))
         {
             return false;
         }
-        auto ret = (entrys[pos].pointer.pointer(mem->BaseAddr()))->Delete(mem, key, value);
+        auto ret = Pointer(pos, mem)->Delete(mem, key, value);
         return ret == status::OK;
     }
 
-    status PointerBEntry::Load(CLevel::MemControl *mem, uint64_t *keys, uint64_t *values, int count)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    int PointerBEntry<Key, value_size, node_size, fanout>::DeleteRange(CLevel::MemControl *mem, key_type lo, key_type hi, key_type max_key, int &dropped)
+    {
+        int n = buf.entries;
+        int removed = 0;
+        int kept = 0;
+        eentry keep[entry_count];
+        buncket_ref freed[entry_count];
+        dropped = 0;
+        for (int i = 0; i < n; i++)
+        {
+            // 节点 i 中的 key 都落在 [entrys[i].entry_key, entrys[i + 1].entry_key) 内
+            key_type first = entrys[i].entry_key;
+            key_type last = i + 1 < n ? entrys[i + 1].entry_key - 1 : max_key;
+            if (last < lo || first > hi)
+            {
+                keep[kept++] = entrys[i];
+            }
+            else if (first >= lo && last <= hi)
+            {
+                freed[dropped++] = Pointer(i, mem);
+                removed += freed[dropped - 1]->EntryCount();
+            }
+            else
+            {
+                removed += Pointer(i, mem)->DeleteRange(lo, hi);
+                keep[kept++] = entrys[i];
+            }
+        }
+        if (dropped == 0 || kept == 0)
+        {
+            // 整个 entry 被覆盖时不修改，由 group 去掉这个 entry 或调用 Truncate
+            return removed;
+        }
+        for (int i = 0; i < entry_count; i++)
+        {
+            if (i < kept)
+                entrys[i] = keep[i];
+            else
+                entrys[i].SetInvalid();
+        }
+        buf.entries = kept;
+        Persist();
+        // eentry 持久化之后节点不再被引用，再归还
+        for (int i = 0; i < dropped; i++)
+        {
+            freed[i].Free(mem);
+        }
+        return removed;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    int PointerBEntry<Key, value_size, node_size, fanout>::Truncate(CLevel::MemControl *mem)
+    {
+        int n = buf.entries;
+        Pointer(0, mem)->Clear();
+        for (int i = 1; i < entry_count; i++)
+        {
+            entrys[i].SetInvalid();
+        }
+        buf.entries = 1;
+        Persist();
+        for (int i = 1; i < n; i++)
+        {
+            Pointer(i, mem).Free(mem);
+        }
+        return n - 1;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void PointerBEntry<Key, value_size, node_size, fanout>::FreeBuckets(CLevel::MemControl *mem)
+    {
+        for (int i = 0; i < buf.entries; i++)
+        {
+            Pointer(i, mem).Free(mem);
+        }
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    int PointerBEntry<Key, value_size, node_size, fanout>::Rewrite_(CLevel::MemControl *mem, int pos, const std::pair<key_type, value_type> kvs[], int count)
+    {
+        buncket_ref node = Pointer(pos, mem);
+        std::pair<key_type, value_type> records[buncket_ref::Capacity()], merged[buncket_ref::Capacity()];
+        int n = node.Records(records);
+        int put = std::min(count, node.Capacity(node.sorted()) - n);
+        if (put <= 0)
+        {
+            return 0;
+        }
+        std::merge(records, records + n, kvs, kvs + put, merged, [](const std::pair<key_type, value_type> &a, const std::pair<key_type, value_type> &b)
+                   { return a.first < b.first; });
+        buncket_ref fresh = buncket_ref::Create(mem, merged[0].first, node.sorted());
+        fresh.Fill(merged, n + put);
+        // 节点的访问计数随节点一起搬过去
+        LayoutStats::Move(node.address(), fresh.address());
+        entrys[pos].pointer.Setup(mem, fresh.address(), merged[0].first, 0);
+        Persist();
+        node.Free(mem);
+        return put;
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    void PointerBEntry<Key, value_size, node_size, fanout>::Split_(CLevel::MemControl *mem, int pos)
+    {
+        buncket_ref node = Pointer(pos, mem);
+        bool sorted = buncket_ref::adaptive && LayoutStats::PreferSorted(node.address());
+        std::pair<key_type, value_type> records[buncket_ref::Capacity()];
+        int n = node.Records(records);
+        int m = n / 2;
+        key_type split_key = records[m].first;
+        int prefix_len = 0;
+        buncket_ref left = buncket_ref::Create(mem, records[0].first, sorted);
+        left.Fill(records, m);
+        buncket_ref right = buncket_ref::Create(mem, split_key, sorted);
+        right.Fill(records + m, n - m);
+        mem->expand_times++;
+        for (int i = buf.entries - 1; i > pos; i--)
+        {
+            entrys[i + 1] = entrys[i];
+        }
+        entrys[pos].pointer.Setup(mem, left.address(), entrys[pos].entry_key, prefix_len);
+        entrys[pos].buf.sorted = sorted;
+        entrys[pos + 1].entry_key = split_key;
+        entrys[pos + 1].pointer.Setup(mem, right.address(), split_key, prefix_len);
+        entrys[pos + 1].buf.prefix_bytes = prefix_len;
+        entrys[pos + 1].buf.suffix_bytes = 8 - prefix_len;
+        entrys[pos + 1].buf.sorted = sorted;
+        buf.entries++;
+        Persist();
+        node.Free(mem);
+        // 两半从零开始计数，节点变多时扩大计数表
+        if constexpr (buncket_ref::adaptive)
+            LayoutStats::Reserve(mem->Used() / sizeof(buncket_t));
+        LayoutStats::Reset(left.address());
+        LayoutStats::Reset(right.address());
+    }
+
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    status PointerBEntry<Key, value_size, node_size, fanout>::Load(CLevel::MemControl *mem, key_type *keys, value_type *values, int count)
     {
         assert(buf.entries == 1);
         Pointer(0, mem)->Load(keys, values, count);
         return status::OK;
     }
 
-    status PointerBEntry::Put(CLevel::MemControl *mem, uint64_t key, uint64_t value, bool *split)
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    status PointerBEntry<Key, value_size, node_size, fanout>::Put(CLevel::MemControl *mem, key_type key, value_type value, bool *split, TmpWriteBuffer *tmp)
     {
     retry:
         // Common::timers["ALevel_times"].start();
         int pos = Find_pos(key);
         bool flag = false;
+#ifdef USE_TMP_WRITE_BUFFER
+        // 扩展期间不能修改 eentry，也不能写入比首节点最小 key 更小的 key（AdjustEntryKey 会据此调整 entry_key），
+        // 否则新 group_space 里的路由信息会过期
+        if constexpr (use_tmp_buffer)
+        {
+            if (unlikely(tmp && tmp->Expanding()) &&
+                (!entrys[pos].IsValid() || (pos == 0 && (key < entry_key || key < Pointer(0, mem)->min_key()))))
+            {
+                tmp->Put(key, value);
+                return status::OK;
+            }
+        }
+#endif
         if (unlikely(!entrys[pos].IsValid()))
         {
             // cout << "begin" << endl;
@@ -2503,41 +3065,31 @@ namespace letree
         }
         // Common::timers["ALevel_times"].end();
         // std::cout << "Put key: " << key << ", value " << value << std::endl;
-        auto ret = (entrys[pos].pointer.pointer(mem->BaseAddr()))->Put(mem, key, value);
+        auto ret = Pointer(pos, mem)->Put(mem, key, value);
         // if(ret == status::Full){
         //     std::cout << entrys[0].buf.entries << std::endl;
         // }
-        if (ret == status::Full && entrys[0].buf.entries < entry_count)
-        { // 节点满的时候进行扩展
 #ifdef USE_TMP_WRITE_BUFFER
-            if (is_tree_expand.load(std::memory_order_acquire))
-            {
-                tmp_buffer->btree_insert(key, (char *)value);
+        if constexpr (use_tmp_buffer)
+        {
+            // 有序节点的尾部写满时要替换成新节点，也会修改 eentry
+            if ((ret == status::Full || ret == status::Failed) && tmp && tmp->Expanding())
+            { // 扩展期间不分裂节点，也不触发 group::expand
+                tmp->Put(key, value);
                 return status::OK;
             }
+        }
 #endif
-            buncket_t *next = nullptr;
-            uint64_t split_key;
-            int prefix_len = 0;
-            (entrys[pos].pointer.pointer(mem->BaseAddr()))->Expand_(mem, next, split_key, prefix_len);
-            for (int i = entrys[0].buf.entries - 1; i > pos; i--)
-            {
-                entrys[i + 1] = entrys[i];
-            }
-            entrys[pos + 1].entry_key = split_key;
-            entrys[pos + 1].pointer.Setup(mem, next, key, prefix_len);
-            entrys[pos + 1].buf.prefix_bytes = prefix_len;
-            entrys[pos + 1].buf.suffix_bytes = 8 - prefix_len;
-            entrys[0].buf.entries++;
-            // std::cout << entrys[0].buf.entries << std::endl;
-            // this->Show(mem);
+        if (ret == status::Failed && entrys[pos].buf.sorted)
+        {
+            std::pair<key_type, value_type> kv(key, value);
+            ret = Rewrite_(mem, pos, &kv, 1) == 1 ? status::OK : status::Full;
+        }
+        if (ret == status::Full && buf.entries < entry_count)
+        { // 节点满的时候进行扩展
+            Split_(mem, pos);
             if (split)
                 *split = true;
-            NVM::Mem_persist(&entrys[0], sizeof(PointerBEntry));
-            // clflush(&entrys[0]);
-            // #ifdef TEST_PMEM_SIZE
-            //                 NVM::pmem_size += CACHE_LINE_SIZE;
-            // #endif
             goto retry;
         }
         // if(ret != status::OK) {
@@ -2555,11 +3107,59 @@ namespace letree
         return ret;
     }
 
+    template <typename Key, const size_t value_size, const size_t node_size, const int fanout>
+    status PointerBEntry<Key, value_size, node_size, fanout>::MultiPut(CLevel::MemControl *mem, const std::pair<key_type, value_type> kvs[], int count, int &done, int &splits,
+                                                                     TmpWriteBuffer *tmp)
+    {
+        done = 0;
+        while (done < count)
+        {
+            int pos = Find_pos(kvs[done].first);
+            int end = count;
+            if (pos + 1 < buf.entries)
+            {
+                end = done + 1;
+                while (end < count && kvs[end].first < entrys[pos + 1].entry_key)
+                    end++;
+            }
+            int n = 0;
+#ifdef USE_TMP_WRITE_BUFFER
+            // 扩展期间是否转写 tmp_buffer 由 Put 逐个判断
+            if (likely(entrys[pos].IsValid() && !(use_tmp_buffer && tmp && tmp->Expanding())))
+#else
+            if (likely(entrys[pos].IsValid()))
+#endif
+            {
+                n = Pointer(pos, mem)->PutBatch(&kvs[done], end - done);
+                // 有序节点的尾部写满之后，其余的 key 和节点中的记录合并成一个新节点
+                if (n == 0 && entrys[pos].buf.sorted)
+                    n = Rewrite_(mem, pos, &kvs[done], end - done);
+                if (n > 0 && entry_key > kvs[done].first)
+                {
+                    entry_key = kvs[done].first;
+                }
+                done += n;
+            }
+            if (done < end)
+            { // 节点满了，下一个 key 走 Put 的分裂逻辑
+                bool split = false;
+                auto ret = Put(mem, kvs[done].first, kvs[done].second, &split, tmp);
+                if (split)
+                    splits++;
+                if (ret != status::OK)
+                    return ret;
+                done++;
+            }
+        }
+        return status::OK;
+    }
+
     // 合并左右节点，并插入KV对
-    static status MergePointerBEntry(PointerBEntry *left, PointerBEntry *right,
-                                     CLevel::MemControl *mem, uint64_t key, uint64_t value)
+    template <typename bentry_t>
+    static status MergePointerBEntry(bentry_t *left, bentry_t *right, CLevel::MemControl *mem,
+                                     typename bentry_t::key_type key, typename bentry_t::value_type value)
     {
-        if (left->buf.entries == PointerBEntry::entry_count)
+        if (left->buf.entries == bentry_t::entry_count)
         {
             // simple move one to left
             int right_entries = right->buf.entries;
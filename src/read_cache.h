@@ -0,0 +1,291 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <x86intrin.h>
+#include "pmem.h"
+
+namespace letree
+{
+
+  /**
+   * @brief DRAM 热点读缓存，放在 letree::Get 和 find_fast 之间，只缓存命中的 key
+   * 1. 组相联：key 哈希到一个 128B 的 set，set 内 kWays 路按 CLOCK 淘汰，每个 set 相当于一个分片；
+   * 2. 和 group 一样用版本号做乐观读，读者不加锁，命中时只在访问位没置位时写一次；
+   * 3. 写者（Put/Update/Delete）在持有 group 锁时修改或作废缓存，并总是推进 set 的版本号，
+   *    Get 未命中后回填时版本号已经变化就放弃，避免把读到的旧值放进缓存。
+   * set 固定 128B，路数由 key 和值的宽度决定，8 字节 key 和值时为 7 路。
+   */
+  template <typename Key = uint64_t, typename Value = uint64_t>
+  class ReadCache
+  {
+  public:
+    static const int kHeader = 8;
+    static const int kWays = std::min<int>(8, (128 - std::max<int>(kHeader, alignof(Key))) / (sizeof(Key) + sizeof(Value)));
+
+    struct alignas(64) Set
+    {
+      std::atomic<uint32_t> version; // odd while a writer holds the set
+      std::atomic<uint8_t> ref;      // CLOCK reference bit of each way
+      uint8_t valid;                 // one bit per way
+      uint8_t hand;
+      uint8_t reserve;
+      Key keys[kWays];
+      Value values[kWays];
+    };
+    static_assert(sizeof(Set) == 128, "a set spans two cache lines");
+
+    // bytes 向下取到 2 的幂个 set，至少一个 set
+    explicit ReadCache(size_t bytes)
+    {
+      size_t n = 1;
+      while (n * 2 * sizeof(Set) <= bytes)
+        n *= 2;
+      nr_sets_ = n;
+      mask_ = n - 1;
+      sets_ = new Set[n];
+      for (size_t i = 0; i < n; i++)
+      {
+        sets_[i].version.store(0, std::memory_order_relaxed);
+        sets_[i].ref.store(0, std::memory_order_relaxed);
+        sets_[i].valid = 0;
+        sets_[i].hand = 0;
+      }
+      for (int i = 0; i < kStatSlots; i++)
+      {
+        stats_[i].hits.store(0, std::memory_order_relaxed);
+        stats_[i].misses.store(0, std::memory_order_relaxed);
+      }
+    }
+
+    ~ReadCache()
+    {
+      delete[] sets_;
+    }
+
+    ReadCache(const ReadCache &) = delete;
+    ReadCache &operator=(const ReadCache &) = delete;
+
+    /**
+     * @brief 查找 key，未命中时 version 返回查找时 set 的版本号，交给 Fill
+     */
+    ALWAYS_INLINE bool Get(Key key, Value &value, uint32_t &version)
+    {
+      Set &s = sets_[SetIndex(key)];
+      while (true)
+      {
+        uint32_t v = s.version.load(std::memory_order_acquire);
+        if (unlikely(v & 1))
+        {
+          _mm_pause();
+          continue;
+        }
+        int way = Find(s, key);
+        Value val = way >= 0 ? s.values[way] : 0;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.version.load(std::memory_order_relaxed) != v)
+          continue;
+        Stat &st = stats_[ThreadSlot()];
+        if (way < 0)
+        {
+          version = v;
+          st.misses.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        }
+        uint8_t bit = 1 << way;
+        if (!(s.ref.load(std::memory_order_relaxed) & bit))
+          s.ref.fetch_or(bit, std::memory_order_relaxed);
+        value = val;
+        st.hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+
+    // Get 未命中后把从树中读到的值放进缓存，set 在此期间被修改过时放弃
+    void Fill(Key key, Value value, uint32_t version)
+    {
+      Set &s = sets_[SetIndex(key)];
+      if (!s.version.compare_exchange_strong(version, version + 1, std::memory_order_acquire))
+        return;
+      int way = Find(s, key);
+      if (way < 0)
+        way = Victim(s);
+      s.keys[way] = key;
+      s.values[way] = value;
+      s.valid |= 1 << way;
+      s.ref.fetch_and(~(1 << way), std::memory_order_relaxed);
+      Unlock(s);
+    }
+
+    // 写入树之后调用，已缓存的 key 更新为新值
+    void Update(Key key, Value value)
+    {
+      Set &s = Lock(key);
+      int way = Find(s, key);
+      if (way >= 0)
+        s.values[way] = value;
+      Unlock(s);
+    }
+
+    void Erase(Key key)
+    {
+      Set &s = Lock(key);
+      int way = Find(s, key);
+      if (way >= 0)
+        s.valid &= ~(1 << way);
+      Unlock(s);
+    }
+
+    // 作废 [lo, hi] 内的 key，需要遍历所有 set，只用于 DeleteRange 这类低频操作
+    void EraseRange(Key lo, Key hi)
+    {
+      for (size_t i = 0; i < nr_sets_; i++)
+      {
+        Set &s = LockSet(sets_[i]);
+        for (int w = 0; w < kWays; w++)
+        {
+          if ((s.valid & (1 << w)) && s.keys[w] >= lo && s.keys[w] <= hi)
+            s.valid &= ~(1 << w);
+        }
+        Unlock(s);
+      }
+    }
+
+    void Clear()
+    {
+      EraseRange(0, ~Key(0));
+    }
+
+    size_t Capacity() const
+    {
+      return nr_sets_ * kWays;
+    }
+
+    size_t Bytes() const
+    {
+      return nr_sets_ * sizeof(Set);
+    }
+
+    uint64_t Hits() const
+    {
+      uint64_t n = 0;
+      for (int i = 0; i < kStatSlots; i++)
+        n += stats_[i].hits.load(std::memory_order_relaxed);
+      return n;
+    }
+
+    uint64_t Misses() const
+    {
+      uint64_t n = 0;
+      for (int i = 0; i < kStatSlots; i++)
+        n += stats_[i].misses.load(std::memory_order_relaxed);
+      return n;
+    }
+
+    double HitRate() const
+    {
+      uint64_t hits = Hits(), total = hits + Misses();
+      return total ? 1.0 * hits / total : 0;
+    }
+
+    void ResetStats()
+    {
+      for (int i = 0; i < kStatSlots; i++)
+      {
+        stats_[i].hits.store(0, std::memory_order_relaxed);
+        stats_[i].misses.store(0, std::memory_order_relaxed);
+      }
+    }
+
+    void Info() const
+    {
+      std::cout << "read cache : " << Bytes() << " bytes, " << Capacity() << " keys, hits " << Hits()
+                << ", misses " << Misses() << ", hit rate " << HitRate() << std::endl;
+    }
+
+  private:
+    static const int kStatSlots = 64;
+
+    // counters are striped by thread, readers of the same hot set still write their own cache line
+    struct alignas(64) Stat
+    {
+      std::atomic<uint64_t> hits;
+      std::atomic<uint64_t> misses;
+    };
+
+    static int ThreadSlot()
+    {
+      static std::atomic<int> next_slot(0);
+      static thread_local int slot = next_slot.fetch_add(1) % kStatSlots;
+      return slot;
+    }
+
+    ALWAYS_INLINE size_t SetIndex(Key k) const
+    {
+      uint64_t key = k;
+      if constexpr (sizeof(Key) > 8)
+        key ^= (uint64_t)(k >> 64) * 0x9e3779b97f4a7c15UL;
+      key ^= key >> 33;
+      key *= 0xff51afd7ed558ccdUL;
+      key ^= key >> 33;
+      return key & mask_;
+    }
+
+    ALWAYS_INLINE static int Find(const Set &s, Key key)
+    {
+      for (int w = 0; w < kWays; w++)
+      {
+        if ((s.valid & (1 << w)) && s.keys[w] == key)
+          return w;
+      }
+      return -1;
+    }
+
+    // CLOCK：从 hand 开始，空闲的路直接使用，访问位置位的清除后跳过
+    static int Victim(Set &s)
+    {
+      while (true)
+      {
+        int w = s.hand;
+        s.hand = (w + 1) % kWays;
+        uint8_t bit = 1 << w;
+        if (!(s.valid & bit))
+          return w;
+        if (!(s.ref.load(std::memory_order_relaxed) & bit))
+          return w;
+        s.ref.fetch_and(~bit, std::memory_order_relaxed);
+      }
+    }
+
+    Set &Lock(Key key)
+    {
+      return LockSet(sets_[SetIndex(key)]);
+    }
+
+    static Set &LockSet(Set &s)
+    {
+      while (true)
+      {
+        uint32_t v = s.version.load(std::memory_order_relaxed);
+        if (!(v & 1) && s.version.compare_exchange_weak(v, v + 1, std::memory_order_acquire))
+          break;
+        _mm_pause();
+      }
+      std::atomic_thread_fence(std::memory_order_release);
+      return s;
+    }
+
+    static void Unlock(Set &s)
+    {
+      s.version.fetch_add(1, std::memory_order_release);
+    }
+
+    Set *sets_;
+    size_t nr_sets_;
+    size_t mask_;
+    Stat stats_[kStatSlots];
+  };
+
+} // namespace letree
@@ -1,5 +1,6 @@
 #pragma once 
 
+#include <vector>
 #include "learnindex/piecewise_linear_model.hpp"
 namespace LearnModel
 {
@@ -140,6 +141,19 @@ class LinearModelBuilder {
     model_ = model;
   }
 
+  // merge the statistics collected by another builder (e.g. another thread)
+  void merge(const LinearModelBuilder<T>& other) {
+    count_ += other.count_;
+    x_sum_ += other.x_sum_;
+    y_sum_ += other.y_sum_;
+    xx_sum_ += other.xx_sum_;
+    xy_sum_ += other.xy_sum_;
+    x_min_ = std::min<T>(x_min_, other.x_min_);
+    x_max_ = std::max<T>(x_max_, other.x_max_);
+    y_min_ = std::min<double>(y_min_, other.y_min_);
+    y_max_ = std::max<double>(y_max_, other.y_max_);
+  }
+
  private:
   int count_ = 0;
   long double x_sum_ = 0;
@@ -235,8 +249,8 @@ private:
 template <class T>
 class rmi_line_model<T>::builder_t {
 public:
-  explicit builder_t(rmi_line_model<T>* model) 
-    : builder_(&model->stage_1) {
+  explicit builder_t(rmi_line_model<T>* model, int key_seq = 0) 
+    : builder_(&model->stage_1), key_seq(key_seq) {
     }
 
   template<typename key_t = T>
@@ -256,6 +270,10 @@ public:
     builder_.build();
   }
 
+  // builders of consecutive key ranges can be filled in parallel and merged before build()
+  void merge(const builder_t& other) {
+    builder_.merge(other.builder_);
+  }
 
 private:
   rmi_line_model<T>::stage_1_model_builder_t builder_;
@@ -328,6 +346,122 @@ private:
     static const size_t linear_sample = 8;
 };
 
+// Two-stage RMI kept in DRAM. Every leaf covers the same number of
+// positions and keeps its first key, so a stage 1 misprediction on skewed
+// keys is corrected by an exponential search over the leaf first keys
+// instead of piling keys up in a few leaves. Each stage 2 leaf records the
+// min/max error of its training keys so lookups can search a bounded window.
+template <class T>
+class rmi_bound_model {
+    using stage_1_model_t = LinearModel<T>;
+    using stage_1_model_builder_t = LinearModelBuilder<T>;
+    using stage_2_model_t = LinearModel<T>;
+    using stage_2_model_builder_t = LinearModelBuilder<T>;
+public:
+    // untrained model has a single leaf and always predicts position 0
+    rmi_bound_model() : leaf_key(1, 0), stage_2(1), min_err(1, 0), max_err(1, 0), size_(1) { }
+
+    // keys in [first, first + size) must be sorted, the position of key i is i
+    template<typename RandomIt, typename key_t = T>
+    void init(RandomIt first, size_t size, size_t sg_num, T (*func)(const key_t&) = to_key<T, key_t>) {
+        size_ = std::max<size_t>(size, 1);
+        sg_num = std::max<size_t>(1, std::min(sg_num, size_));
+        leaf_key.assign(sg_num, 0);
+        stage_2.assign(sg_num, stage_2_model_t());
+        min_err.assign(sg_num, 0);
+        max_err.assign(sg_num, 0);
+        if(size == 0) return;
+
+        for(size_t m = 0; m < sg_num; m++) {
+          size_t start = m * size / sg_num, end = (m + 1) * size / sg_num;
+          leaf_key[m] = func(first[start]);
+          {
+            stage_2_model_builder_t builder(&stage_2[m]);
+            for(size_t i = start; i < end; i++)
+              builder.add(first[i], i, func);
+            builder.build();
+          }
+          for(size_t i = start; i < end; i++) {
+            int err = static_cast<int>(i) - clamp(stage_2[m].predict(func(first[i])));
+            min_err[m] = std::min(min_err[m], err);
+            max_err[m] = std::max(max_err[m], err);
+          }
+        }
+        {
+          stage_1_model_builder_t builder(&stage_1);
+          for(size_t m = 0; m < sg_num; m++)
+            builder.add(leaf_key[m], m);
+          builder.build();
+        }
+    }
+
+    inline int predict(T key) const {
+      return clamp(stage_2[leaf(key)].predict(key));
+    }
+
+    // predicted position plus the [lo, hi] window recorded for its leaf
+    inline int predict(T key, int &lo, int &hi) const {
+      int m = leaf(key);
+      int pos = clamp(stage_2[m].predict(key));
+      lo = clamp(pos + min_err[m]);
+      hi = clamp(pos + max_err[m]);
+      return pos;
+    }
+
+    size_t leaf_count() const {
+      return stage_2.size();
+    }
+
+    // mean width of the leaf error windows
+    double avg_window() const {
+      double sum = 0;
+      for(size_t m = 0; m < stage_2.size(); m++)
+        sum += max_err[m] - min_err[m];
+      return sum / stage_2.size();
+    }
+
+private:
+    // last leaf whose first key <= key: exponential search from the stage 1
+    // prediction, then a branchless binary search inside [lo, hi)
+    inline int leaf(T key) const {
+      int n = leaf_key.size();
+      int m = std::min(std::max(stage_1.predict(key), 0), n - 1);
+      int lo, hi, bound = 1;
+      if(leaf_key[m] <= key) {
+        lo = m;
+        while(lo + bound < n && leaf_key[lo + bound] <= key) {
+          lo += bound;
+          bound <<= 1;
+        }
+        hi = std::min(lo + bound, n);
+      } else {
+        hi = m;
+        while(hi - bound >= 0 && leaf_key[hi - bound] > key) {
+          hi -= bound;
+          bound <<= 1;
+        }
+        lo = std::max(hi - bound, 0);
+      }
+      for(int len = hi - lo; len > 1; ) {
+        int half = len / 2;
+        lo = (leaf_key[lo + half] <= key) ? lo + half : lo;
+        len -= half;
+      }
+      return lo;
+    }
+
+    inline int clamp(int pos) const {
+      return std::min(std::max(pos, 0), (int)size_ - 1);
+    }
+
+    stage_1_model_t stage_1;
+    std::vector<T> leaf_key;
+    std::vector<stage_2_model_t> stage_2;
+    std::vector<int> min_err;
+    std::vector<int> max_err;
+    size_t size_;
+};
+
 using NVM::common_alloc;
 template <class T>
 class rmi_model_3 {
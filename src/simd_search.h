@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <x86intrin.h>
+#include "pmem.h"
+
+namespace letree
+{
+
+  /**
+   * @brief C 层节点和 PointerBEntry 内部查找用的向量比较，指令集在编译期按编译选项（-march=native）选择：
+   * 1. AVX-512 一次比较 64 个指纹或 8 个 8 字节字，尾部用带掩码的读取，不会越过数组；
+   * 2. AVX2 一次比较 32 个指纹或 4 个 8 字节字，无符号比较先翻转符号位，key 的尾部用 maskload；
+   * 3. SSE2 只用于指纹，一次 16 个；其他情况退化为标量循环。
+   * 模板参数 isa 默认是编译期选出的 kIsa，基准测试可以显式指定较低的指令集做对比
+   */
+  namespace simd
+  {
+    enum class Isa
+    {
+      Scalar,
+      SSE2,
+      AVX2,
+      AVX512
+    };
+
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+    static constexpr Isa kIsa = Isa::AVX512;
+#elif defined(__AVX2__)
+    static constexpr Isa kIsa = Isa::AVX2;
+#elif defined(__SSE2__)
+    static constexpr Isa kIsa = Isa::SSE2;
+#else
+    static constexpr Isa kIsa = Isa::Scalar;
+#endif
+
+    inline const char *IsaName(Isa isa)
+    {
+      switch (isa)
+      {
+      case Isa::AVX512:
+        return "avx512";
+      case Isa::AVX2:
+        return "avx2";
+      case Isa::SSE2:
+        return "sse2";
+      default:
+        return "scalar";
+      }
+    }
+
+    ALWAYS_INLINE uint64_t LowBits(int n)
+    {
+      return n >= 64 ? ~0UL : (1UL << n) - 1;
+    }
+
+    /**
+     * @brief p[0, n) 中等于 b 的字节，第 i 位对应 p[i]，n <= 64。
+     * AVX2 和 SSE2 按整个向量读取，调用者保证 p 之后按 32 字节取整的范围仍在同一个对象内
+     */
+    template <Isa isa = kIsa>
+    ALWAYS_INLINE uint64_t MatchBytes(const uint8_t *p, uint8_t b, int n)
+    {
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+      if constexpr (isa == Isa::AVX512)
+      {
+        __m512i v = _mm512_maskz_loadu_epi8(LowBits(n), p);
+        return _mm512_mask_cmpeq_epi8_mask(LowBits(n), v, _mm512_set1_epi8(b));
+      }
+#endif
+#ifdef __AVX2__
+      if constexpr (isa == Isa::AVX2)
+      {
+        const __m256i fp = _mm256_set1_epi8(b);
+        uint64_t mask = 0;
+        for (int base = 0; base < n; base += 32)
+        {
+          __m256i v = _mm256_loadu_si256((const __m256i *)(p + base));
+          mask |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, fp)) << base;
+        }
+        return mask & LowBits(n);
+      }
+#endif
+#ifdef __SSE2__
+      if constexpr (isa == Isa::SSE2)
+      {
+        const __m128i fp = _mm_set1_epi8(b);
+        uint64_t mask = 0;
+        for (int base = 0; base < n; base += 16)
+        {
+          __m128i v = _mm_loadu_si128((const __m128i *)(p + base));
+          mask |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, fp)) << base;
+        }
+        return mask & LowBits(n);
+      }
+#endif
+      if constexpr (isa == Isa::Scalar)
+      {
+        uint64_t mask = 0;
+        for (int i = 0; i < n; i++)
+          mask |= (uint64_t)(p[i] == b) << i;
+        return mask;
+      }
+      return MatchBytes<Isa::Scalar>(p, b, n);
+    }
+
+    template <size_t stride>
+    ALWAYS_INLINE uint64_t LoadKey(const void *keys, int i)
+    {
+      return *(const uint64_t *)((const char *)keys + i * stride);
+    }
+
+    /**
+     * @brief 每隔 stride 字节一个的 n 个 8 字节 key 中，第一个大于 target（Strict）或不小于 target 的下标，
+     * 没有时返回 n。stride 为 8（key 连续）或 16（key 和 8 字节值/指针交错）时向量化：
+     * 每 64 个 64 位字先全部比较、合并成一个掩码再取最低位，不在每个向量之后分支，有序节点里位置随机时不会猜错分支
+     */
+    template <size_t stride, bool Strict, Isa isa = kIsa>
+    ALWAYS_INLINE int FirstGreater(const void *keys, uint64_t target, int n)
+    {
+      static_assert(stride == 8 || stride == 16 || isa == Isa::Scalar || isa == Isa::SSE2, "unsupported key stride");
+      constexpr int lanes_per_key = stride / 8;
+      constexpr int keys_per_group = 64 / lanes_per_key;
+      constexpr uint64_t key_lanes = stride == 8 ? ~0UL : 0x5555555555555555UL;
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+      if constexpr (isa == Isa::AVX512)
+      {
+        const __m512i t = _mm512_set1_epi64(target);
+        for (int base = 0; base < n; base += keys_per_group)
+        {
+          int end = std::min(n, base + keys_per_group);
+          uint64_t mask = 0;
+          for (int i = base; i < end; i += 8 / lanes_per_key)
+          {
+            __mmask8 load = LowBits((end - i) * lanes_per_key);
+            __m512i v = _mm512_maskz_loadu_epi64(load, (const char *)keys + i * stride);
+            __mmask8 m = Strict ? _mm512_mask_cmpgt_epu64_mask(load, v, t) : _mm512_mask_cmpge_epu64_mask(load, v, t);
+            mask |= (uint64_t)m << ((i - base) * lanes_per_key);
+          }
+          mask &= key_lanes;
+          if (mask)
+            return base + __builtin_ctzll(mask) / lanes_per_key;
+        }
+        return n;
+      }
+#endif
+#ifdef __AVX2__
+      if constexpr (isa == Isa::AVX2)
+      {
+        const __m256i sign = _mm256_set1_epi64x(0x8000000000000000UL);
+        const __m256i t = _mm256_xor_si256(_mm256_set1_epi64x(target), sign);
+        const __m256i lane_ids = _mm256_set_epi64x(3, 2, 1, 0);
+        for (int base = 0; base < n; base += keys_per_group)
+        {
+          int end = std::min(n, base + keys_per_group);
+          uint64_t mask = 0;
+          for (int i = base; i < end; i += 4 / lanes_per_key)
+          {
+            const char *p = (const char *)keys + i * stride;
+            int lanes = (end - i) * lanes_per_key;
+            __m256i v = lanes >= 4 ? _mm256_loadu_si256((const __m256i *)p)
+                                   : _mm256_maskload_epi64((const long long *)p, _mm256_cmpgt_epi64(_mm256_set1_epi64x(lanes), lane_ids));
+            v = _mm256_xor_si256(v, sign);
+            __m256i c = Strict ? _mm256_cmpgt_epi64(v, t) : _mm256_xor_si256(_mm256_cmpgt_epi64(t, v), _mm256_set1_epi64x(-1));
+            mask |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(c)) << ((i - base) * lanes_per_key);
+          }
+          mask &= key_lanes & LowBits((end - base) * lanes_per_key);
+          if (mask)
+            return base + __builtin_ctzll(mask) / lanes_per_key;
+        }
+        return n;
+      }
+#endif
+      for (int i = 0; i < n; i++)
+      {
+        uint64_t k = LoadKey<stride>(keys, i);
+        if (Strict ? k > target : k >= target)
+          return i;
+      }
+      return n;
+    }
+
+  } // namespace simd
+
+} // namespace letree
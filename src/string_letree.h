@@ -0,0 +1,544 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <functional>
+#include <climits>
+#include "letree.h"
+
+namespace letree
+{
+    /**
+     * @brief 字符串 key 的 letree：
+     * 1. 去掉所有 key 共有的 common_prefix 之后，前 8 个字节按大端转成整数，右移一位作为树中前缀的 key，
+     *    整数的大小顺序和字符串的字典序一致，学习模型直接在这个前缀上训练；
+     * 2. 前缀相同的 key 和它们的值按字典序放在值日志的记录（块）里，完整的 key 保存在 PM 的日志中，
+     *    桶里的 8 字节值低 48 位是块的偏移，块中只有一个 key 时高 16 位是这个 key 的指纹，
+     *    查找不存在的 key 大多在比较指纹时就返回，不需要读日志；
+     * 3. 块超过 block_cap 时分裂，前缀下的块组成一棵写时复制的 B+ 树：内部块的值是子块在树中的 key，
+     *    子块的 key 带最高位，和前缀不冲突，每个块都直接被树引用，值日志回收时按 key 搬迁，父块不需要改写，
+     *    写入只复制一个叶子块，分裂时再改写父块；
+     * 4. 修改一个块时写入新块再替换树中的偏移，分裂出的块先写到新 key 下，父块提交之后才删除旧块，
+     *    同一个前缀的写者用条带锁串行，读者不加锁，只持有值日志的 epoch，读到已删除的子块时从前缀重新查找。
+     */
+    class StringLetree
+    {
+    public:
+        StringLetree(const std::string &common_prefix = "", ConcurrencyMode mode = default_concurrency_mode,
+                     PoolMode pool = TempPool)
+            : common_(common_prefix), tree_(new letree(mode, pool)), next_id_(node_bit)
+        {
+        }
+
+        ~StringLetree()
+        {
+            delete tree_;
+        }
+
+        void Init(size_t log_size = VALUE_LOG_FILE_SIZE)
+        {
+            tree_->Init();
+            tree_->OpenValueLog(log_size);
+        }
+
+        // 从 OpenPool 映射的内存池恢复，common_prefix 需要和上次相同
+        bool Recover(size_t log_size = VALUE_LOG_FILE_SIZE)
+        {
+            if (!tree_->Recover())
+                return false;
+            tree_->OpenValueLog(log_size);
+            // 子块的 key 从已有的最大值之后继续分配
+            tree_->Scan(node_bit, INT_MAX, [this](uint64_t id, uint64_t)
+                        { next_id_.store(id + 1, std::memory_order_relaxed); });
+            return true;
+        }
+
+        // key 已存在时覆盖，key 不以 common_prefix 开头时返回 Failed
+        status Put(std::string_view key, std::string_view value);
+
+        bool Get(std::string_view key, std::string &value);
+
+        bool Delete(std::string_view key);
+
+        /**
+         * @brief 从 start_key 开始按字典序把最多 len 个记录交给 visit(key, value)，
+         * value 直接指向日志，只在 visit 期间有效
+         * @return 访问的记录个数
+         */
+        template <typename Visitor>
+        int Scan(std::string_view start_key, int len, Visitor &&visit);
+
+        letree *tree() const
+        {
+            return tree_;
+        }
+
+        void Info()
+        {
+            tree_->Info();
+        }
+
+    private:
+        static const int nr_stripes = 1024;
+        static const size_t block_cap = 4096;         // 块超过这个大小并且有多个 key 时分裂
+        static const uint32_t inner_flag = 1U << 31;  // 内部块的标记，在 n 的最高位
+        static const uint64_t node_bit = 1UL << 63;   // 分裂出的块在树中的 key 带最高位
+
+        // 块：n 个 1 字节指纹之后是按 key 排列的 (klen, vlen, key, value)，key 不含 common_prefix，
+        // 内部块的 key 是子块中最小的 key，value 是子块在树中的 key
+        struct Block
+        {
+            uint32_t n;
+            uint8_t fp[];
+        };
+
+        struct Entry
+        {
+            std::string_view key;
+            std::string_view value;
+        };
+
+        // 写者路径上的一层：块在树中的 key、块的副本和走向的子块在块中的位置
+        struct Level
+        {
+            uint64_t key;
+            std::string block;
+            int pos;
+        };
+
+        // 依次访问块中的记录
+        class BlockIter
+        {
+        public:
+            explicit BlockIter(const char *block)
+                : n_(((const Block *)block)->n & ~inner_flag), fp_(((const Block *)block)->fp), i_(0),
+                  p_(block + ((sizeof(Block) + n_ + 3) & ~3UL))
+            {
+            }
+
+            bool Valid() const
+            {
+                return i_ < n_;
+            }
+
+            uint8_t fp() const
+            {
+                return fp_[i_];
+            }
+
+            Entry Get() const
+            {
+                uint32_t klen, vlen;
+                memcpy(&klen, p_, 4);
+                memcpy(&vlen, p_ + 4, 4);
+                return {std::string_view(p_ + 8, klen), std::string_view(p_ + 8 + klen, vlen)};
+            }
+
+            void Next()
+            {
+                uint32_t klen, vlen;
+                memcpy(&klen, p_, 4);
+                memcpy(&vlen, p_ + 4, 4);
+                p_ += 8 + klen + vlen;
+                i_++;
+            }
+
+        private:
+            uint32_t n_;
+            const uint8_t *fp_;
+            uint32_t i_;
+            const char *p_;
+        };
+
+        ALWAYS_INLINE bool Accept_(std::string_view key) const
+        {
+            return key.compare(0, common_.size(), common_) == 0;
+        }
+
+        // 去掉 common_prefix 之后的前 8 个字节，大端，右移一位把最高位留给子块
+        ALWAYS_INLINE static uint64_t Prefix_(std::string_view suffix)
+        {
+            uint64_t prefix = 0;
+            memcpy(&prefix, suffix.data(), std::min<size_t>(suffix.size(), 8));
+            return __builtin_bswap64(prefix) >> 1;
+        }
+
+        ALWAYS_INLINE static uint64_t Hash_(std::string_view suffix)
+        {
+            return std::hash<std::string_view>()(suffix);
+        }
+
+        // 块中只有一个 key 时放在偏移的高 16 位，0 表示块中有多个 key 或者是内部块
+        ALWAYS_INLINE static uint64_t Tag_(uint64_t hash)
+        {
+            uint64_t tag = hash >> 48;
+            return tag ? tag : 1;
+        }
+
+        ALWAYS_INLINE static bool Inner_(const char *block)
+        {
+            return ((const Block *)block)->n & inner_flag;
+        }
+
+        ALWAYS_INLINE static uint64_t Id_(std::string_view value)
+        {
+            uint64_t id;
+            memcpy(&id, value.data(), sizeof(id));
+            return id;
+        }
+
+        ALWAYS_INLINE const char *Block_(uint64_t word) const
+        {
+            return tree_->vlog_->Read(word)->data;
+        }
+
+        std::mutex &Stripe_(uint64_t prefix)
+        {
+            return stripes_[(prefix * 0x9e3779b97f4a7c15UL) >> 54];
+        }
+
+        // 内部块中 key 不大于 suffix 的最后一项，都大于 suffix 时是第一项
+        static Entry Child_(const char *block, std::string_view suffix, int *pos = nullptr);
+
+        // 从前缀向下找到 suffix 所在的叶子块，子块被并发的分裂删除时从前缀重新查找，前缀不存在时返回 nullptr
+        const char *Leaf_(uint64_t prefix, std::string_view suffix, uint64_t &word);
+
+        // 写者在条带锁下复制从前缀到叶子的路径，前缀不存在时 path 为空
+        void Path_(uint64_t prefix, std::string_view suffix, std::vector<Level> &path);
+
+        // 按顺序访问以 block 为根的子树中不小于 start 的记录，读到已删除的子块时返回 false
+        template <typename Visitor>
+        bool Visit_(const char *block, std::string_view start, int len, int &n, std::string &key, Visitor &visit);
+
+        static void Load_(const char *block, std::vector<Entry> &entries);
+
+        static void Store_(const Entry *entries, size_t n, bool inner, std::string &out);
+
+        // 把 path 第 depth 层的块改成 entries，写满时分裂并修改父块，块为空时从父块中删除
+        status Write_(std::vector<Level> &path, size_t depth, const std::vector<Entry> &entries);
+
+        // 写入新块并替换树中 key 的偏移
+        status Commit_(uint64_t key, const std::string &block, uint64_t tag);
+
+        void Remove_(uint64_t key);
+
+        std::string common_;
+        letree *tree_;
+        std::atomic<uint64_t> next_id_;
+        std::mutex stripes_[nr_stripes];
+    };
+
+    StringLetree::Entry StringLetree::Child_(const char *block, std::string_view suffix, int *pos)
+    {
+        BlockIter it(block);
+        Entry child = it.Get();
+        int i = 0, at = 0;
+        for (it.Next(), i++; it.Valid(); it.Next(), i++)
+        {
+            Entry e = it.Get();
+            if (e.key > suffix)
+                break;
+            child = e;
+            at = i;
+        }
+        if (pos)
+            *pos = at;
+        return child;
+    }
+
+    const char *StringLetree::Leaf_(uint64_t prefix, std::string_view suffix, uint64_t &word)
+    {
+        while (tree_->Get(prefix, word))
+        {
+            const char *block = Block_(word);
+            while (Inner_(block) && tree_->Get(Id_(Child_(block, suffix).value), word))
+                block = Block_(word);
+            if (!Inner_(block))
+                return block;
+        }
+        return nullptr;
+    }
+
+    void StringLetree::Path_(uint64_t prefix, std::string_view suffix, std::vector<Level> &path)
+    {
+        EpochManager::Guard guard(tree_->vlog_epoch());
+        path.clear();
+        uint64_t key = prefix, word;
+        while (tree_->Get(key, word))
+        {
+            const ValueLog::Record *r = tree_->vlog_->Read(word);
+            path.push_back({key, std::string(r->data, r->len), 0});
+            if (!Inner_(r->data))
+                break;
+            key = Id_(Child_(r->data, suffix, &path.back().pos).value);
+        }
+    }
+
+    void StringLetree::Load_(const char *block, std::vector<Entry> &entries)
+    {
+        entries.clear();
+        for (BlockIter it(block); it.Valid(); it.Next())
+            entries.push_back(it.Get());
+    }
+
+    void StringLetree::Store_(const Entry *entries, size_t n, bool inner, std::string &out)
+    {
+        size_t head = (sizeof(Block) + n + 3) & ~3UL;
+        size_t size = head;
+        for (size_t i = 0; i < n; i++)
+            size += 8 + entries[i].key.size() + entries[i].value.size();
+        out.resize(size);
+        char *p = &out[0];
+        ((Block *)p)->n = n | (inner ? inner_flag : 0);
+        char *q = p + head;
+        for (size_t i = 0; i < n; i++)
+        {
+            ((Block *)p)->fp[i] = (uint8_t)Hash_(entries[i].key);
+            uint32_t klen = entries[i].key.size(), vlen = entries[i].value.size();
+            memcpy(q, &klen, 4);
+            memcpy(q + 4, &vlen, 4);
+            memcpy(q + 8, entries[i].key.data(), klen);
+            memcpy(q + 8 + klen, entries[i].value.data(), vlen);
+            q += 8 + klen + vlen;
+        }
+    }
+
+    status StringLetree::Write_(std::vector<Level> &path, size_t depth, const std::vector<Entry> &entries)
+    {
+        uint64_t key = path[depth].key;
+        bool inner = depth + 1 < path.size();
+        std::vector<Entry> parent;
+        if (entries.empty())
+        {
+            if (depth == 0)
+            {
+                Remove_(key);
+                return status::OK;
+            }
+            Load_(path[depth - 1].block.data(), parent);
+            parent.erase(parent.begin() + path[depth - 1].pos);
+            status s = Write_(path, depth - 1, parent);
+            if (s == status::OK)
+                Remove_(key);
+            return s;
+        }
+        std::string block;
+        Store_(entries.data(), entries.size(), inner, block);
+        if (block.size() <= block_cap || entries.size() == 1)
+            return Commit_(key, block, !inner && entries.size() == 1 ? Tag_(Hash_(entries[0].key)) : 0);
+
+        // 分成大小接近的几块写到新的 key 下，读者在父块提交之前仍然读旧块
+        size_t target = block.size() / ((block.size() + block_cap - 1) / block_cap);
+        std::vector<size_t> bounds(1, 0);
+        size_t bytes = 0;
+        for (size_t i = 0; i < entries.size(); i++)
+        {
+            if (bytes >= target)
+            {
+                bounds.push_back(i);
+                bytes = 0;
+            }
+            bytes += 8 + entries[i].key.size() + entries[i].value.size();
+        }
+        bounds.push_back(entries.size());
+        size_t pieces = bounds.size() - 1;
+        std::vector<uint64_t> ids(pieces);
+        std::vector<Entry> children(pieces);
+        for (size_t i = 0; i < pieces; i++)
+        {
+            size_t n = bounds[i + 1] - bounds[i];
+            ids[i] = next_id_.fetch_add(1, std::memory_order_relaxed);
+            Store_(entries.data() + bounds[i], n, inner, block);
+            status s = Commit_(ids[i], block, !inner && n == 1 ? Tag_(Hash_(entries[bounds[i]].key)) : 0);
+            if (s != status::OK)
+                return s;
+            children[i] = {entries[bounds[i]].key, std::string_view((const char *)&ids[i], sizeof(uint64_t))};
+        }
+        if (depth == 0)
+        {
+            // 前缀的根块分裂，树长高一层
+            Store_(children.data(), pieces, true, block);
+            return Commit_(key, block, 0);
+        }
+        const Level &up = path[depth - 1];
+        Load_(up.block.data(), parent);
+        parent[up.pos].value = children[0].value;
+        parent.insert(parent.begin() + up.pos + 1, children.begin() + 1, children.end());
+        status s = Write_(path, depth - 1, parent);
+        if (s == status::OK)
+            Remove_(key);
+        return s;
+    }
+
+    status StringLetree::Commit_(uint64_t key, const std::string &block, uint64_t tag)
+    {
+        ValueLog *vlog = tree_->vlog_;
+        if (block.size() > vlog->MaxValueSize())
+            return status::Failed;
+        uint64_t offset = tree_->AppendValue_(key, block.data(), block.size());
+        if (offset == 0)
+            return status::Full;
+        offset |= tag << 48;
+        {
+            EpochManager::Guard guard(tree_->vlog_epoch());
+            uint64_t old;
+            if (tree_->Upsert_(key, offset, &old) == status::Exist)
+                vlog->Release(old);
+        }
+        tree_->WakeCollector_();
+        return status::OK;
+    }
+
+    void StringLetree::Remove_(uint64_t key)
+    {
+        EpochManager::Guard guard(tree_->vlog_epoch());
+        uint64_t old;
+        if (tree_->Delete_(key, &old))
+            tree_->vlog_->Release(old);
+    }
+
+    status StringLetree::Put(std::string_view key, std::string_view value)
+    {
+        if (!Accept_(key))
+            return status::Failed;
+        std::string_view suffix = key.substr(common_.size());
+        uint64_t prefix = Prefix_(suffix);
+        // 写入路径上复用的缓冲区，避免每次分配
+        static thread_local std::vector<Level> path;
+        static thread_local std::vector<Entry> entries;
+        std::lock_guard<std::mutex> lock(Stripe_(prefix));
+        Path_(prefix, suffix, path);
+        entries.clear();
+        if (path.empty())
+            path.push_back({prefix, std::string(), 0});
+        else
+            Load_(path.back().block.data(), entries);
+        auto it = std::lower_bound(entries.begin(), entries.end(), suffix, [](const Entry &e, std::string_view k)
+                                   { return e.key < k; });
+        if (it != entries.end() && it->key == suffix)
+            it->value = value;
+        else
+            entries.insert(it, {suffix, value});
+        return Write_(path, path.size() - 1, entries);
+    }
+
+    bool StringLetree::Get(std::string_view key, std::string &value)
+    {
+        if (!Accept_(key))
+            return false;
+        std::string_view suffix = key.substr(common_.size());
+        uint64_t hash = Hash_(suffix);
+        EpochManager::Guard guard(tree_->vlog_epoch());
+        uint64_t word = 0;
+        const char *block = Leaf_(Prefix_(suffix), suffix, word);
+        if (block == nullptr)
+            return false;
+        uint64_t tag = word >> 48;
+        if (tag != 0 && tag != Tag_(hash))
+            return false;
+        for (BlockIter it(block); it.Valid(); it.Next())
+        {
+            if (it.fp() != (uint8_t)hash)
+                continue;
+            Entry e = it.Get();
+            if (e.key == suffix)
+            {
+                value.assign(e.value.data(), e.value.size());
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool StringLetree::Delete(std::string_view key)
+    {
+        if (!Accept_(key))
+            return false;
+        std::string_view suffix = key.substr(common_.size());
+        uint64_t prefix = Prefix_(suffix);
+        static thread_local std::vector<Level> path;
+        static thread_local std::vector<Entry> entries;
+        std::lock_guard<std::mutex> lock(Stripe_(prefix));
+        Path_(prefix, suffix, path);
+        if (path.empty())
+            return false;
+        Load_(path.back().block.data(), entries);
+        auto it = std::lower_bound(entries.begin(), entries.end(), suffix, [](const Entry &e, std::string_view k)
+                                   { return e.key < k; });
+        if (it == entries.end() || it->key != suffix)
+            return false;
+        entries.erase(it);
+        return Write_(path, path.size() - 1, entries) == status::OK;
+    }
+
+    template <typename Visitor>
+    bool StringLetree::Visit_(const char *block, std::string_view start, int len, int &n, std::string &key,
+                              Visitor &visit)
+    {
+        if (!Inner_(block))
+        {
+            for (BlockIter it(block); it.Valid() && n < len; it.Next())
+            {
+                Entry e = it.Get();
+                if (e.key < start)
+                    continue;
+                key.resize(common_.size());
+                key.append(e.key.data(), e.key.size());
+                visit(key, e.value);
+                n++;
+            }
+            return true;
+        }
+        int pos, i = 0;
+        Child_(block, start, &pos);
+        for (BlockIter it(block); it.Valid() && n < len; it.Next(), i++)
+        {
+            uint64_t word = 0;
+            if (i < pos)
+                continue;
+            if (!tree_->Get(Id_(it.Get().value), word) || !Visit_(Block_(word), start, len, n, key, visit))
+                return false;
+        }
+        return true;
+    }
+
+    template <typename Visitor>
+    int StringLetree::Scan(std::string_view start_key, int len, Visitor &&visit)
+    {
+        std::string start(start_key.compare(0, common_.size(), common_) < 0
+                              ? std::string_view()
+                              : start_key.substr(common_.size()));
+        if (start_key.compare(0, common_.size(), common_) > 0)
+            return 0;
+        std::string key = common_;
+        uint64_t from = Prefix_(start);
+        int n = 0;
+        EpochManager::Guard guard(tree_->vlog_epoch());
+        std::vector<std::pair<uint64_t, uint64_t>> roots;
+        while (n < len)
+        {
+            // 每个前缀至少有一个 key，取 len - n 个前缀一定够用，除非第一个前缀里有小于 start 的 key
+            int want = len - n, got = 0;
+            roots.clear();
+            tree_->Scan(from, want, [&roots, &got](uint64_t prefix, uint64_t word)
+                        { got++;
+                          if (prefix < node_bit)
+                              roots.emplace_back(prefix, word); });
+            for (auto &r : roots)
+            {
+                uint64_t word = r.second;
+                // 子块被并发的分裂删除时重新读前缀的根块，从访问过的最后一个 key 之后继续
+                while (!Visit_(Block_(word), start, len, n, key, visit) && tree_->Get(r.first, word))
+                {
+                    if (n > 0)
+                        start.assign(key, common_.size()).push_back('\0');
+                }
+            }
+            if (got < want || (int)roots.size() < got)
+                break;
+            from = roots.back().first + 1;
+        }
+        return n;
+    }
+
+} // namespace letree
@@ -0,0 +1,446 @@
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+#include <libpmem.h>
+#include <x86intrin.h>
+#include "letree_config.h"
+#include "nvm_alloc.h"
+#include "clevel.h"
+#include "epoch.h"
+
+namespace letree
+{
+
+  /**
+   * @brief 键值分离用的 PM 值日志，变长的值追加到日志里，树中只保存 8 字节的日志偏移
+   * 1. 日志文件按 segment_size 切成段，每个线程映射到一个追加头，各自追加到自己的段，段写满后封存；
+   * 2. 记录带 crc，种子是段的分配序号，崩溃后未封存的段从头扫描到第一个校验失败的记录为止，
+   *    段被回收重用后上一轮留下的旧记录也会因为序号不同而校验失败；
+   * 3. 每个段在 DRAM 中记录存活字节数，回收时选存活比例最低的封存段，存活检查和搬迁由调用者完成，
+   *    段在 epoch 同步之后才释放，释放前开始读这个段的读者都已经结束。
+   */
+  class ValueLog
+  {
+  public:
+    struct Record
+    {
+      uint64_t key;
+      uint32_t len;
+      uint32_t crc;
+      char data[];
+
+      size_t Size() const
+      {
+        return RecordSize(len);
+      }
+    };
+
+    static const size_t head_size = 4096;           // 日志文件头，之后是各个段
+    static const size_t segment_head_size = 64;     // 段头：分配序号和封存时的长度
+    static const size_t default_segment_size = 4UL << 20;
+    static const int max_heads = EpochManager::max_slots;
+    static const int gc_reserve = 2;                // 只留给回收搬迁使用的空闲段数
+    static const uint64_t offset_mask = (1UL << 48) - 1; // 树中保存的值低 48 位是偏移，高 16 位留给使用者做标记
+
+    static size_t RecordSize(uint32_t len)
+    {
+      return (sizeof(Record) + len + 7) & ~7UL;
+    }
+
+    /**
+     * @param mode 和 C 层内存池相同，OpenPool 时映射已有的日志，封存上次没有封存的段
+     */
+    ValueLog(const std::string &file, size_t file_size, PoolMode mode = TempPool,
+             size_t segment_size = default_segment_size)
+        : file_(mode == TempPool ? file + std::to_string(NextFileId()) : file), mode_(mode), opened_(false)
+    {
+      int is_pmem;
+      if (mode == OpenPool && std::filesystem::exists(file_))
+      {
+        base_ = (char *)pmem_map_file(file_.c_str(), 0, 0, 0666, &mapped_len_, &is_pmem);
+        opened_ = base_ != nullptr && head()->magic == LogHead::kMagic;
+      }
+      else
+      {
+        std::filesystem::remove(file_);
+        base_ = (char *)pmem_map_file(file_.c_str(), file_size, PMEM_FILE_CREATE | PMEM_FILE_EXCL, 0666,
+                                      &mapped_len_, &is_pmem);
+      }
+      if (base_ == nullptr)
+      {
+        perror("ValueLog::ValueLog(): pmem_map_file");
+        exit(1);
+      }
+      if (!opened_)
+      {
+        head()->magic = 0;
+        head()->segment_size = segment_size;
+        // 段从 segment_size 对齐的位置开始，文件头之后不足一个段的部分不用
+        head()->nr_segments = mapped_len_ / segment_size - (head_size + segment_size - 1) / segment_size;
+        pmem_persist(head(), sizeof(LogHead));
+        head()->magic = LogHead::kMagic;
+        pmem_persist(&head()->magic, sizeof(uint64_t));
+      }
+      segment_size_ = head()->segment_size;
+      nr_segments_ = head()->nr_segments;
+      segments_ = new Segment[nr_segments_];
+      for (int i = 0; i <= max_heads; i++)
+        heads_[i].segment = -1;
+      Load_();
+    }
+
+    ~ValueLog()
+    {
+      for (int i = 0; i <= max_heads; i++)
+      {
+        if (heads_[i].segment >= 0)
+          Seal_(heads_[i].segment, heads_[i].tail);
+      }
+      delete[] segments_;
+      pmem_unmap(base_, mapped_len_);
+      if (mode_ == TempPool)
+        std::filesystem::remove(file_);
+    }
+
+    ValueLog(const ValueLog &) = delete;
+    ValueLog &operator=(const ValueLog &) = delete;
+
+    // 是否从已有的日志恢复，此时存活字节数需要调用者通过 AddLive 重新统计
+    bool Opened() const
+    {
+      return opened_;
+    }
+
+    /**
+     * @brief 追加一条记录并持久化
+     * @param gc 回收搬迁使用单独的追加头，并且可以使用预留的空闲段
+     * @return 记录的偏移，没有空闲段时返回 0
+     */
+    uint64_t Append(uint64_t key, const void *data, uint32_t len, bool gc = false)
+    {
+      size_t size = RecordSize(len);
+      if (size > segment_size_ - segment_head_size)
+        return 0;
+      Head &h = heads_[gc ? max_heads : ThreadSlot()];
+      std::lock_guard<std::mutex> lock(h.lock);
+      if (h.segment < 0 || h.tail + size > segment_size_)
+      {
+        if (h.segment >= 0)
+          Seal_(h.segment, h.tail);
+        h.segment = NewSegment_(gc);
+        if (h.segment < 0)
+          return 0;
+        h.tail = segment_head_size;
+      }
+      uint64_t offset = SegmentOffset(h.segment) + h.tail;
+      Record *r = (Record *)(base_ + offset);
+      r->key = key;
+      r->len = len;
+      memcpy(r->data, data, len);
+      r->crc = Crc_(segments_[h.segment].seq, r);
+      NVM::Mem_persist(r, size);
+      h.tail += size;
+      segments_[h.segment].live.fetch_add(size, std::memory_order_relaxed);
+      return offset;
+    }
+
+    // 一条记录要放进一个段里
+    size_t MaxValueSize() const
+    {
+      return segment_size_ - segment_head_size - sizeof(Record);
+    }
+
+    // 给写者用的快速检查，空闲段不多时通知回收
+    bool LowOnSpace() const
+    {
+      return FreeSegments() < std::max<size_t>(nr_segments_ / 8, gc_reserve + 2);
+    }
+
+    ALWAYS_INLINE const Record *Read(uint64_t offset) const
+    {
+      return (const Record *)(base_ + (offset & offset_mask));
+    }
+
+    // 记录被覆盖或删除，扣减所在段的存活字节数
+    void Release(uint64_t offset)
+    {
+      segments_[(offset & offset_mask) / segment_size_ - SegmentBase()].live.fetch_sub(Read(offset)->Size(), std::memory_order_relaxed);
+    }
+
+    // 恢复时对树中引用的每条记录调用一次
+    void AddLive(uint64_t offset)
+    {
+      segments_[(offset & offset_mask) / segment_size_ - SegmentBase()].live.fetch_add(Read(offset)->Size(), std::memory_order_relaxed);
+    }
+
+    // 读者在读取偏移和记录期间持有，回收的段在所有读者退出之后才重用
+    EpochManager *epoch()
+    {
+      return &epoch_;
+    }
+
+    size_t FreeSegments() const
+    {
+      return nr_free_.load(std::memory_order_relaxed);
+    }
+
+    // 空闲段少于 1/8，或者封存段中一半以上是垃圾时需要回收，需要遍历所有段，只给回收线程使用
+    bool NeedCollect() const
+    {
+      if (LowOnSpace())
+        return true;
+      uint64_t live = 0, used = 0;
+      for (size_t i = 0; i < nr_segments_; i++)
+      {
+        if (segments_[i].sealed.load(std::memory_order_acquire))
+        {
+          live += segments_[i].live.load(std::memory_order_relaxed);
+          used += segments_[i].tail - segment_head_size;
+        }
+      }
+      return used > 0 && live * 2 < used;
+    }
+
+    /**
+     * @brief 回收存活比例最低且低于 max_live_ratio 的一个封存段。
+     * relocate(offset, record) 检查记录是否仍被树引用（比较时忽略高 16 位的标记），是则用 Append(..., true) 搬迁并改写树中的偏移，
+     * 返回 false 表示无法搬迁（没有空闲段），此时放弃这个段
+     * @return 回收的字节数，没有可回收的段时返回 0
+     */
+    template <typename Relocate>
+    size_t Collect(Relocate &&relocate, double max_live_ratio = 0.5)
+    {
+      std::lock_guard<std::mutex> lock(gc_lock_);
+      int victim = -1;
+      double victim_ratio = max_live_ratio;
+      for (size_t i = 0; i < nr_segments_; i++)
+      {
+        if (!segments_[i].sealed.load(std::memory_order_acquire) || segments_[i].tail == segment_head_size)
+          continue;
+        double ratio = 1.0 * segments_[i].live.load(std::memory_order_relaxed) / (segments_[i].tail - segment_head_size);
+        if (ratio < victim_ratio)
+        {
+          victim = i;
+          victim_ratio = ratio;
+        }
+      }
+      if (victim < 0)
+        return 0;
+      uint64_t begin = SegmentOffset(victim);
+      for (uint64_t pos = segment_head_size; pos < segments_[victim].tail;)
+      {
+        const Record *r = Read(begin + pos);
+        if (!relocate(begin + pos, r))
+          return 0;
+        pos += r->Size();
+      }
+      size_t reclaimed = segments_[victim].tail - segment_head_size;
+      // 此后树中不再有指向 victim 的偏移，等待之前读到旧偏移的读者和扣减存活字节的写者结束
+      epoch_.Synchronize();
+      FreeSegment_(victim);
+      collected_bytes_ += reclaimed;
+      collect_times_++;
+      return reclaimed;
+    }
+
+    void Info() const
+    {
+      uint64_t live = 0;
+      for (size_t i = 0; i < nr_segments_; i++)
+        live += segments_[i].live.load(std::memory_order_relaxed);
+      std::cout << "value log : " << file_ << ", " << nr_segments_ << " segments of " << segment_size_
+                << " bytes, " << FreeSegments() << " free, live " << live << " bytes, collected "
+                << collected_bytes_ << " bytes in " << collect_times_ << " times" << std::endl;
+    }
+
+  private:
+    struct LogHead
+    {
+      static const uint64_t kMagic = 0x4c45564c4f473031UL; // "LEVLOG01"
+
+      uint64_t magic;
+      uint64_t segment_size;
+      uint64_t nr_segments;
+    };
+
+    // 段头，seq 为 0 表示空闲，tail 为 0 表示还没有封存
+    struct SegmentHead
+    {
+      uint64_t seq;
+      uint64_t tail;
+    };
+
+    struct Segment
+    {
+      std::atomic<uint64_t> live{0};
+      uint64_t seq = 0;
+      uint64_t tail = 0;
+      std::atomic<bool> sealed{false}; // 封存后 tail 不再变化，回收线程只选封存的段
+    };
+
+    struct alignas(64) Head
+    {
+      std::mutex lock;
+      int segment;
+      uint64_t tail;
+    };
+
+    static int NextFileId()
+    {
+      static std::atomic<int> file_id(0);
+      return file_id.fetch_add(1);
+    }
+
+    static int ThreadSlot()
+    {
+      static std::atomic<int> next_slot(0);
+      static thread_local int slot = next_slot.fetch_add(1) % max_heads;
+      return slot;
+    }
+
+    static uint32_t Crc_(uint64_t seq, const Record *r)
+    {
+      uint64_t crc = _mm_crc32_u64((uint32_t)seq, r->key);
+      crc = _mm_crc32_u32(crc, r->len);
+      const char *p = r->data;
+      uint32_t i = 0;
+      for (; i + 8 <= r->len; i += 8)
+        crc = _mm_crc32_u64(crc, *(const uint64_t *)(p + i));
+      for (; i < r->len; i++)
+        crc = _mm_crc32_u8(crc, p[i]);
+      return crc;
+    }
+
+    LogHead *head() const
+    {
+      return (LogHead *)base_;
+    }
+
+    // 段在文件中按 segment_size 对齐，offset / segment_size_ 减去这个值就是段号
+    uint64_t SegmentBase() const
+    {
+      return (head_size + segment_size_ - 1) / segment_size_;
+    }
+
+    uint64_t SegmentOffset(int segment) const
+    {
+      return (SegmentBase() + segment) * segment_size_;
+    }
+
+    SegmentHead *segment_head(int segment) const
+    {
+      return (SegmentHead *)(base_ + SegmentOffset(segment));
+    }
+
+    // 恢复各段状态：封存段直接使用段头，未封存的段扫描出有效记录后封存
+    void Load_()
+    {
+      uint64_t max_seq = 0;
+      for (size_t i = 0; i < nr_segments_; i++)
+      {
+        SegmentHead *sh = segment_head(i);
+        if (!opened_)
+        {
+          sh->seq = 0;
+          sh->tail = 0;
+          pmem_persist(sh, sizeof(SegmentHead));
+        }
+        Segment &s = segments_[i];
+        s.seq = sh->seq;
+        if (s.seq == 0)
+        {
+          free_.push_back(i);
+          continue;
+        }
+        max_seq = std::max(max_seq, s.seq);
+        uint64_t tail = sh->tail;
+        if (tail == 0)
+        {
+          tail = segment_head_size;
+          while (tail + sizeof(Record) <= segment_size_)
+          {
+            const Record *r = Read(SegmentOffset(i) + tail);
+            if (tail + r->Size() > segment_size_ || r->len > segment_size_ || r->crc != Crc_(s.seq, r))
+              break;
+            tail += r->Size();
+          }
+        }
+        if (tail == segment_head_size)
+        {
+          FreeSegment_(i);
+          continue;
+        }
+        Seal_(i, tail);
+      }
+      next_seq_ = max_seq + 1;
+      nr_free_.store(free_.size(), std::memory_order_relaxed);
+    }
+
+    int NewSegment_(bool gc)
+    {
+      std::lock_guard<std::mutex> lock(free_lock_);
+      if (free_.empty() || (!gc && free_.size() <= gc_reserve))
+        return -1;
+      int segment = free_.back();
+      free_.pop_back();
+      nr_free_.store(free_.size(), std::memory_order_relaxed);
+      Segment &s = segments_[segment];
+      s.seq = next_seq_++;
+      s.tail = 0;
+      s.sealed.store(false, std::memory_order_relaxed);
+      s.live.store(0, std::memory_order_relaxed);
+      // 释放时 tail 已经清零，只需要写入序号
+      segment_head(segment)->seq = s.seq;
+      pmem_persist(segment_head(segment), sizeof(SegmentHead));
+      return segment;
+    }
+
+    void Seal_(int segment, uint64_t tail)
+    {
+      segment_head(segment)->tail = tail;
+      pmem_persist(segment_head(segment), sizeof(SegmentHead));
+      segments_[segment].tail = tail;
+      segments_[segment].sealed.store(true, std::memory_order_release);
+    }
+
+    void FreeSegment_(int segment)
+    {
+      SegmentHead *sh = segment_head(segment);
+      sh->seq = 0;
+      pmem_persist(sh, sizeof(SegmentHead));
+      sh->tail = 0;
+      pmem_persist(sh, sizeof(SegmentHead));
+      Segment &s = segments_[segment];
+      s.seq = 0;
+      s.tail = 0;
+      s.sealed.store(false, std::memory_order_relaxed);
+      s.live.store(0, std::memory_order_relaxed);
+      std::lock_guard<std::mutex> lock(free_lock_);
+      free_.push_back(segment);
+      nr_free_.store(free_.size(), std::memory_order_relaxed);
+    }
+
+    std::string file_;
+    PoolMode mode_;
+    bool opened_;
+    char *base_;
+    size_t mapped_len_;
+    size_t segment_size_;
+    size_t nr_segments_;
+    Segment *segments_;
+    Head heads_[max_heads + 1]; // 最后一个给回收搬迁使用
+    std::mutex free_lock_;
+    std::vector<int> free_;
+    std::atomic<size_t> nr_free_{0};
+    uint64_t next_seq_ = 1;
+    std::mutex gc_lock_;
+    EpochManager epoch_;
+    uint64_t collected_bytes_ = 0;
+    uint64_t collect_times_ = 0;
+  };
+
+} // namespace letree
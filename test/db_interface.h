@@ -13,6 +13,7 @@
 #include "xindex/xindex_impl.h"
 #include "alex/alex.h"
 #include "../src/letree.h"
+#include "../src/string_letree.h"
 #include "random.h"
 #include "lipp/lipp.h"
 
@@ -564,21 +565,30 @@ namespace dbInter
     }
 
   public:
-    LetDB() : let_(nullptr) {}
-    LetDB(letree::letree *root) : let_(root) {}
+    LetDB() : let_(nullptr), mode_(letree::default_concurrency_mode), pool_(letree::TempPool) {}
+    LetDB(letree::ConcurrencyMode mode, letree::PoolMode pool = letree::TempPool) : let_(nullptr), mode_(mode), pool_(pool) {}
+    LetDB(letree::letree *root) : let_(root), mode_(root->mode()), pool_(letree::TempPool) {}
     virtual ~LetDB()
     {
       delete let_;
     }
 
+    // OpenPool 时先尝试从上次保留的内存池恢复，没有可恢复的树时新建
     void Init()
     {
-      NVM::data_init();
-      let_ = new letree::letree();
-      let_->Init();
+      NVM::data_init(pool_ == letree::OpenPool);
+      let_ = new letree::letree(mode_, pool_);
+      if (pool_ != letree::OpenPool || !let_->Recover())
+        let_->Init();
       NVM::pmem_size = 0;
     }
 
+    // Init 之后调用，0 表示关闭读缓存
+    void SetReadCache(size_t bytes)
+    {
+      let_->SetReadCache(bytes);
+    }
+
     void Info()
     {
       // std::cout << "NVM WRITE : " << NVM::pmem_size << std::endl;
@@ -598,11 +608,23 @@ namespace dbInter
       return 1;
     }
 
+    int MultiPut(const std::pair<uint64_t, uint64_t> data[], int size)
+    {
+      let_->MultiPut(data, size);
+      return 1;
+    }
+
     int Get(uint64_t key, uint64_t &value)
     {
       let_->Get(key, value);
       return 1;
     }
+
+    int MultiGet(const uint64_t keys[], int size, uint64_t values[])
+    {
+      let_->MultiGet(keys, size, values);
+      return 1;
+    }
     int Delete(uint64_t key)
     {
       let_->Delete(key);
@@ -618,6 +640,10 @@ namespace dbInter
       let_->Scan(start_key, len, results);
       return 1;
     }
+    int Scan(uint64_t start_key, int len, std::pair<uint64_t, uint64_t> results[])
+    {
+      return let_->Scan(start_key, len, results);
+    }
 
     void Begin_trans()
     {
@@ -630,6 +656,99 @@ namespace dbInter
 
   private:
     letree::letree *let_;
+    letree::ConcurrencyMode mode_;
+    letree::PoolMode pool_;
+  };
+
+  /**
+   * @brief 字符串 key 的 FAST&FAIR 基线：FAST&FAIR 只支持 8 字节 key，和 StringLetree 一样
+   * 用去掉公共前缀之后的前 8 个字节做 key，前缀相同的 key 在 PM 上链成链表，节点保存完整的 key 和值
+   */
+  class FastFairStringDb
+  {
+    struct Record
+    {
+      Record *next;
+      uint32_t klen;
+      uint32_t vlen;
+      char data[];
+
+      string_view key() const { return string_view(data, klen); }
+      string_view value() const { return string_view(data + klen, vlen); }
+    };
+
+  public:
+    explicit FastFairStringDb(const string &common_prefix = "") : common_(common_prefix), tree_(nullptr) {}
+
+    void Init()
+    {
+      NVM::data_init();
+      tree_ = new btree();
+    }
+
+    // key 已存在时新节点替换链表中的旧节点
+    int Put(string_view key, string_view value)
+    {
+      string_view suffix = key.substr(common_.size());
+      uint64_t prefix = Prefix(suffix);
+      Record *r = (Record *)NVM::data_alloc->alloc(sizeof(Record) + suffix.size() + value.size());
+      r->klen = suffix.size();
+      r->vlen = value.size();
+      memcpy(r->data, suffix.data(), suffix.size());
+      memcpy(r->data + suffix.size(), value.data(), value.size());
+      Record *head = (Record *)tree_->btree_search(prefix);
+      Record **link = &head;
+      while (*link && (*link)->key() != suffix)
+        link = &(*link)->next;
+      r->next = *link ? (*link)->next : (head ? head->next : nullptr);
+      NVM::Mem_persist(r, sizeof(Record) + suffix.size() + value.size());
+      if (head == nullptr)
+      {
+        tree_->btree_insert(prefix, (char *)r);
+      }
+      else if (*link == head)
+      {
+        tree_->btree_delete(prefix);
+        tree_->btree_insert(prefix, (char *)r);
+      }
+      else if (*link)
+      {
+        *link = r;
+        NVM::Mem_persist(link, sizeof(Record *));
+      }
+      else
+      {
+        // 新 key 插在链表头之后，不需要修改树
+        head->next = r;
+        NVM::Mem_persist(&head->next, sizeof(Record *));
+      }
+      return 1;
+    }
+
+    bool Get(string_view key, string &value)
+    {
+      string_view suffix = key.substr(common_.size());
+      for (Record *r = (Record *)tree_->btree_search(Prefix(suffix)); r; r = r->next)
+      {
+        if (r->key() == suffix)
+        {
+          value.assign(r->value().data(), r->vlen);
+          return true;
+        }
+      }
+      return false;
+    }
+
+  private:
+    static uint64_t Prefix(string_view suffix)
+    {
+      uint64_t prefix = 0;
+      memcpy(&prefix, suffix.data(), min<size_t>(suffix.size(), 8));
+      return __builtin_bswap64(prefix);
+    }
+
+    string common_;
+    btree *tree_;
   };
 
 } // namespace dbInter
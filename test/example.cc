@@ -1,6 +1,9 @@
+#include <map>
+#include <random>
 #include "getopt.h"
 #include "db_interface.h"
 #include "util.h"
+#include "ycsb/core/scrambled_zipfian_generator.h"
 
 using letree::Random;
 using ycsbc::KvDB;
@@ -15,6 +18,17 @@ void show_help(char *prog)
        << "    --load-size              LOAD_SIZE" << endl
        << "    --put-size               PUT_SIZE" << endl
        << "    --get-size               GET_SIZE" << endl
+       << "    --mode                   single | multi | background" << endl
+       << "    --multiget               compare Get with MultiGet of batch 8/16/32" << endl
+       << "    --scan                   compare Scan into a vector with Scan into a buffer" << endl
+       << "    --recover                keep the PM pools, reopen them and time recovery against loading" << endl
+       << "    --read-cache             BYTES, compare zipfian Get without and with a DRAM read cache" << endl
+       << "    --value-log              COUNT, put/overwrite/delete COUNT values of 100B-4KB through the value log" << endl
+       << "    --string-keys            COUNT, compare StringLetree with FAST&FAIR on COUNT ycsb-style string keys" << endl
+       << "    --typed                  COUNT, run put/get/scan/delete on COUNT keys with 32/4, 64/8 and 128/16 bit keys/byte values" << endl
+       << "    --delete-range           COUNT, delete ranges of 1 to 1000 keys from COUNT keys and check counts, Get and Scan against std::map" << endl
+       << "    --range-scan             COUNT, check ScanRange, ReverseScan and Iter Seek/SeekForPrev/next/prev on COUNT keys against std::map" << endl
+       << "    --multiput               COUNT, load COUNT keys with MultiPut between scans that turn nodes sorted, then check Get and Scan" << endl
        << "    --help[-h]               show help" << endl;
 }
 
@@ -37,18 +51,136 @@ vector<uint64_t> generate_uniform_random(size_t op_num)
   return data;
 }
 
+// the same workload on one key/value width, reports records per C-level node and C-level bytes per key
+template <typename Key, size_t value_size>
+void typed_bench(const vector<uint64_t> &ids, letree::ConcurrencyMode mode)
+{
+  typedef letree::basic_letree<Key, value_size> tree_t;
+  typedef typename tree_t::value_type value_t;
+  size_t n = ids.size();
+  vector<Key> keys(n);
+  for (size_t i = 0; i < n; i++)
+  {
+    if constexpr (sizeof(Key) > 8)
+      keys[i] = ((Key)ids[i] << 64) | (ids[i] * 0x9e3779b97f4a7c15UL);
+    else
+      keys[i] = (Key)(ids[i] >> (64 - 8 * sizeof(Key)));
+  }
+  auto value_of = [](Key k)
+  { return (value_t)(k * 3 + 1); };
+  // narrow keys collide and Put does not look for an existing key, so only the first copy is inserted
+  vector<Key> sorted_keys(keys);
+  sort(sorted_keys.begin(), sorted_keys.end());
+  sorted_keys.erase(unique(sorted_keys.begin(), sorted_keys.end()), sorted_keys.end());
+  vector<bool> seen(sorted_keys.size());
+  n = 0;
+  for (Key k : keys)
+  {
+    size_t pos = lower_bound(sorted_keys.begin(), sorted_keys.end(), k) - sorted_keys.begin();
+    if (!seen[pos])
+    {
+      seen[pos] = true;
+      keys[n++] = k;
+    }
+  }
+  keys.resize(n);
+
+  tree_t *t = new tree_t(mode);
+  t->Init();
+  uint64_t used = t->clevel_mem()->Used();
+  uint64_t put_ns = util::timing([&]
+                                 {
+                                   for (size_t i = 0; i < n; i++)
+                                   {
+                                     t->Put(keys[i], value_of(keys[i]));
+                                   } });
+  used = t->clevel_mem()->Used() - used;
+  int wrong = 0;
+  value_t v;
+  uint64_t get_ns = util::timing([&]
+                                 {
+                                   for (size_t i = 0; i < n; i++)
+                                   {
+                                     if (!t->Get(keys[i], v) || v != value_of(keys[i]))
+                                       wrong++;
+                                   } });
+  // neighbours of inserted keys that were never inserted, mostly rejected by the node fingerprints
+  vector<Key> missing;
+  for (size_t i = 0; i < n; i++)
+  {
+    if (!binary_search(sorted_keys.begin(), sorted_keys.end(), keys[i] + 1))
+      missing.push_back(keys[i] + 1);
+  }
+  uint64_t miss_ns = util::timing([&]
+                                  {
+                                    for (Key k : missing)
+                                    {
+                                      if (t->Get(k, v))
+                                        wrong++;
+                                    } });
+  int wrong_scan = 0;
+  for (size_t i = 0; i < min<size_t>(n, 1000); i++)
+  {
+    auto it = lower_bound(sorted_keys.begin(), sorted_keys.end(), keys[i]);
+    int expect = min<int>(100, sorted_keys.end() - it);
+    int got = t->Scan(keys[i], 100, [&](Key k, value_t val)
+                      { wrong_scan += k != *it || val != value_of(*it);
+                        it++; });
+    wrong_scan += got != expect;
+  }
+  for (size_t i = 0; i < sorted_keys.size(); i += 4)
+  {
+    if (!t->Delete(sorted_keys[i]))
+      wrong++;
+  }
+  for (size_t i = 0; i < n; i++)
+  {
+    bool deleted = (lower_bound(sorted_keys.begin(), sorted_keys.end(), keys[i]) - sorted_keys.begin()) % 4 == 0;
+    if (t->Get(keys[i], v) == deleted)
+      wrong++;
+  }
+  cout << sizeof(Key) * 8 << "-bit keys, " << value_size << "B values : "
+       << tree_t::buncket_t::Capacity() << " records per node, put " << n * 1e3 / put_ns << " Mops, get "
+       << n * 1e3 / get_ns << " Mops, get missing " << missing.size() * 1e3 / miss_ns << " Mops, "
+       << (double)used / n << " C-level bytes per key, with "
+       << wrong << " wrong value, " << wrong_scan << " wrong scan." << endl;
+  delete t;
+}
+
 int main(int argc, char *argv[])
 {
   int thread_num = 1;
   size_t LOAD_SIZE = 10000000;
   size_t PUT_SIZE = 10000000;
   size_t GET_SIZE = 10000000;
+  letree::ConcurrencyMode mode = letree::default_concurrency_mode;
+  bool multiget = false;
+  bool scan = false;
+  bool recover = false;
+  size_t read_cache = 0;
+  size_t value_log = 0;
+  size_t string_keys = 0;
+  size_t typed = 0;
+  size_t delete_range = 0;
+  size_t range_scan = 0;
+  size_t multiput = 0;
 
   static struct option opts[] = {
       /* NAME               HAS_ARG            FLAG  SHORTNAME*/
       {"load-size", required_argument, NULL, 0},
       {"put-size", required_argument, NULL, 0},
       {"get-size", required_argument, NULL, 0},
+      {"mode", required_argument, NULL, 0},
+      {"multiget", no_argument, NULL, 0},
+      {"scan", no_argument, NULL, 0},
+      {"recover", no_argument, NULL, 0},
+      {"read-cache", required_argument, NULL, 0},
+      {"value-log", required_argument, NULL, 0},
+      {"string-keys", required_argument, NULL, 0},
+      {"typed", required_argument, NULL, 0},
+      {"delete-range", required_argument, NULL, 0},
+      {"range-scan", required_argument, NULL, 0},
+      {"multiput", required_argument, NULL, 0},
       {"help", no_argument, NULL, 'h'},
       {NULL, 0, NULL, 0}};
 
@@ -72,6 +204,49 @@ int main(int argc, char *argv[])
       case 2:
         GET_SIZE = atoi(optarg);
         break;
+      case 3:
+        if (string(optarg) == "single")
+          mode = letree::SingleThread;
+        else if (string(optarg) == "multi")
+          mode = letree::MultiThread;
+        else if (string(optarg) == "background")
+          mode = letree::MultiThreadBackground;
+        else
+        {
+          show_help(argv[0]);
+          return 0;
+        }
+        break;
+      case 4:
+        multiget = true;
+        break;
+      case 5:
+        scan = true;
+        break;
+      case 6:
+        recover = true;
+        break;
+      case 7:
+        read_cache = atol(optarg);
+        break;
+      case 8:
+        value_log = atol(optarg);
+        break;
+      case 9:
+        string_keys = atol(optarg);
+        break;
+      case 10:
+        typed = atol(optarg);
+        break;
+      case 11:
+        delete_range = atol(optarg);
+        break;
+      case 12:
+        range_scan = atol(optarg);
+        break;
+      case 13:
+        multiput = atol(optarg);
+        break;
       case 'h':
         show_help(argv[0]);
         return 0;
@@ -84,19 +259,23 @@ int main(int argc, char *argv[])
   cout << "LOAD_SIZE:             " << LOAD_SIZE << endl;
   cout << "PUT_SIZE:              " << PUT_SIZE << endl;
   cout << "GET_SIZE:              " << GET_SIZE << endl;
+  cout << "MODE:                  " << mode << endl;
 
   vector<uint64_t> data_base = generate_uniform_random(LOAD_SIZE + PUT_SIZE * 10);
   NVM::env_init();
-  KvDB *db = new LetDB();
+  KvDB *db = new LetDB(mode, recover ? letree::CreatePool : letree::TempPool);
   db->Init();
   uint64_t load_pos = 0;
   // load
   cout << "start loading ...." << endl;
   util::FastRandom ranny(18);
-  for (load_pos; load_pos < LOAD_SIZE; load_pos++)
-  {
-    db->Put(data_base[load_pos], (uint64_t)data_base[load_pos]);
-  }
+  uint64_t load_ns = util::timing([&]
+                                  {
+                                    for (load_pos; load_pos < LOAD_SIZE; load_pos++)
+                                    {
+                                      db->Put(data_base[load_pos], (uint64_t)data_base[load_pos]);
+                                    } });
+  cout << "load " << LOAD_SIZE << " kvs in " << load_ns / 1e6 << " ms." << endl;
   load_pos = LOAD_SIZE;
   // test put
   for (int i = 0; i < PUT_SIZE; i++)
@@ -114,15 +293,539 @@ int main(int argc, char *argv[])
 
   int wrong_get = 0;
   uint64_t value = 0;
-  for (uint64_t i = 0; i < GET_SIZE; i++)
+  uint64_t get_ns = util::timing([&]
+                                 {
+                                   for (uint64_t i = 0; i < GET_SIZE; i++)
+                                   {
+                                     db->Get(data_base[rand_pos[i]], value);
+                                     if (value != data_base[rand_pos[i]])
+                                     {
+                                       wrong_get++;
+                                     }
+                                   } });
+  cout << "test get " << GET_SIZE << " kvs, with " << wrong_get << " wrong value." << endl;
+#ifdef DRAM_INDEX
+  cout << "get (index in DRAM) : " << (double)get_ns / GET_SIZE << " ns/op" << endl;
+#else
+  cout << "get (index in PM) : " << (double)get_ns / GET_SIZE << " ns/op" << endl;
+#endif
+
+  // compare per-key Get with MultiGet on the same random keys
+  if (multiget)
   {
-    db->Get(data_base[rand_pos[i]], value);
-    if (value != data_base[rand_pos[i]])
+    vector<uint64_t> keys(GET_SIZE);
+    vector<uint64_t> values(GET_SIZE);
+    for (uint64_t i = 0; i < GET_SIZE; i++)
     {
-      wrong_get++;
+      keys[i] = data_base[rand_pos[i]];
+    }
+    uint64_t ns = util::timing([&]
+                               {
+                                 for (uint64_t i = 0; i < GET_SIZE; i++)
+                                 {
+                                   db->Get(keys[i], values[i]);
+                                 } });
+    cout << "get      : " << (double)ns / GET_SIZE << " ns/op" << endl;
+    for (int batch : {8, 16, 32})
+    {
+      fill(values.begin(), values.end(), 0);
+      ns = util::timing([&]
+                        {
+                          for (uint64_t i = 0; i < GET_SIZE; i += batch)
+                          {
+                            db->MultiGet(&keys[i], min<uint64_t>(batch, GET_SIZE - i), &values[i]);
+                          } });
+      wrong_get = 0;
+      for (uint64_t i = 0; i < GET_SIZE; i++)
+      {
+        if (values[i] != keys[i])
+          wrong_get++;
+      }
+      cout << "multiget " << batch << " : " << (double)ns / GET_SIZE << " ns/op, with "
+           << wrong_get << " wrong value." << endl;
     }
   }
-  cout << "test get " << GET_SIZE << " kvs, with " << wrong_get << " wrong value." << endl;
+
+  // compare Scan into a fresh vector with Scan into a reused buffer, check against the sorted keys
+  if (scan)
+  {
+    const int SCAN_LEN = 100;
+    const uint64_t SCAN_SIZE = GET_SIZE / SCAN_LEN;
+    vector<uint64_t> sorted_keys(data_base.begin(), data_base.begin() + load_pos);
+    sort(sorted_keys.begin(), sorted_keys.end());
+    sorted_keys.erase(unique(sorted_keys.begin(), sorted_keys.end()), sorted_keys.end());
+    uint64_t ns = util::timing([&]
+                               {
+                                 for (uint64_t i = 0; i < SCAN_SIZE; i++)
+                                 {
+                                   vector<pair<uint64_t, uint64_t>> results;
+                                   db->Scan(data_base[rand_pos[i]], SCAN_LEN, results);
+                                 } });
+    cout << "scan vector : " << (double)ns / SCAN_SIZE << " ns/op" << endl;
+    vector<pair<uint64_t, uint64_t>> buffer(SCAN_LEN);
+    ns = util::timing([&]
+                      {
+                        for (uint64_t i = 0; i < SCAN_SIZE; i++)
+                        {
+                          db->Scan(data_base[rand_pos[i]], SCAN_LEN, buffer.data());
+                        } });
+    int wrong_scan = 0;
+    for (uint64_t i = 0; i < SCAN_SIZE; i++)
+    {
+      auto it = lower_bound(sorted_keys.begin(), sorted_keys.end(), data_base[rand_pos[i]]);
+      int expect = min<int>(SCAN_LEN, sorted_keys.end() - it);
+      int n = db->Scan(data_base[rand_pos[i]], SCAN_LEN, buffer.data());
+      bool ok = n == expect;
+      for (int j = 0; ok && j < n; j++)
+        ok = buffer[j].first == it[j] && buffer[j].second == it[j];
+      if (!ok)
+        wrong_scan++;
+    }
+    cout << "scan buffer : " << (double)ns / SCAN_SIZE << " ns/op, with "
+         << wrong_scan << " wrong scan." << endl;
+  }
+
+  // zipfian Get on the loaded keys without and with the read cache, then update the hot keys through the cache
+  if (read_cache)
+  {
+    ycsbc::ScrambledZipfianGenerator zipf(0, load_pos - 1);
+    vector<uint64_t> keys(GET_SIZE);
+    for (uint64_t i = 0; i < GET_SIZE; i++)
+    {
+      keys[i] = data_base[zipf.Next()];
+    }
+    auto zipf_get = [&](const char *name)
+    {
+      wrong_get = 0;
+      uint64_t ns = util::timing([&]
+                                 {
+                                   for (uint64_t i = 0; i < GET_SIZE; i++)
+                                   {
+                                     db->Get(keys[i], value);
+                                     if (value != keys[i])
+                                       wrong_get++;
+                                   } });
+      cout << "zipfian get (" << name << ") : " << (double)ns / GET_SIZE << " ns/op, with "
+           << wrong_get << " wrong value." << endl;
+    };
+    zipf_get("no cache");
+    LetDB *let_db = static_cast<LetDB *>(db);
+    let_db->SetReadCache(read_cache);
+    zipf_get("read cache");
+    let_db->Info();
+    for (uint64_t i = 0; i < GET_SIZE / 100; i++)
+    {
+      db->Update(keys[i], keys[i] + 1);
+    }
+    wrong_get = 0;
+    for (uint64_t i = 0; i < GET_SIZE / 100; i++)
+    {
+      db->Get(keys[i], value);
+      if (value != keys[i] + 1)
+        wrong_get++;
+    }
+    cout << "update " << GET_SIZE / 100 << " hot kvs, with " << wrong_get << " stale value." << endl;
+    for (uint64_t i = 0; i < GET_SIZE / 100; i++)
+    {
+      db->Update(keys[i], keys[i]);
+    }
+  }
+
+  // variable-length values in a separate tree with a value log: write, overwrite all, delete a quarter, verify
+  if (value_log)
+  {
+    vector<uint64_t> keys = generate_uniform_random(value_log);
+    letree::letree *vt = new letree::letree(mode);
+    vt->Init();
+    vt->OpenValueLog();
+    auto make_value = [](uint64_t key, int round)
+    {
+      size_t len = 100 + (key ^ (key >> 17)) % (4096 - 100 + 1);
+      string v(len, (char)('a' + (key + round) % 26));
+      memcpy(&v[0], &key, sizeof(key));
+      v[8] = (char)round;
+      return v;
+    };
+    size_t bytes = 0;
+    for (int round = 0; round < 2; round++)
+    {
+      uint64_t ns = util::timing([&]
+                                 {
+                                   for (size_t i = 0; i < value_log; i++)
+                                   {
+                                     string v = make_value(keys[i], round);
+                                     bytes += v.size();
+                                     vt->PutValue(keys[i], v.data(), v.size());
+                                   } });
+      cout << (round ? "overwrite " : "put ") << value_log << " values : " << (double)ns / value_log << " ns/op" << endl;
+    }
+    for (size_t i = 0; i < value_log; i += 4)
+    {
+      vt->DeleteValue(keys[i]);
+    }
+    while (vt->CollectValueLog() > 0)
+      ;
+    int wrong_value = 0;
+    string v;
+    uint64_t ns = util::timing([&]
+                               {
+                                 for (size_t i = 0; i < value_log; i++)
+                                 {
+                                   bool found = vt->GetValue(keys[i], v);
+                                   if (i % 4 == 0 ? found : (!found || v != make_value(keys[i], 1)))
+                                     wrong_value++;
+                                 } });
+    cout << "get " << value_log << " values : " << (double)ns / value_log << " ns/op, with "
+         << wrong_value << " wrong value, " << bytes << " value bytes written." << endl;
+    vt->value_log()->Info();
+    delete vt;
+  }
+
+  // ycsb-style keys ("user" + hashed number), both indexes keyed by the 8 bytes after "user"
+  if (string_keys)
+  {
+    vector<uint64_t> ids = generate_uniform_random(string_keys);
+    vector<string> keys(string_keys);
+    for (size_t i = 0; i < string_keys; i++)
+    {
+      keys[i] = "user" + to_string(ids[i]);
+    }
+    vector<string> missing(string_keys);
+    for (size_t i = 0; i < string_keys; i++)
+    {
+      missing[i] = keys[i] + "0";
+    }
+    vector<size_t> order(string_keys);
+    for (size_t i = 0; i < string_keys; i++)
+    {
+      order[i] = ranny.RandUint32(0, string_keys - 1);
+    }
+    auto string_bench = [&](const char *name, auto &&put, auto &&get)
+    {
+      uint64_t put_ns = util::timing([&]
+                                     {
+                                       for (size_t i = 0; i < string_keys; i++)
+                                       {
+                                         put(keys[i], string_view((const char *)&ids[i], sizeof(uint64_t)));
+                                       } });
+      int wrong = 0;
+      string v;
+      uint64_t get_ns = util::timing([&]
+                                     {
+                                       for (size_t i = 0; i < string_keys; i++)
+                                       {
+                                         size_t j = order[i];
+                                         if (!get(keys[j], v) || memcmp(v.data(), &ids[j], sizeof(uint64_t)) != 0)
+                                           wrong++;
+                                       } });
+      // keys that were never inserted, mostly rejected by the fingerprint before reading PM
+      uint64_t miss_ns = util::timing([&]
+                                      {
+                                        for (size_t i = 0; i < string_keys; i++)
+                                        {
+                                          if (get(missing[i], v))
+                                            wrong++;
+                                        } });
+      cout << name << " : put " << string_keys * 1e3 / put_ns << " Mops, get " << string_keys * 1e3 / get_ns
+           << " Mops, get missing " << string_keys * 1e3 / miss_ns << " Mops, with " << wrong << " wrong value." << endl;
+    };
+    auto string_letree_bench = [&](const char *name)
+    {
+      letree::StringLetree *st = new letree::StringLetree("user", mode);
+      st->Init();
+      string_bench(name, [&](const string &k, string_view v)
+                   { st->Put(k, v); },
+                   [&](const string &k, string &v)
+                   { return st->Get(k, v); });
+      vector<string> sorted_keys(keys);
+      sort(sorted_keys.begin(), sorted_keys.end());
+      sorted_keys.erase(unique(sorted_keys.begin(), sorted_keys.end()), sorted_keys.end());
+      int wrong_scan = 0;
+      for (size_t i = 0; i < min<size_t>(string_keys, 1000); i++)
+      {
+        const string &start = keys[order[i]];
+        auto it = lower_bound(sorted_keys.begin(), sorted_keys.end(), start);
+        int expect = min<int>(100, sorted_keys.end() - it);
+        int n = st->Scan(start, 100, [&](const string &k, string_view)
+                         { wrong_scan += k != *it++; });
+        wrong_scan += n != expect;
+      }
+      cout << name << " scan 100 : " << wrong_scan << " wrong scan." << endl;
+      delete st;
+    };
+    string_letree_bench("string letree");
+    FastFairStringDb ff("user");
+    ff.Init();
+    string_bench("fast&fair", [&](const string &k, string_view v)
+                 { ff.Put(k, v); },
+                 [&](const string &k, string &v)
+                 { return ff.Get(k, v); });
+    // zero-padded keys share the 8 bytes after "user", so they all fall under one prefix whose blocks keep splitting
+    for (size_t i = 0; i < string_keys; i++)
+    {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "user%020lu", i);
+      keys[i] = buf;
+      missing[i] = keys[i] + "0";
+    }
+    string_letree_bench("string letree, shared prefix");
+  }
+
+  if (typed)
+  {
+    vector<uint64_t> ids = generate_uniform_random(typed);
+    typed_bench<uint32_t, 4>(ids, mode);
+    typed_bench<uint64_t, 8>(ids, mode);
+    typed_bench<letree::uint128_t, 16>(ids, mode);
+  }
+
+  // DeleteRange on a separate tree against a std::map: ranges inside one node, ranges that drop whole nodes,
+  // empty ranges and the tail of the key space, then half of the removed keys are put back
+  if (delete_range)
+  {
+    vector<uint64_t> keys = generate_uniform_random(delete_range);
+    letree::letree *dt = new letree::letree(mode);
+    dt->Init();
+    map<uint64_t, uint64_t> ref;
+    for (uint64_t k : keys)
+    {
+      // Put does not look for an existing key, so only the first copy is inserted
+      if (ref.emplace(k, k + 1).second)
+        dt->Put(k, k + 1);
+    }
+    int wrong_count = 0, wrong_value = 0, wrong_scan = 0;
+    vector<uint64_t> removed;
+    auto erase = [&](uint64_t lo, uint64_t hi)
+    {
+      auto first = ref.lower_bound(lo), last = lo > hi ? first : ref.upper_bound(hi);
+      uint64_t expect = distance(first, last);
+      for (auto it = first; it != last; ++it)
+        removed.push_back(it->first);
+      ref.erase(first, last);
+      if (dt->DeleteRange(lo, hi) != expect)
+        wrong_count++;
+    };
+    auto check = [&]()
+    {
+      uint64_t v;
+      for (uint64_t k : keys)
+      {
+        auto it = ref.find(k);
+        bool found = dt->Get(k, v);
+        if (it == ref.end() ? found : (!found || v != it->second))
+          wrong_value++;
+      }
+      for (size_t i = 0; i < min<size_t>(keys.size(), 1000); i++)
+      {
+        auto it = ref.lower_bound(keys[i * 7 % keys.size()]);
+        int expect = min<size_t>(100, distance(it, ref.end()));
+        int n = dt->Scan(keys[i * 7 % keys.size()], 100, [&](uint64_t k, uint64_t val)
+                         { wrong_scan += it == ref.end() || k != it->first || val != it->second;
+                           if (it != ref.end())
+                             it++; });
+        wrong_scan += n != expect;
+      }
+    };
+    uint64_t gap = UINT64_MAX / ref.size();
+    size_t before = ref.size(), ranges = 0;
+    uint64_t ns = util::timing([&]
+                               {
+                                 // each width removes about 5% of the keys
+                                 for (uint64_t width : {1, 10, 100, 1000})
+                                 {
+                                   for (size_t i = 0; i < before / width / 20; i++, ranges++)
+                                   {
+                                     uint64_t lo = keys[ranny.RandUint32(0, keys.size() - 1)];
+                                     erase(lo, lo + min(gap * width, UINT64_MAX - lo));
+                                   }
+                                 }
+                                 // a tenth of the key space covers whole groups, which are truncated to one node
+                                 uint64_t lo = keys[ranny.RandUint32(0, keys.size() - 1)] / 10 * 9;
+                                 erase(lo, lo + UINT64_MAX / 10);
+                                 erase(keys[0] + 1, keys[0]);
+                                 erase(ref.rbegin()->first - gap * 100, UINT64_MAX);
+                                 ranges += 3; });
+    check();
+    cout << "delete range : " << before - ref.size() << " of " << before << " keys in " << ranges << " ranges, "
+         << (double)ns / ranges << " ns/range, with " << wrong_count << " wrong count, " << wrong_value
+         << " wrong value, " << wrong_scan << " wrong scan." << endl;
+    wrong_value = wrong_scan = 0;
+    for (size_t i = 0; i < removed.size(); i += 2)
+    {
+      dt->Put(removed[i], removed[i] + 2);
+      ref.emplace(removed[i], removed[i] + 2);
+    }
+    check();
+    cout << "put back " << (removed.size() + 1) / 2 << " removed keys, with " << wrong_value << " wrong value, "
+         << wrong_scan << " wrong scan." << endl;
+    delete dt;
+  }
+
+  // ScanRange, ReverseScan and the iterator on a separate tree with a quarter of the keys deleted, against a std::map
+  if (range_scan)
+  {
+    vector<uint64_t> keys = generate_uniform_random(range_scan);
+    letree::letree *rt = new letree::letree(mode);
+    rt->Init();
+    map<uint64_t, uint64_t> ref;
+    for (uint64_t k : keys)
+    {
+      if (ref.emplace(k, k + 1).second)
+        rt->Put(k, k + 1);
+    }
+    for (size_t i = 0; i < keys.size(); i += 4)
+    {
+      if (ref.erase(keys[i]))
+        rt->Delete(keys[i]);
+    }
+    const int checks = min<size_t>(keys.size(), 1000);
+    uint64_t gap = UINT64_MAX / ref.size();
+    const uint64_t widths[] = {1, 10, 100, 1000};
+    int wrong_range = 0;
+    uint64_t visited = 0;
+    for (int i = 0; i < checks; i++)
+    {
+      // ranges of about 1 to 1000 keys starting at a deleted key, a present key or between keys
+      uint64_t lo = keys[i] - (i % 3 == 2 ? gap / 2 : 0);
+      uint64_t hi = lo + min(gap * widths[i % 4], UINT64_MAX - lo);
+      auto it = ref.lower_bound(lo), last = ref.lower_bound(hi);
+      uint64_t n = rt->ScanRange(lo, hi, [&](uint64_t k, uint64_t v)
+                                 { wrong_range += it == last || k != it->first || v != it->second;
+                                   if (it != last)
+                                     it++; });
+      wrong_range += n != (uint64_t)distance(ref.lower_bound(lo), last) || it != last;
+      visited += n;
+    }
+    vector<pair<uint64_t, uint64_t>> results;
+    wrong_range += rt->ScanRange(keys[1], keys[1], results) != 0 || !results.empty();
+    wrong_range += rt->ScanRange(0, UINT64_MAX, results) != ref.size() - ref.count(UINT64_MAX);
+    int wrong_reverse = 0;
+    vector<pair<uint64_t, uint64_t>> buffer(100);
+    for (int i = 0; i < checks; i++)
+    {
+      uint64_t start = keys[i] - (i % 3 == 2 ? gap / 2 : 0);
+      auto it = make_reverse_iterator(ref.upper_bound(start));
+      int expect = min<size_t>(100, distance(it, ref.rend()));
+      int n = rt->ReverseScan(start, 100, buffer.data());
+      wrong_reverse += n != expect;
+      for (int j = 0; j < min(n, expect); j++, it++)
+        wrong_reverse += buffer[j].first != it->first || buffer[j].second != it->second;
+    }
+    int wrong_iter = 0;
+    for (int i = 0; i < checks; i++)
+    {
+      uint64_t target = keys[i] - (i % 3 == 2 ? gap / 2 : 0);
+      letree::letree::Iter iter(rt);
+      // Seek then walk forward, then back past the start
+      iter.Seek(target);
+      auto it = ref.lower_bound(target);
+      for (int j = 0; j < 50 && it != ref.end(); j++, it++, iter.next())
+        wrong_iter += iter.end() || iter.key() != it->first || iter.value() != it->second;
+      wrong_iter += (it == ref.end()) != iter.end();
+      if (it != ref.end())
+      {
+        for (int j = 0; j < 100 && it != ref.begin(); j++)
+        {
+          iter.prev();
+          it--;
+          wrong_iter += iter.end() || iter.key() != it->first;
+        }
+      }
+      // SeekForPrev then walk backward
+      iter.SeekForPrev(target);
+      auto rit = make_reverse_iterator(ref.upper_bound(target));
+      for (int j = 0; j < 50 && rit != ref.rend(); j++, rit++, iter.prev())
+        wrong_iter += iter.end() || iter.key() != rit->first || iter.value() != rit->second;
+      wrong_iter += (rit == ref.rend()) != iter.end();
+    }
+    // whole walks in both directions
+    size_t forward = 0, backward = 0;
+    auto it = ref.begin();
+    for (letree::letree::Iter iter(rt); !iter.end(); iter.next(), forward++)
+      wrong_iter += it == ref.end() || iter.key() != (it++)->first;
+    auto rit = ref.rbegin();
+    letree::letree::Iter iter(rt);
+    for (iter.SeekForPrev(UINT64_MAX); !iter.end(); iter.prev(), backward++)
+      wrong_iter += rit == ref.rend() || iter.key() != (rit++)->first;
+    wrong_iter += forward != ref.size() || backward != ref.size();
+    cout << "range scan : " << checks << " ranges visited " << visited << " keys, with " << wrong_range
+         << " wrong range, " << wrong_reverse << " wrong reverse scan, " << wrong_iter << " wrong iterator step." << endl;
+    delete rt;
+  }
+
+  // MultiPut on a separate tree in unsorted batches, with scans between the rounds so that split nodes take the
+  // sorted layout and later batches fill their tails and go through the rewrite fallback
+  if (multiput)
+  {
+    vector<uint64_t> keys = generate_uniform_random(multiput);
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+    vector<uint64_t> sorted_keys(keys);
+    shuffle(keys.begin(), keys.end(), mt19937_64(13));
+    letree::letree *mt = new letree::letree(mode);
+    mt->Init();
+    const int batch = 256, rounds = 10;
+    vector<pair<uint64_t, uint64_t>> kvs(batch);
+    vector<pair<uint64_t, uint64_t>> buffer(100);
+    uint64_t put_ns = 0;
+    size_t pos = 0;
+    for (int round = 1; round <= rounds; round++)
+    {
+      put_ns += util::timing([&]
+                             {
+                               for (; pos < keys.size() * round / rounds; pos += batch)
+                               {
+                                 int n = min<size_t>(batch, keys.size() * round / rounds - pos);
+                                 for (int i = 0; i < n; i++)
+                                   kvs[i] = {keys[pos + i], keys[pos + i] + 1};
+                                 mt->MultiPut(kvs.data(), n);
+                               }
+                               pos = keys.size() * round / rounds; });
+      for (size_t i = 0; i < keys.size() / 20; i++)
+        mt->Scan(keys[i], 100, buffer.data());
+    }
+    int wrong = 0, wrong_scan = 0;
+    uint64_t v;
+    for (uint64_t k : keys)
+    {
+      if (!mt->Get(k, v) || v != k + 1)
+        wrong++;
+    }
+    for (size_t i = 0; i < min<size_t>(keys.size(), 1000); i++)
+    {
+      auto it = lower_bound(sorted_keys.begin(), sorted_keys.end(), keys[i]);
+      int expect = min<int>(100, sorted_keys.end() - it);
+      int n = mt->Scan(keys[i], 100, buffer.data());
+      wrong_scan += n != expect;
+      for (int j = 0; j < min(n, expect); j++)
+        wrong_scan += buffer[j].first != it[j] || buffer[j].second != it[j] + 1;
+    }
+    cout << "multiput " << keys.size() << " kvs in batches of " << batch << " : " << keys.size() * 1e3 / put_ns
+         << " Mops, with " << wrong << " wrong value, " << wrong_scan << " wrong scan." << endl;
+    delete mt;
+  }
+
+  // close the tree, unmap both pools and rebuild it from what is left on PM
+  if (recover)
+  {
+    delete db;
+    NVM::env_exit();
+    NVM::env_init();
+    uint64_t ns = util::timing([&]
+                               {
+                                 db = new LetDB(mode, letree::OpenPool);
+                                 db->Init(); });
+    wrong_get = 0;
+    for (uint64_t i = 0; i < GET_SIZE; i++)
+    {
+      value = 0;
+      db->Get(data_base[rand_pos[i]], value);
+      if (value != data_base[rand_pos[i]])
+        wrong_get++;
+    }
+    cout << "recover " << load_pos << " kvs in " << ns / 1e6 << " ms, load took "
+         << load_ns / 1e6 << " ms, with " << wrong_get << " wrong value." << endl;
+  }
 
   delete db;
   NVM::env_exit();
@@ -0,0 +1,295 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <x86intrin.h>
+#include "getopt.h"
+#include "../src/letree.h"
+#include "random.h"
+
+using letree::Random;
+using letree::simd::Isa;
+using namespace std;
+
+// cycles per lookup of the in-node search kernels, nodes are kept in DRAM so only the search itself is timed
+
+static const Isa all_isas[] = {Isa::Scalar, Isa::SSE2, Isa::AVX2, Isa::AVX512};
+
+void show_help(char *prog)
+{
+  cout << "Usage: " << prog << " [options]" << endl
+       << endl
+       << "  Option:" << endl
+       << "    --nodes                  NODES, number of nodes of each size (default 4096)" << endl
+       << "    --lookups                LOOKUPS, lookups per kernel (default 4M)" << endl
+       << "    --help[-h]               show help" << endl;
+}
+
+template <typename Node>
+Node *new_nodes(size_t n)
+{
+  return (Node *)new (std::align_val_t{64}) char[n * sizeof(Node)];
+}
+
+// runs find(node, key) for every (node, key) pair and returns cycles per lookup, found counts the hits
+template <typename Node, typename Find>
+double time_lookups(Node *nodes, const vector<pair<uint32_t, uint64_t>> &probes, int &found, Find &&find)
+{
+  found = 0;
+  uint64_t start = __rdtsc();
+  for (auto &p : probes)
+    found += find(nodes[p.first], p.second);
+  return (double)(__rdtsc() - start) / probes.size();
+}
+
+void report(const char *name, size_t node_size, int capacity, Isa isa, double hit, double miss, int wrong)
+{
+  cout << left << setw(16) << name << setw(6) << node_size << setw(8) << capacity << setw(8)
+       << letree::simd::IsaName(isa) << fixed << setprecision(1) << setw(10) << hit << setw(10) << miss
+       << wrong << endl;
+}
+
+// fills every node to capacity, then probes each kernel with keys that are present and keys that are not
+template <typename Node, typename Put, typename Find>
+void bench_nodes(const char *name, size_t node_size, size_t nr_nodes, size_t lookups, Put &&put, Find &&find)
+{
+  Random rnd(1, UINT64_MAX - 1, 7);
+  Node *nodes = new_nodes<Node>(nr_nodes);
+  vector<vector<uint64_t>> keys(nr_nodes);
+  int capacity = 0;
+  for (size_t i = 0; i < nr_nodes; i++)
+  {
+    keys[i] = put(&nodes[i], rnd);
+    capacity = keys[i].size();
+  }
+  vector<pair<uint32_t, uint64_t>> hits(lookups), misses(lookups);
+  for (size_t i = 0; i < lookups; i++)
+  {
+    uint32_t n = rnd.Next() % nr_nodes;
+    hits[i] = {n, keys[n][rnd.Next() % keys[n].size()]};
+    misses[i] = {(uint32_t)(rnd.Next() % nr_nodes), rnd.Next() | 1}; // inserted keys are even
+  }
+  for (Isa isa : all_isas)
+  {
+    if (isa > letree::simd::kIsa)
+      break;
+    int found_hits, found_misses;
+    double hit = time_lookups(nodes, hits, found_hits, [&](const Node &node, uint64_t key)
+                              { return find(node, key, isa); });
+    double miss = time_lookups(nodes, misses, found_misses, [&](const Node &node, uint64_t key)
+                               { return find(node, key, isa); });
+    report(name, node_size, capacity, isa, hit, miss, (int)(lookups - found_hits) + found_misses);
+  }
+  delete[] (char *)nodes;
+}
+
+template <size_t size>
+void bench_unsorted(size_t nr_nodes, size_t lookups)
+{
+  typedef letree::UnSortBuncket<size, 8, 8> node_t;
+  bench_nodes<node_t>(
+      "unsorted", size, nr_nodes, lookups,
+      [](node_t *node, Random &rnd)
+      {
+        new (node) node_t(0, 0);
+        vector<uint64_t> keys;
+        while (node->Put(nullptr, rnd.Next() & ~1UL, 1) == letree::status::OK)
+          keys.push_back(node->key(keys.size()));
+        return keys;
+      },
+      [](const node_t &node, uint64_t key, Isa isa)
+      {
+        bool find = false;
+        switch (isa)
+        {
+        case Isa::Scalar:
+          node.template Find<Isa::Scalar>(key, find);
+          break;
+        case Isa::SSE2:
+          node.template Find<Isa::SSE2>(key, find);
+          break;
+        case Isa::AVX2:
+          node.template Find<Isa::AVX2>(key, find);
+          break;
+        default:
+          node.template Find<Isa::AVX512>(key, find);
+        }
+        return find;
+      });
+}
+
+// fills a sorted node to capacity: an ascending run, then TailCapacity() keys in random order that land in the tail
+template <typename node_t>
+vector<uint64_t> fill_sorted(node_t *node, Random &rnd, uint64_t mask)
+{
+  new (node) node_t(0, 0);
+  vector<uint64_t> keys(node_t::Capacity());
+  for (auto &key : keys)
+    key = rnd.Next() & mask;
+  sort(keys.begin(), keys.end() - node_t::TailCapacity());
+  for (uint64_t key : keys)
+    node->Put(nullptr, key, 1);
+  return keys;
+}
+
+template <size_t size, bool with_tail>
+void bench_sorted(size_t nr_nodes, size_t lookups)
+{
+  typedef letree::SortBuncket<size, 8, 8, with_tail> node_t;
+  bench_nodes<node_t>(
+      with_tail ? "sorted+tail" : "sorted", size, nr_nodes, lookups,
+      [](node_t *node, Random &rnd)
+      { return fill_sorted(node, rnd, ~1UL); },
+      [](const node_t &node, uint64_t key, Isa isa)
+      {
+        bool find = false;
+        switch (isa)
+        {
+        case Isa::Scalar:
+        case Isa::SSE2:
+          node.template Find<Isa::Scalar>(key, find);
+          break;
+        case Isa::AVX2:
+          node.template Find<Isa::AVX2>(key, find);
+          break;
+        default:
+          node.template Find<Isa::AVX512>(key, find);
+        }
+        return find;
+      });
+}
+
+// cycles per in-order visit of a whole node filled by Put, sorted nodes are filled by fill_sorted
+template <typename node_t, bool sorted>
+void bench_visit(const char *name, size_t size, size_t nr_nodes, size_t lookups)
+{
+  Random rnd(1, UINT64_MAX - 1, 7);
+  node_t *nodes = new_nodes<node_t>(nr_nodes);
+  vector<int> counts(nr_nodes);
+  for (size_t i = 0; i < nr_nodes; i++)
+  {
+    if constexpr (sorted)
+    {
+      counts[i] = fill_sorted(&nodes[i], rnd, ~0UL).size();
+      continue;
+    }
+    new (&nodes[i]) node_t(0, 0);
+    while (nodes[i].Put(nullptr, rnd.Next(), 1) == letree::status::OK)
+      counts[i]++;
+  }
+  int wrong = 0;
+  uint64_t start = __rdtsc();
+  for (size_t i = 0; i < lookups; i++)
+  {
+    uint64_t n = rnd.Next() % nr_nodes, prev = 0;
+    int visited = nodes[n].Visit(0, UINT64_MAX, node_t::Capacity(), [&](uint64_t k, uint64_t v)
+                                 { wrong += k < prev; prev = k; });
+    wrong += visited != counts[n];
+  }
+  double cycles = (double)(__rdtsc() - start) / lookups;
+  cout << left << setw(16) << name << setw(6) << size << setw(8) << node_t::Capacity() << setw(8) << ""
+       << fixed << setprecision(1) << setw(20) << cycles << wrong << endl;
+  delete[] (char *)nodes;
+}
+
+// PointerBEntry::Find_pos over its 4 eentries, a lookup counts as found when it picks the right node
+void bench_bentry(size_t nr_nodes, size_t lookups)
+{
+  typedef letree::PointerBEntry<uint64_t, 8> bentry_t;
+  bench_nodes<bentry_t>(
+      "pointer entry", sizeof(bentry_t), nr_nodes, lookups,
+      [](bentry_t *entry, Random &rnd)
+      {
+        memset((void *)entry, 0, sizeof(bentry_t));
+        vector<uint64_t> keys;
+        for (int i = 0; i < bentry_t::entry_count; i++)
+          keys.push_back(rnd.Next() & ~1UL);
+        sort(keys.begin(), keys.end());
+        for (int i = 0; i < bentry_t::entry_count; i++)
+          entry->entrys[i].entry_key = keys[i];
+        entry->buf.entries = bentry_t::entry_count;
+        return keys;
+      },
+      [](const bentry_t &entry, uint64_t key, Isa isa)
+      {
+        int pos;
+        switch (isa)
+        {
+        case Isa::Scalar:
+        case Isa::SSE2:
+          pos = entry.Find_pos<Isa::Scalar>(key);
+          break;
+        case Isa::AVX2:
+          pos = entry.Find_pos<Isa::AVX2>(key);
+          break;
+        default:
+          pos = entry.Find_pos<Isa::AVX512>(key);
+        }
+        return entry.entrys[pos].entry_key == key;
+      });
+}
+
+int main(int argc, char *argv[])
+{
+  size_t nr_nodes = 4096;
+  size_t lookups = 4 << 20;
+
+  static struct option opts[] = {
+      /* NAME               HAS_ARG            FLAG  SHORTNAME*/
+      {"nodes", required_argument, NULL, 0},
+      {"lookups", required_argument, NULL, 0},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0}};
+
+  int c;
+  int opt_idx;
+  while ((c = getopt_long(argc, argv, "h", opts, &opt_idx)) != -1)
+  {
+    switch (c)
+    {
+    case 0:
+      switch (opt_idx)
+      {
+      case 0:
+        nr_nodes = atol(optarg);
+        break;
+      case 1:
+        lookups = atol(optarg);
+        break;
+      }
+      break;
+    case 'h':
+    default:
+      show_help(argv[0]);
+      return 0;
+    }
+  }
+
+  cout << "compiled for " << letree::simd::IsaName(letree::simd::kIsa) << ", " << nr_nodes << " nodes, "
+       << lookups << " lookups" << endl;
+  cout << left << setw(16) << "node" << setw(6) << "size" << setw(8) << "slots" << setw(8) << "isa"
+       << setw(10) << "hit" << setw(10) << "miss" << "wrong" << endl;
+  bench_unsorted<128>(nr_nodes, lookups);
+  bench_unsorted<256>(nr_nodes, lookups);
+  bench_unsorted<512>(nr_nodes, lookups);
+  bench_sorted<128, false>(nr_nodes, lookups);
+  bench_sorted<256, false>(nr_nodes, lookups);
+  bench_sorted<512, false>(nr_nodes, lookups);
+  bench_sorted<128, true>(nr_nodes, lookups);
+  bench_sorted<256, true>(nr_nodes, lookups);
+  bench_sorted<512, true>(nr_nodes, lookups);
+  bench_bentry(nr_nodes, lookups);
+  cout << endl
+       << left << setw(16) << "node" << setw(6) << "size" << setw(8) << "slots" << setw(8) << ""
+       << setw(20) << "cycles" << "wrong" << endl;
+  bench_visit<letree::UnSortBuncket<128, 8, 8>, false>("unsorted visit", 128, nr_nodes, lookups / 4);
+  bench_visit<letree::UnSortBuncket<256, 8, 8>, false>("unsorted visit", 256, nr_nodes, lookups / 4);
+  bench_visit<letree::UnSortBuncket<512, 8, 8>, false>("unsorted visit", 512, nr_nodes, lookups / 4);
+  bench_visit<letree::SortBuncket<128, 8, 8, false>, true>("sorted visit", 128, nr_nodes, lookups / 4);
+  bench_visit<letree::SortBuncket<256, 8, 8, false>, true>("sorted visit", 256, nr_nodes, lookups / 4);
+  bench_visit<letree::SortBuncket<512, 8, 8, false>, true>("sorted visit", 512, nr_nodes, lookups / 4);
+  bench_visit<letree::SortBuncket<128, 8, 8, true>, true>("tail visit", 128, nr_nodes, lookups / 4);
+  bench_visit<letree::SortBuncket<256, 8, 8, true>, true>("tail visit", 256, nr_nodes, lookups / 4);
+  bench_visit<letree::SortBuncket<512, 8, 8, true>, true>("tail visit", 512, nr_nodes, lookups / 4);
+  return 0;
+}
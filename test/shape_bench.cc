@@ -0,0 +1,152 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "getopt.h"
+#include "../src/letree.h"
+#include "random.h"
+#include "util.h"
+
+using letree::Random;
+using namespace std;
+
+// the same workload on letree instantiated with different C-level node sizes and PointerBEntry fanouts,
+// reports throughput, bytes flushed to PM per put (NVM::pmem_size) and C-level bytes per key
+
+void show_help(char *prog)
+{
+  cout << "Usage: " << prog << " [options]" << endl
+       << endl
+       << "  Option:" << endl
+       << "    --keys                   KEYS, number of random 64-bit keys (default 1M)" << endl
+       << "    --scans                  SCANS, number of 100-key scans (default 100K)" << endl
+       << "    --mode                   single | multi | background" << endl
+       << "    --help[-h]               show help" << endl;
+}
+
+template <size_t node_size, int fanout>
+void bench_shape(const vector<uint64_t> &keys, const vector<uint64_t> &sorted_keys, size_t scans,
+                 letree::ConcurrencyMode mode)
+{
+  typedef letree::basic_letree<uint64_t, 8, node_size, fanout> tree_t;
+  size_t n = keys.size();
+  auto value_of = [](uint64_t k)
+  { return k * 3 + 1; };
+
+  tree_t *t = new tree_t(mode);
+  t->Init();
+  uint64_t used = t->clevel_mem()->Used();
+  NVM::pmem_size = 0;
+  uint64_t put_ns = util::timing([&]
+                                 {
+                                   for (uint64_t k : keys)
+                                     t->Put(k, value_of(k)); });
+  uint64_t written = NVM::pmem_size;
+  used = t->clevel_mem()->Used() - used;
+  int wrong = 0;
+  uint64_t v;
+  uint64_t get_ns = util::timing([&]
+                                 {
+                                   for (uint64_t k : keys)
+                                   {
+                                     if (!t->Get(k, v) || v != value_of(k))
+                                       wrong++;
+                                   } });
+  int wrong_scan = 0;
+  uint64_t scan_ns = util::timing([&]
+                                  {
+                                    for (size_t i = 0; i < scans; i++)
+                                    {
+                                      auto it = lower_bound(sorted_keys.begin(), sorted_keys.end(), keys[i % n]);
+                                      int expect = min<int>(100, sorted_keys.end() - it);
+                                      int got = t->Scan(keys[i % n], 100, [&](uint64_t k, uint64_t val)
+                                                        { wrong_scan += k != *it || val != value_of(*it);
+                                                          it++; });
+                                      wrong_scan += got != expect;
+                                    } });
+  cout << left << setw(6) << node_size << setw(8) << fanout << setw(8) << tree_t::buncket_t::Capacity()
+       << fixed << setprecision(2) << setw(10) << n * 1e3 / put_ns << setw(10) << n * 1e3 / get_ns
+       << setw(10) << scans * 1e6 / scan_ns << setprecision(1) << setw(12) << (double)written / n
+       << setw(12) << (double)used / n << wrong << "/" << wrong_scan << endl;
+  delete t;
+}
+
+int main(int argc, char *argv[])
+{
+  size_t nr_keys = 1 << 20;
+  size_t scans = 100000;
+  letree::ConcurrencyMode mode = letree::default_concurrency_mode;
+
+  static struct option opts[] = {
+      /* NAME               HAS_ARG            FLAG  SHORTNAME*/
+      {"keys", required_argument, NULL, 0},
+      {"scans", required_argument, NULL, 0},
+      {"mode", required_argument, NULL, 0},
+      {"help", no_argument, NULL, 'h'},
+      {NULL, 0, NULL, 0}};
+
+  int c;
+  int opt_idx;
+  while ((c = getopt_long(argc, argv, "h", opts, &opt_idx)) != -1)
+  {
+    switch (c)
+    {
+    case 0:
+      switch (opt_idx)
+      {
+      case 0:
+        nr_keys = atol(optarg);
+        break;
+      case 1:
+        scans = atol(optarg);
+        break;
+      case 2:
+        if (string(optarg) == "single")
+          mode = letree::SingleThread;
+        else if (string(optarg) == "multi")
+          mode = letree::MultiThread;
+        else if (string(optarg) == "background")
+          mode = letree::MultiThreadBackground;
+        else
+        {
+          show_help(argv[0]);
+          return 0;
+        }
+        break;
+      }
+      break;
+    case 'h':
+    default:
+      show_help(argv[0]);
+      return 0;
+    }
+  }
+
+  NVM::data_init();
+  // Put does not look for an existing key, so duplicates are dropped before the keys are shuffled
+  Random rnd(1, UINT64_MAX - 1, 7);
+  vector<uint64_t> sorted_keys(nr_keys);
+  for (auto &k : sorted_keys)
+    k = rnd.Next();
+  sort(sorted_keys.begin(), sorted_keys.end());
+  sorted_keys.erase(unique(sorted_keys.begin(), sorted_keys.end()), sorted_keys.end());
+  vector<uint64_t> keys(sorted_keys);
+  shuffle(keys.begin(), keys.end(), mt19937_64(7));
+
+  cout << keys.size() << " keys, " << scans << " scans" << endl;
+  cout << left << setw(6) << "node" << setw(8) << "fanout" << setw(8) << "slots" << setw(10) << "put Mops" << setw(10)
+       << "get Mops" << setw(10) << "scan Kops" << setw(12) << "PM B/put" << setw(12) << "B/key" << "wrong" << endl;
+  // node sizes that are multiples of 256 keep every C-level node on its own XPLines (Optane's 256B media unit)
+  bench_shape<128, 4>(keys, sorted_keys, scans, mode);
+  bench_shape<128, 8>(keys, sorted_keys, scans, mode);
+  bench_shape<256, 4>(keys, sorted_keys, scans, mode);
+  bench_shape<256, 8>(keys, sorted_keys, scans, mode);
+  bench_shape<256, 16>(keys, sorted_keys, scans, mode);
+  bench_shape<256, 32>(keys, sorted_keys, scans, mode);
+  bench_shape<512, 4>(keys, sorted_keys, scans, mode);
+  bench_shape<512, 8>(keys, sorted_keys, scans, mode);
+  bench_shape<1024, 4>(keys, sorted_keys, scans, mode);
+  bench_shape<1024, 8>(keys, sorted_keys, scans, mode);
+  return 0;
+}